@@ -0,0 +1,171 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "cam_decimate.h"
+
+static inline size_t out_line_size(const cam_decimate_t *dec)
+{
+    return (dec->width >> dec->shift) * dec->bytes_per_pixel;
+}
+
+esp_err_t cam_decimate_init(cam_decimate_t *dec, camera_decimate_t mode, pixformat_t format, uint16_t width, uint16_t height)
+{
+    cam_decimate_deinit(dec);
+    if (cam_decimate_shift(mode) == 0 || format == PIXFORMAT_JPEG) {
+        return ESP_OK;
+    }
+
+    uint8_t shift = cam_decimate_shift(mode);
+    bool average = mode == CAMERA_DECIMATE_2X_AVERAGE || mode == CAMERA_DECIMATE_4X_AVERAGE;
+    bool yuyv = format == PIXFORMAT_YUV422;
+    uint8_t bytes_per_pixel = format == PIXFORMAT_GRAYSCALE ? 1 : 2;
+    uint16_t width_align = (yuyv ? 2 : 1) << shift;
+
+    if (average && format == PIXFORMAT_RGB565) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if ((width % width_align) || (height % (1 << shift))) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    dec->shift = shift;
+    dec->average = average;
+    dec->yuyv = yuyv;
+    dec->bytes_per_pixel = bytes_per_pixel;
+    dec->width = width;
+    dec->line = 0;
+    if (average) {
+        dec->sum = heap_caps_malloc(out_line_size(dec) * sizeof(uint16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!dec->sum) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    dec->factor = 1 << shift;
+    return ESP_OK;
+}
+
+void cam_decimate_deinit(cam_decimate_t *dec)
+{
+    if (dec->sum) {
+        heap_caps_free(dec->sum);
+    }
+    memset(dec, 0, sizeof(*dec));
+    dec->factor = 1;
+}
+
+size_t cam_decimate_out_size(const cam_decimate_t *dec, size_t len)
+{
+    uint32_t start = dec->line;
+    uint32_t end = start + len / (dec->width * dec->bytes_per_pixel);
+    size_t lines;
+    if (dec->average) {
+        /* a block row is written with its last line */
+        lines = (end >> dec->shift) - (start >> dec->shift);
+    } else {
+        /* and with its first line when dropping */
+        lines = ((end + dec->factor - 1) >> dec->shift) - ((start + dec->factor - 1) >> dec->shift);
+    }
+    return lines * out_line_size(dec);
+}
+
+/* Keep the top left pixel of every block; a YUYV pair keeps the U and V of its first input pair */
+static void IRAM_ATTR decimate_line(const cam_decimate_t *dec, uint8_t *out, const uint8_t *in)
+{
+    size_t f = dec->factor;
+    size_t out_width = dec->width >> dec->shift;
+
+    if (dec->bytes_per_pixel == 1) {
+        for (size_t x = 0; x < out_width; x++) {
+            out[x] = in[x * f];
+        }
+    } else if (dec->yuyv) {
+        /* output pair m: Y of input pixels 2mf and (2m+1)f, chroma of input pair mf */
+        for (size_t m = 0; m < out_width / 2; m++) {
+            const uint8_t *p = in + 4 * m * f;
+            out[0] = p[0];
+            out[1] = p[1];
+            out[2] = p[2 * f];
+            out[3] = p[3];
+            out += 4;
+        }
+    } else {
+        for (size_t x = 0; x < out_width; x++) {
+            out[0] = in[0];
+            out[1] = in[1];
+            in += 2 * f;
+            out += 2;
+        }
+    }
+}
+
+/* Add the samples of one input line to the block sums, the first line of a block row sets them */
+static void IRAM_ATTR decimate_sum_line(cam_decimate_t *dec, const uint8_t *in, bool first)
+{
+    size_t f = dec->factor;
+    size_t out_size = out_line_size(dec);
+    uint16_t *sum = dec->sum;
+
+    for (size_t b = 0; b < out_size; b++) {
+        const uint8_t *p;
+        size_t step;
+        if (!dec->yuyv) {
+            p = in + b * f;
+            step = 1;
+        } else if (b & 1) {
+            /* U or V of output pair b / 4, from the pairs of its block */
+            p = in + 4 * (b >> 2) * f + (b & 3);
+            step = 4;
+        } else {
+            p = in + 2 * (b >> 1) * f;
+            step = 2;
+        }
+        uint16_t s = 0;
+        for (size_t k = 0; k < f; k++) {
+            s += p[k * step];
+        }
+        sum[b] = first ? s : sum[b] + s;
+    }
+}
+
+size_t IRAM_ATTR cam_decimate_lines(cam_decimate_t *dec, uint8_t *out, const uint8_t *in, size_t len)
+{
+    size_t line_size = dec->width * dec->bytes_per_pixel;
+    size_t out_size = out_line_size(dec);
+    uint32_t row_mask = dec->factor - 1;
+    uint32_t rounding = 1 << (2 * dec->shift - 1);
+    uint8_t *start = out;
+
+    for (; len >= line_size; len -= line_size, in += line_size, dec->line++) {
+        uint32_t row = dec->line & row_mask;
+        if (!dec->average) {
+            if (row == 0) {
+                decimate_line(dec, out, in);
+                out += out_size;
+            }
+            continue;
+        }
+        decimate_sum_line(dec, in, row == 0);
+        if (row == row_mask) {
+            for (size_t b = 0; b < out_size; b++) {
+                out[b] = (dec->sum[b] + rounding) >> (2 * dec->shift);
+            }
+            out += out_size;
+        }
+    }
+    return out - start;
+}
@@ -18,6 +18,8 @@
 #include "esp_heap_caps.h"
 #include "ll_cam.h"
 #include "cam_hal.h"
+#include "jpeg_scan.h"
+#include "jpeg_repair.h"
 
 #if (ESP_IDF_VERSION_MAJOR == 3) && (ESP_IDF_VERSION_MINOR == 3)
 #include "rom/ets_sys.h"
@@ -42,6 +44,34 @@
 static const char *TAG = "cam_hal";
 static cam_obj_t *cam_obj = NULL;
 
+static cam_frame_cb_t s_frame_cb = NULL;
+static void *s_frame_cb_arg = NULL;
+static camera_slice_cb_t s_slice_cb = NULL;
+static void *s_slice_cb_arg = NULL;
+static portMUX_TYPE s_frame_cb_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Counters behind esp_camera_get_stats(), event_overflow is written from the ISR */
+typedef struct {
+    atomic_uint frames_started;
+    atomic_uint frames_delivered;
+    atomic_uint fb_overflow;
+    atomic_uint no_soi;
+    atomic_uint no_eoi;
+    atomic_uint repaired;
+    atomic_uint bad_size;
+    atomic_uint event_overflow;
+    atomic_uint queue_evicted;
+    atomic_uint queue_dropped;
+    atomic_uint no_free_fb;
+    atomic_uint dma_resets;
+    atomic_uint fb_resizes;
+} cam_stats_t;
+
+static cam_stats_t s_stats;
+static uint32_t s_frame_seq = 0;
+
+#define CAM_STAT_INC(name) atomic_fetch_add_explicit(&s_stats.name, 1, memory_order_relaxed)
+
 /* At top of cam_hal.c – one switch for noisy ISR prints */
 #ifndef CAM_LOG_SPAM_EVERY_FRAME
 #define CAM_LOG_SPAM_EVERY_FRAME 0   /* set to 1 to restore old behaviour */
@@ -66,10 +96,8 @@ static cam_obj_t *cam_obj = NULL;
 #define CAM_WARN_THROTTLE(counter, first) do { (void)(counter); } while (0)
 #endif
 
-/* JPEG markers in little-endian order (ESP32). */
-static const uint8_t JPEG_SOI_MARKER[] = {0xFF, 0xD8, 0xFF}; /* SOI = FF D8 FF */
+/* SOI = FF D8 followed by the FF of the next marker, EOI = FF D9 */
 #define JPEG_SOI_MARKER_LEN (3)
-static const uint16_t JPEG_EOI_MARKER = 0xD9FF;              /* EOI = FF D9 */
 #define JPEG_EOI_MARKER_LEN (2)
 
 static int cam_verify_jpeg_soi(const uint8_t *inbuf, uint32_t length)
@@ -81,11 +109,19 @@ static int cam_verify_jpeg_soi(const uint8_t *inbuf, uint32_t length)
         return -1;
     }
 
-    for (uint32_t i = 0; i <= length - JPEG_SOI_MARKER_LEN; i++) {
-        if (memcmp(&inbuf[i], JPEG_SOI_MARKER, JPEG_SOI_MARKER_LEN) == 0) {
+    uint32_t i = 0;
+    for (;;) {
+        /* the last byte can't start FF D8 FF, leave it out of the search */
+        int32_t pos = jpeg_scan_marker(&inbuf[i], length - 1 - i, JPEG_MARKER_SOI);
+        if (pos < 0) {
+            break;
+        }
+        i += pos;
+        if (inbuf[i + 2] == 0xFF) {
             //ESP_LOGW(TAG, "SOI: %d", (int) i);
             return i;
         }
+        i++;
     }
 
     CAM_WARN_THROTTLE(warn_soi_miss_cnt,
@@ -93,38 +129,151 @@ static int cam_verify_jpeg_soi(const uint8_t *inbuf, uint32_t length)
     return -1;
 }
 
-static int cam_verify_jpeg_eoi(const uint8_t *inbuf, uint32_t length)
+/* Scan the bytes of a frame that arrived since the last call, [from, to), for the JPEG end marker.
+ * The scan starts one byte early so a marker split across two DMA buffers is found too.
+ * Returns the length of the frame up to and including the last EOI seen so far,
+ * or 'eoi_len' unchanged when the new bytes hold none (0 = no EOI yet). */
+static size_t cam_scan_jpeg_eoi(const uint8_t *inbuf, size_t from, size_t to, size_t eoi_len)
 {
-    if (length < JPEG_EOI_MARKER_LEN) {
-        return -1;
+    size_t start = from ? from - 1 : 0;
+    if (to <= start) {
+        return eoi_len;
+    }
+    int32_t pos = jpeg_scan_marker_rev(&inbuf[start], to - start, JPEG_MARKER_EOI);
+    if (pos >= 0) {
+        eoi_len = start + pos + JPEG_EOI_MARKER_LEN;
     }
+    return eoi_len;
+}
 
-    int offset = -1;
-    uint8_t *dptr = (uint8_t *)inbuf + length - JPEG_EOI_MARKER_LEN;
-    while (dptr > inbuf) {
-        if (memcmp(dptr, &JPEG_EOI_MARKER, JPEG_EOI_MARKER_LEN) == 0) {
-            offset = dptr - inbuf;
-            //ESP_LOGW(TAG, "EOI: %d", length - (offset + 2));
-            return offset;
-        }
-        dptr--;
+/* frames_free holds one bit per frame buffer */
+#define CAM_FRAME_CNT_MAX (sizeof(unsigned int) * 8)
+
+static inline void cam_frame_claim(int pos)
+{
+    atomic_fetch_and(&cam_obj->frames_free, ~(1u << pos));
+}
+
+static inline void cam_frame_release(int pos)
+{
+    atomic_fetch_or(&cam_obj->frames_free, 1u << pos);
+}
+
+/* Index of the frame owning fb, -1 if fb is not one of ours */
+static int cam_frame_index(const camera_fb_t *fb)
+{
+    uintptr_t off = (uintptr_t)fb - (uintptr_t)&cam_obj->frames[0].fb;
+    size_t x = off / sizeof(cam_frame_t);
+    if (off % sizeof(cam_frame_t) || x >= cam_obj->frame_cnt) {
+        return -1;
     }
-    return -1;
+    return x;
 }
 
 static bool cam_get_next_frame(int * frame_pos)
 {
-    if(!cam_obj->frames[*frame_pos].en){
-        for (int x = 0; x < cam_obj->frame_cnt; x++) {
-            if (cam_obj->frames[x].en) {
-                *frame_pos = x;
-                return true;
-            }
-        }
-    } else {
+    unsigned int free_mask = atomic_load(&cam_obj->frames_free);
+    if (free_mask & (1u << *frame_pos)) {
         return true;
     }
-    return false;
+    if (free_mask == 0) {
+        return false;
+    }
+    *frame_pos = __builtin_ctz(free_mask);
+    return true;
+}
+
+/* Take VSYNC interrupts again after waiting for a free frame, unless capture has been stopped */
+static void cam_vsync_rearm(void)
+{
+    if (!cam_obj->started) {
+        return;
+    }
+    ll_cam_vsync_intr_enable(cam_obj, true);
+    /* cam_stop() clears started before disabling, so one that ran in between is seen here */
+    if (!cam_obj->started) {
+        ll_cam_vsync_intr_enable(cam_obj, false);
+    }
+}
+
+/* No frame to fill: stop taking VSYNC interrupts until cam_give() posts CAM_FB_FREE_EVENT */
+static void cam_wait_free_frame(void)
+{
+    CAM_STAT_INC(no_free_fb);
+    atomic_store(&cam_obj->frame_wait, true);
+    ll_cam_vsync_intr_enable(cam_obj, false);
+    /* a frame returned before the flag was set would not have posted the event */
+    if (atomic_load(&cam_obj->frames_free) && atomic_exchange(&cam_obj->frame_wait, false)) {
+        cam_vsync_rearm();
+    }
+}
+
+/* Offer a complete frame to the registered callback, true if it took the frame */
+static bool cam_frame_cb_take(camera_fb_t *fb)
+{
+    portENTER_CRITICAL(&s_frame_cb_lock);
+    cam_frame_cb_t cb = s_frame_cb;
+    void *arg = s_frame_cb_arg;
+    portEXIT_CRITICAL(&s_frame_cb_lock);
+    return cb && cb(fb, arg);
+}
+
+/* Slice progress of the frame being captured, only touched by cam_task */
+typedef struct {
+    size_t sent;    /* bytes of the frame already passed to the slice callback */
+    bool open;      /* a first slice was emitted and the final one not yet */
+    bool held;      /* the frame is claimed with a reference of cam_task's until the final slice */
+} cam_slice_state_t;
+
+/* Pass the bytes that arrived since the last slice, [sent, avail), to the slice callback */
+static void cam_emit_slice(cam_slice_state_t *st, camera_fb_t *fb, size_t avail, bool last, bool ok)
+{
+    portENTER_CRITICAL(&s_frame_cb_lock);
+    camera_slice_cb_t cb = s_slice_cb;
+    void *arg = s_slice_cb_arg;
+    portEXIT_CRITICAL(&s_frame_cb_lock);
+
+    /* start only at the beginning of a frame, and don't report the drop of a frame never started */
+    if (cb && (st->open || st->sent == 0) && (st->open || !last || ok)) {
+        camera_slice_t slice = {
+            .fb = fb,
+            .offset = st->sent,
+            .len = avail > st->sent ? avail - st->sent : 0,
+            .first = !st->open,
+            .last = last,
+            .ok = last && ok,
+        };
+        if (slice.first) {
+            /* a slice consumer may take references from here on and keep reading after the final
+             * slice, even of a dropped frame: it is neither refilled nor resized until they let go */
+            int x = cam_frame_index(fb);
+            atomic_store(&cam_obj->frames[x].refs, 1);
+            cam_frame_claim(x);
+            st->held = true;
+        }
+        cb(&slice, arg);
+        st->open = !last;
+    }
+    if (avail > st->sent) {
+        st->sent = avail;
+    }
+    if (last) {
+        st->sent = 0;
+        st->open = false;
+        if (st->held) {
+            st->held = false;
+            cam_give(fb);
+        }
+    }
+}
+
+static void cam_notify_frame_free(void)
+{
+    if (atomic_exchange(&cam_obj->frame_wait, false)) {
+        cam_event_t cam_event = CAM_FB_FREE_EVENT;
+        /* a full queue means cam_task is about to run anyway and will see the free frame */
+        xQueueSend(cam_obj->event_queue, (void *)&cam_event, 0);
+    }
 }
 
 static bool cam_start_frame(int * frame_pos)
@@ -134,8 +283,14 @@ static bool cam_start_frame(int * frame_pos)
             // Vsync the frame manually
             ll_cam_do_vsync(cam_obj);
             uint64_t us = (uint64_t)esp_timer_get_time();
-            cam_obj->frames[*frame_pos].fb.timestamp.tv_sec = us / 1000000UL;
-            cam_obj->frames[*frame_pos].fb.timestamp.tv_usec = us % 1000000UL;
+            camera_fb_t *fb = &cam_obj->frames[*frame_pos].fb;
+            fb->timestamp.tv_sec = us / 1000000UL;
+            fb->timestamp.tv_usec = us % 1000000UL;
+            fb->vsync_us = us;
+            fb->seq = ++s_frame_seq;
+            fb->repaired = false;
+            cam_obj->decimate.line = 0;
+            CAM_STAT_INC(frames_started);
             return true;
         }
     }
@@ -147,6 +302,7 @@ void IRAM_ATTR ll_cam_send_event(cam_obj_t *cam, cam_event_t cam_event, BaseType
     if (xQueueSendFromISR(cam->event_queue, (void *)&cam_event, HPTaskAwoken) != pdTRUE) {
         ll_cam_stop(cam);
         cam->state = CAM_STATE_IDLE;
+        CAM_STAT_INC(event_overflow);
 #if CAM_LOG_SPAM_EVERY_FRAME
         ESP_DRAM_LOGD(TAG, "EV-%s-OVF", cam_event==CAM_IN_SUC_EOF_EVENT ? "EOF" : "VSYNC");
 #else
@@ -157,11 +313,105 @@ void IRAM_ATTR ll_cam_send_event(cam_obj_t *cam, cam_event_t cam_event, BaseType
     }
 }
 
+/* Bytes the frame at pos may hold: JPEG frames can use the whole buffer, raw frames have a fixed size */
+static inline size_t cam_frame_capacity(int pos)
+{
+    return cam_obj->jpeg_mode ? cam_obj->frames[pos].buf_size : cam_obj->fb_size;
+}
+
+#if CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE_ADAPTIVE
+static esp_err_t cam_frame_alloc(int x, size_t buf_size);
+
+/* JPEG frame lengths seen since the last size decision */
+static struct {
+    size_t high_water;
+    uint16_t frames;
+} s_fb_adapt;
+
+static size_t cam_fb_adapt_max(void)
+{
+    size_t max = CONFIG_CAMERA_JPEG_ADAPTIVE_MAX_SIZE;
+    if (max == 0) {
+        max = cam_obj->width * cam_obj->height / 2;
+    }
+    return max;
+}
+
+static size_t cam_fb_adapt_clamp(size_t size)
+{
+    size_t max = cam_fb_adapt_max();
+    size = (size + 1023) & ~(size_t)1023;
+    if (size > max) {
+        size = max;
+    }
+    if (size < CONFIG_CAMERA_JPEG_ADAPTIVE_MIN_SIZE) {
+        size = CONFIG_CAMERA_JPEG_ADAPTIVE_MIN_SIZE;
+    }
+    return size;
+}
+
+/* Move fb_size towards the high-water mark of the last window of frames plus headroom */
+static void cam_fb_adapt(size_t len, bool overflow)
+{
+    size_t size = cam_obj->fb_size;
+
+    if (overflow) {
+        /* don't wait for the window, the next frames are likely as big */
+        size = cam_fb_adapt_clamp(size + size / 2);
+    } else {
+        if (len > s_fb_adapt.high_water) {
+            s_fb_adapt.high_water = len;
+        }
+        if (++s_fb_adapt.frames < CONFIG_CAMERA_JPEG_ADAPTIVE_WINDOW) {
+            return;
+        }
+        size = cam_fb_adapt_clamp(s_fb_adapt.high_water + s_fb_adapt.high_water * CONFIG_CAMERA_JPEG_ADAPTIVE_HEADROOM / 100);
+        /* shrink only by a margin so the size doesn't flap between two values */
+        if (size < cam_obj->fb_size && size + cam_obj->fb_size / 4 > cam_obj->fb_size) {
+            size = cam_obj->fb_size;
+        }
+    }
+    s_fb_adapt.high_water = 0;
+    s_fb_adapt.frames = 0;
+    if (size != cam_obj->fb_size) {
+        ESP_LOGI(TAG, "JPEG frame buffers %u -> %u Byte", (unsigned) cam_obj->fb_size, (unsigned) size);
+        cam_obj->fb_size = size;
+    }
+}
+
+/* Bring one idle frame buffer to fb_size. cam_task owns every free frame, the one being
+ * filled is left alone; one per frame keeps the time spent between frames short.
+ * A frame that overflowed (the event that grows fb_size) may still be read by a slice
+ * consumer: it holds a reference, so the frame is claimed and skipped until it lets go. */
+static void cam_fb_adapt_resize(int frame_pos)
+{
+    unsigned int mask = atomic_load(&cam_obj->frames_free) & ~(1u << frame_pos);
+    while (mask) {
+        int x = __builtin_ctz(mask);
+        mask &= mask - 1;
+        if (atomic_load(&cam_obj->frames[x].refs)) {
+            /* not expected for a free frame, but never free a buffer somebody holds */
+            continue;
+        }
+        if (cam_obj->frames[x].buf_size != cam_obj->fb_size) {
+            if (cam_frame_alloc(x, cam_obj->fb_size) == ESP_OK) {
+                CAM_STAT_INC(fb_resizes);
+            }
+            return;
+        }
+    }
+}
+#endif
+
 //Copy fram from DMA dma_buffer to fram dma_buffer
 static void cam_task(void *arg)
 {
     int cnt = 0;
     int frame_pos = 0;
+    size_t jpeg_eoi_len = 0; /* length up to the last EOI found in the current frame, 0 = none yet */
+    bool fb_overflow = false; /* the current frame didn't fit, it is counted as FB-OVF if it is dropped */
+    cam_slice_state_t slices = {0};
+    static uint16_t warn_eoi_miss_cnt = 0;
     cam_obj->state = CAM_STATE_IDLE;
     cam_event_t cam_event = 0;
 
@@ -170,16 +420,37 @@ static void cam_task(void *arg)
     while (1) {
         xQueueReceive(cam_obj->event_queue, (void *)&cam_event, portMAX_DELAY);
         DBG_PIN_SET(1);
+        if (cam_event == CAM_FB_FREE_EVENT) {
+            /* the returned frame gets armed on the next VSYNC */
+            cam_vsync_rearm();
+            DBG_PIN_SET(0);
+            continue;
+        }
+        if (cam_event == CAM_PAUSE_EVENT) {
+            /* capture is stopped, the frame in progress is lost; a VSYNC in IDLE restarts everything */
+            cam_emit_slice(&slices, &cam_obj->frames[frame_pos].fb, 0, true, false);
+            cam_obj->state = CAM_STATE_IDLE;
+            frame_pos = 0;
+            xSemaphoreGive(cam_obj->pause_done);
+            DBG_PIN_SET(0);
+            continue;
+        }
         switch (cam_obj->state) {
 
             case CAM_STATE_IDLE: {
                 if (cam_event == CAM_VSYNC_EVENT) {
                     //DBG_PIN_SET(1);
+                    /* a frame aborted by an event queue overflow ends up here without its final slice */
+                    cam_emit_slice(&slices, &cam_obj->frames[frame_pos].fb, 0, true, false);
                     if(cam_start_frame(&frame_pos)){
                         cam_obj->frames[frame_pos].fb.len = 0;
                         cam_obj->state = CAM_STATE_READ_BUF;
+                    } else {
+                        cam_wait_free_frame();
                     }
                     cnt = 0;
+                    jpeg_eoi_len = 0;
+                    fb_overflow = false;
                 }
             }
             break;
@@ -187,11 +458,16 @@ static void cam_task(void *arg)
             case CAM_STATE_READ_BUF: {
                 camera_fb_t * frame_buffer_event = &cam_obj->frames[frame_pos].fb;
                 size_t pixels_per_dma = (cam_obj->dma_half_buffer_size * cam_obj->fb_bytes_per_pixel) / (cam_obj->dma_bytes_per_item * cam_obj->in_bytes_per_pixel);
+                if (cam_obj->decimate.factor > 1) {
+                    pixels_per_dma = cam_decimate_out_size(&cam_obj->decimate, pixels_per_dma);
+                }
 
                 if (cam_event == CAM_IN_SUC_EOF_EVENT) {
+                    size_t prev_len = frame_buffer_event->len;
                     if(!cam_obj->psram_mode){
-                        if (cam_obj->fb_size < (frame_buffer_event->len + pixels_per_dma)) {
+                        if (cam_frame_capacity(frame_pos) < (frame_buffer_event->len + pixels_per_dma)) {
                             ESP_LOGW(TAG, "FB-OVF");
+                            fb_overflow = true;
                             ll_cam_stop(cam_obj);
                             DBG_PIN_SET(0);
                             continue;
@@ -200,11 +476,21 @@ static void cam_task(void *arg)
                             &frame_buffer_event->buf[frame_buffer_event->len],
                             &cam_obj->dma_buffer[(cnt % cam_obj->dma_half_buffer_cnt) * cam_obj->dma_half_buffer_size],
                             cam_obj->dma_half_buffer_size);
+                    } else {
+                        /* DMA writes straight into the frame buffer, one half buffer per EOF */
+                        frame_buffer_event->len = (cnt + 1) * cam_obj->dma_half_buffer_size;
+                    }
+                    if (cam_obj->jpeg_mode) {
+                        jpeg_eoi_len = cam_scan_jpeg_eoi(frame_buffer_event->buf, prev_len, frame_buffer_event->len, jpeg_eoi_len);
                     }
                     //Check for JPEG SOI in the first buffer. stop if not found
                     if (cam_obj->jpeg_mode && cnt == 0 && cam_verify_jpeg_soi(frame_buffer_event->buf, frame_buffer_event->len) != 0) {
                         ll_cam_stop(cam_obj);
                         cam_obj->state = CAM_STATE_IDLE;
+                        CAM_STAT_INC(no_soi);
+                        cam_emit_slice(&slices, frame_buffer_event, 0, true, false);
+                    } else {
+                        cam_emit_slice(&slices, frame_buffer_event, frame_buffer_event->len, false, false);
                     }
                     cnt++;
 
@@ -214,9 +500,13 @@ static void cam_task(void *arg)
 
                     if (cnt || !cam_obj->jpeg_mode || cam_obj->psram_mode) {
                         if (cam_obj->jpeg_mode) {
+                            /* the partially filled last buffer */
+                            size_t prev_len = cnt * cam_obj->dma_half_buffer_size;
                             if (!cam_obj->psram_mode) {
-                                if (cam_obj->fb_size < (frame_buffer_event->len + pixels_per_dma)) {
+                                prev_len = frame_buffer_event->len;
+                                if (cam_frame_capacity(frame_pos) < (frame_buffer_event->len + pixels_per_dma)) {
                                     ESP_LOGW(TAG, "FB-OVF");
+                                    fb_overflow = true;
                                     cnt--;
                                 } else {
                                     frame_buffer_event->len += ll_cam_memcpy(cam_obj,
@@ -226,48 +516,125 @@ static void cam_task(void *arg)
                                 }
                             }
                             cnt++;
+                            if (cam_obj->psram_mode) {
+                                frame_buffer_event->len = cnt * cam_obj->dma_half_buffer_size;
+                            }
+                            jpeg_eoi_len = cam_scan_jpeg_eoi(frame_buffer_event->buf, prev_len, frame_buffer_event->len, jpeg_eoi_len);
                         }
 
-                        cam_obj->frames[frame_pos].en = 0;
+                        bool frame_ok = true;
 
-                        if (cam_obj->psram_mode) {
-                            if (cam_obj->jpeg_mode) {
-                                frame_buffer_event->len = cnt * cam_obj->dma_half_buffer_size;
+                        if (cam_obj->jpeg_mode) {
+                            /* data after the end marker can be discarded */
+                            if (jpeg_eoi_len) {
+                                frame_buffer_event->len = jpeg_eoi_len;
                             } else {
-                                frame_buffer_event->len = cam_obj->recv_size;
+#if CONFIG_CAMERA_JPEG_REPAIR_TRUNCATED
+                                /* cut off inside the scan data: keep the complete MCUs and close the image */
+                                size_t repaired_len = jpeg_repair_truncated(frame_buffer_event->buf, frame_buffer_event->len,
+                                                                            cam_frame_capacity(frame_pos));
+                                if (repaired_len) {
+                                    frame_buffer_event->len = repaired_len;
+                                    frame_buffer_event->repaired = true;
+                                    CAM_STAT_INC(repaired);
+                                } else
+#endif
+                                {
+                                    frame_ok = false;
+                                    CAM_WARN_THROTTLE(warn_eoi_miss_cnt,
+                                                      "NO-EOI - JPEG end marker missing");
+                                }
                             }
-                        } else if (!cam_obj->jpeg_mode) {
+                        } else if (cam_obj->psram_mode) {
+                            frame_buffer_event->len = cam_obj->recv_size;
+                        } else {
                             if (frame_buffer_event->len != cam_obj->fb_size) {
-                                cam_obj->frames[frame_pos].en = 1;
+                                frame_ok = false;
                                 ESP_LOGE(TAG, "FB-SIZE: %u != %u", frame_buffer_event->len, (unsigned) cam_obj->fb_size);
                             }
                         }
-                        //send frame
-                        if(!cam_obj->frames[frame_pos].en && xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, 0) != pdTRUE) {
+                        frame_buffer_event->eof_us = esp_timer_get_time();
+#if CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE_ADAPTIVE
+                        if (cam_obj->jpeg_mode && !cam_obj->psram_mode && (frame_ok || fb_overflow)) {
+                            cam_fb_adapt(frame_buffer_event->len, fb_overflow);
+                        }
+#endif
+                        if (!frame_ok) {
+                            if (fb_overflow) {
+                                CAM_STAT_INC(fb_overflow);
+                            } else if (cam_obj->jpeg_mode) {
+                                CAM_STAT_INC(no_eoi);
+                            } else {
+                                CAM_STAT_INC(bad_size);
+                            }
+                        }
+                        //send frame, the callback or the queue owns it from here on
+                        bool queue_frame = false;
+                        if (frame_ok) {
+                            /* the delivered reference, next to the one the slices hold until their final slice */
+                            if (slices.held) {
+                                atomic_fetch_add(&cam_obj->frames[frame_pos].refs, 1);
+                            } else {
+                                atomic_store(&cam_obj->frames[frame_pos].refs, 1);
+                            }
+                            cam_frame_claim(frame_pos);
+                        }
+                        /* final slice before delivery, so its consumer can still take a reference;
+                         * slices already sent hold bytes a repair has rewritten, that consumer loses the frame */
+                        bool slice_ok = frame_ok && !(frame_buffer_event->repaired && slices.open);
+                        cam_emit_slice(&slices, frame_buffer_event, slice_ok ? frame_buffer_event->len : 0, true, slice_ok);
+                        if (frame_ok) {
+                            queue_frame = !cam_frame_cb_take(frame_buffer_event);
+                            if (!queue_frame) {
+                                CAM_STAT_INC(frames_delivered);
+                            }
+                        }
+                        if (queue_frame && xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, 0) == pdTRUE) {
+                            CAM_STAT_INC(frames_delivered);
+                        } else if (queue_frame) {
                             //pop frame buffer from the queue
                             camera_fb_t * fb2 = NULL;
                             if(xQueueReceive(cam_obj->frame_buffer_queue, &fb2, 0) == pdTRUE) {
                                 //push the new frame to the end of the queue
                                 if (xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, 0) != pdTRUE) {
-                                    cam_obj->frames[frame_pos].en = 1;
+                                    /* drop our reference, the slice consumer may hold another */
+                                    cam_give(frame_buffer_event);
+                                    CAM_STAT_INC(queue_dropped);
                                     ESP_LOGE(TAG, "FBQ-SND");
+                                } else {
+                                    CAM_STAT_INC(frames_delivered);
                                 }
                                 //free the popped buffer
+                                CAM_STAT_INC(queue_evicted);
                                 cam_give(fb2);
                             } else {
                                 //queue is full and we could not pop a frame from it
-                                cam_obj->frames[frame_pos].en = 1;
+                                cam_give(frame_buffer_event);
+                                CAM_STAT_INC(queue_dropped);
                                 ESP_LOGE(TAG, "FBQ-RCV");
                             }
                         }
+                    } else {
+                        /* no data at all before VSYNC */
+                        CAM_STAT_INC(no_soi);
+                        cam_emit_slice(&slices, frame_buffer_event, 0, true, false);
                     }
 
                     if(!cam_start_frame(&frame_pos)){
                         cam_obj->state = CAM_STATE_IDLE;
+                        cam_wait_free_frame();
                     } else {
                         cam_obj->frames[frame_pos].fb.len = 0;
                     }
+#if CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE_ADAPTIVE
+                    /* DMA for the next frame is running into the ping-pong buffer, resize an idle one meanwhile */
+                    if (cam_obj->jpeg_mode && !cam_obj->psram_mode) {
+                        cam_fb_adapt_resize(frame_pos);
+                    }
+#endif
                     cnt = 0;
+                    jpeg_eoi_len = 0;
+                    fb_overflow = false;
                 }
             }
             break;
@@ -295,7 +662,8 @@ static lldesc_t * allocate_dma_descriptors(uint32_t count, uint16_t size, uint8_
     return dma;
 }
 
-static esp_err_t cam_dma_config(const camera_config_t *config)
+/* Recompute the DMA layout for the current frame size and format */
+static esp_err_t cam_dma_sizes(void)
 {
     bool ret = ll_cam_dma_sizes(cam_obj);
     if (0 == ret) {
@@ -308,64 +676,114 @@ static esp_err_t cam_dma_config(const camera_config_t *config)
     ESP_LOGI(TAG, "buffer_size: %d, half_buffer_size: %d, node_buffer_size: %d, node_cnt: %d, total_cnt: %d",
              (int) cam_obj->dma_buffer_size, (int) cam_obj->dma_half_buffer_size, (int) cam_obj->dma_node_buffer_size,
              (int) cam_obj->dma_node_cnt, (int) cam_obj->frame_copy_cnt);
+    return ESP_OK;
+}
+
+/* Usable bytes needed per frame buffer: in psram mode DMA writes the whole frame into it */
+static size_t cam_fb_needed_size(void)
+{
+    size_t fb_size = cam_obj->fb_size;
+    if (cam_obj->psram_mode && fb_size < cam_obj->recv_size) {
+        fb_size = cam_obj->recv_size;
+    }
+    return fb_size * sizeof(uint8_t);
+}
+
+/* Point the psram mode DMA descriptors of frames[x] at its buffer, after the layout changed */
+static esp_err_t cam_frame_dma_alloc(int x)
+{
+    if (cam_obj->frames[x].dma) {
+        free(cam_obj->frames[x].dma);
+    }
+    cam_obj->frames[x].dma = allocate_dma_descriptors(cam_obj->dma_node_cnt, cam_obj->dma_node_buffer_size, cam_obj->frames[x].fb.buf);
+    CAM_CHECK(cam_obj->frames[x].dma != NULL, "frame dma malloc failed", ESP_FAIL);
+    return ESP_OK;
+}
+
+static esp_err_t cam_frame_alloc(int x, size_t buf_size)
+{
+    /* direct DMA writes whole external memory blocks, start and end of the buffer must be aligned to them */
+    size_t align = cam_obj->psram_mode ? ll_cam_get_dma_align(cam_obj) : 16;
+    size_t alloc_size = (buf_size + align - 1) & ~(align - 1);
+    ESP_LOGI(TAG, "Allocating %d Byte frame buffer in %s", alloc_size, cam_obj->fb_caps & MALLOC_CAP_SPIRAM ? "PSRAM" : "OnBoard RAM");
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0)
+    // In IDF v4.2 and earlier, memory returned by heap_caps_aligned_alloc must be freed using heap_caps_aligned_free.
+    // And heap_caps_aligned_free is deprecated on v4.3.
+    uint8_t *buf = (uint8_t *)heap_caps_aligned_alloc(align, alloc_size, cam_obj->fb_caps);
+    size_t offset = 0;
+#else
+    uint8_t *buf = (uint8_t *)heap_caps_malloc(alloc_size + align, cam_obj->fb_caps);
+    size_t offset = buf ? (-(uintptr_t)buf) & (align - 1) : 0;
+#endif
+    CAM_CHECK(buf != NULL, "frame buffer malloc failed", ESP_ERR_NO_MEM);
+    if (cam_obj->frames[x].fb.buf) {
+        free(cam_obj->frames[x].fb.buf - cam_obj->frames[x].fb_offset);
+    }
+    /* fb_offset is where buf starts in the allocation, freeing goes back by it */
+    cam_obj->frames[x].fb.buf = buf + offset;
+    cam_obj->frames[x].fb_offset = offset;
+    cam_obj->frames[x].buf_size = buf_size;
+    if (cam_obj->psram_mode) {
+        ESP_LOGI(TAG, "Frame[%d]: Offset: %u, Addr: 0x%08X", x, (unsigned) offset, (unsigned) cam_obj->frames[x].fb.buf);
+        return cam_frame_dma_alloc(x);
+    }
+    return ESP_OK;
+}
+
+/* Ping-pong buffer and its descriptors, only used when not in psram mode */
+static esp_err_t cam_dma_buffer_alloc(void)
+{
+    if (cam_obj->dma) {
+        free(cam_obj->dma);
+        cam_obj->dma = NULL;
+    }
+    if (cam_obj->dma_buffer) {
+        free(cam_obj->dma_buffer);
+    }
+    cam_obj->dma_buffer = (uint8_t *)heap_caps_malloc(cam_obj->dma_buffer_size * sizeof(uint8_t), MALLOC_CAP_DMA);
+    if(NULL == cam_obj->dma_buffer) {
+        ESP_LOGE(TAG,"%s(%d): DMA buffer %d Byte malloc failed, the current largest free block:%d Byte", __FUNCTION__, __LINE__,
+                 (int) cam_obj->dma_buffer_size, (int) heap_caps_get_largest_free_block(MALLOC_CAP_DMA));
+        return ESP_FAIL;
+    }
+
+    cam_obj->dma = allocate_dma_descriptors(cam_obj->dma_node_cnt, cam_obj->dma_node_buffer_size, cam_obj->dma_buffer);
+    CAM_CHECK(cam_obj->dma != NULL, "dma malloc failed", ESP_FAIL);
+    return ESP_OK;
+}
+
+static esp_err_t cam_dma_config(const camera_config_t *config)
+{
+    esp_err_t ret = cam_dma_sizes();
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
     cam_obj->dma_buffer = NULL;
     cam_obj->dma = NULL;
 
     cam_obj->frames = (cam_frame_t *)heap_caps_aligned_calloc(alignof(cam_frame_t), 1, cam_obj->frame_cnt * sizeof(cam_frame_t), MALLOC_CAP_DEFAULT);
     CAM_CHECK(cam_obj->frames != NULL, "frames malloc failed", ESP_FAIL);
-
-    uint8_t dma_align = 0;
-    size_t fb_size = cam_obj->fb_size;
-    if (cam_obj->psram_mode) {
-        dma_align = ll_cam_get_dma_align(cam_obj);
-        if (cam_obj->fb_size < cam_obj->recv_size) {
-            fb_size = cam_obj->recv_size;
-        }
-    }
+    atomic_store(&cam_obj->frames_free, 0);
+    atomic_store(&cam_obj->frame_wait, false);
 
     /* Allocate memory for frame buffer */
-    size_t alloc_size = fb_size * sizeof(uint8_t) + dma_align;
-    uint32_t _caps = MALLOC_CAP_8BIT;
+    cam_obj->fb_caps = MALLOC_CAP_8BIT;
     if (CAMERA_FB_IN_DRAM == config->fb_location) {
-        _caps |= MALLOC_CAP_INTERNAL;
+        cam_obj->fb_caps |= MALLOC_CAP_INTERNAL;
     } else {
-        _caps |= MALLOC_CAP_SPIRAM;
+        cam_obj->fb_caps |= MALLOC_CAP_SPIRAM;
     }
     for (int x = 0; x < cam_obj->frame_cnt; x++) {
-        cam_obj->frames[x].dma = NULL;
-        cam_obj->frames[x].fb_offset = 0;
-        cam_obj->frames[x].en = 0;
-        ESP_LOGI(TAG, "Allocating %d Byte frame buffer in %s", alloc_size, _caps & MALLOC_CAP_SPIRAM ? "PSRAM" : "OnBoard RAM");
-#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0)
-        // In IDF v4.2 and earlier, memory returned by heap_caps_aligned_alloc must be freed using heap_caps_aligned_free.
-        // And heap_caps_aligned_free is deprecated on v4.3.
-        cam_obj->frames[x].fb.buf = (uint8_t *)heap_caps_aligned_alloc(16, alloc_size, _caps);
-#else
-        cam_obj->frames[x].fb.buf = (uint8_t *)heap_caps_malloc(alloc_size, _caps);
-#endif
-        CAM_CHECK(cam_obj->frames[x].fb.buf != NULL, "frame buffer malloc failed", ESP_FAIL);
-        if (cam_obj->psram_mode) {
-            //align PSRAM buffer. TODO: save the offset so proper address can be freed later
-            cam_obj->frames[x].fb_offset = dma_align - ((uint32_t)cam_obj->frames[x].fb.buf & (dma_align - 1));
-            cam_obj->frames[x].fb.buf += cam_obj->frames[x].fb_offset;
-            ESP_LOGI(TAG, "Frame[%d]: Offset: %u, Addr: 0x%08X", x, cam_obj->frames[x].fb_offset, (unsigned) cam_obj->frames[x].fb.buf);
-            cam_obj->frames[x].dma = allocate_dma_descriptors(cam_obj->dma_node_cnt, cam_obj->dma_node_buffer_size, cam_obj->frames[x].fb.buf);
-            CAM_CHECK(cam_obj->frames[x].dma != NULL, "frame dma malloc failed", ESP_FAIL);
+        ret = cam_frame_alloc(x, cam_fb_needed_size());
+        if (ret != ESP_OK) {
+            return ESP_FAIL;
         }
-        cam_obj->frames[x].en = 1;
+        cam_frame_release(x);
     }
 
     if (!cam_obj->psram_mode) {
-        cam_obj->dma_buffer = (uint8_t *)heap_caps_malloc(cam_obj->dma_buffer_size * sizeof(uint8_t), MALLOC_CAP_DMA);
-        if(NULL == cam_obj->dma_buffer) {
-            ESP_LOGE(TAG,"%s(%d): DMA buffer %d Byte malloc failed, the current largest free block:%d Byte", __FUNCTION__, __LINE__,
-                     (int) cam_obj->dma_buffer_size, (int) heap_caps_get_largest_free_block(MALLOC_CAP_DMA));
-            return ESP_FAIL;
-        }
-
-        cam_obj->dma = allocate_dma_descriptors(cam_obj->dma_node_cnt, cam_obj->dma_node_buffer_size, cam_obj->dma_buffer);
-        CAM_CHECK(cam_obj->dma != NULL, "dma malloc failed", ESP_FAIL);
+        return cam_dma_buffer_alloc();
     }
 
     return ESP_OK;
@@ -376,6 +794,8 @@ esp_err_t cam_init(const camera_config_t *config)
     CAM_CHECK(NULL != config, "config pointer is invalid", ESP_ERR_INVALID_ARG);
 
     esp_err_t ret = ESP_OK;
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_frame_seq = 0;
     cam_obj = (cam_obj_t *)heap_caps_calloc(1, sizeof(cam_obj_t), MALLOC_CAP_DMA);
     CAM_CHECK(NULL != cam_obj, "lcd_cam object malloc error", ESP_ERR_NO_MEM);
 
@@ -402,35 +822,88 @@ err:
     return ESP_FAIL;
 }
 
-esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint16_t sensor_pid)
+static void cam_set_frame_size(framesize_t frame_size)
 {
-    CAM_CHECK(NULL != config, "config pointer is invalid", ESP_ERR_INVALID_ARG);
-    esp_err_t ret = ESP_OK;
-
-    ret = ll_cam_set_sample_mode(cam_obj, (pixformat_t)config->pixel_format, config->xclk_freq_hz, sensor_pid);
-    CAM_CHECK_GOTO(ret == ESP_OK, "ll_cam_set_sample_mode failed", err);
-    
-    cam_obj->jpeg_mode = config->pixel_format == PIXFORMAT_JPEG;
-#if CONFIG_IDF_TARGET_ESP32
-    cam_obj->psram_mode = false;
-#else
-    cam_obj->psram_mode = (config->xclk_freq_hz == 16000000);
-#endif
-    cam_obj->frame_cnt = config->fb_count;
     cam_obj->width = resolution[frame_size].width;
     cam_obj->height = resolution[frame_size].height;
 
     if(cam_obj->jpeg_mode){
-#ifdef CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE_AUTO
+#if defined(CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE_AUTO) || defined(CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE_ADAPTIVE)
         cam_obj->recv_size = cam_obj->width * cam_obj->height / 5;
 #else
         cam_obj->recv_size = CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE;
 #endif
         cam_obj->fb_size = cam_obj->recv_size;
+#if CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE_ADAPTIVE
+        /* start from the automatic size, cam_task adapts it to the frames it sees */
+        if (!cam_obj->psram_mode) {
+            cam_obj->fb_size = cam_fb_adapt_clamp(cam_obj->recv_size);
+        }
+        memset(&s_fb_adapt, 0, sizeof(s_fb_adapt));
+#endif
     } else {
         cam_obj->recv_size = cam_obj->width * cam_obj->height * cam_obj->in_bytes_per_pixel;
-        cam_obj->fb_size = cam_obj->width * cam_obj->height * cam_obj->fb_bytes_per_pixel;
+        cam_obj->fb_size = (cam_obj->width >> cam_obj->decimate.shift) * (cam_obj->height >> cam_obj->decimate.shift)
+                           * cam_obj->fb_bytes_per_pixel;
+    }
+}
+
+/* Copy out of a DMA ring buffer or DMA straight into the frame buffers, see camera_config_t.dma_mode */
+static esp_err_t cam_dma_mode_config(const camera_config_t *config)
+{
+    /* the chips that can DMA into PSRAM report the external memory block size, the ESP32 reports 0 */
+    uint8_t dma_align = ll_cam_get_dma_align(cam_obj);
+    bool direct_ok = dma_align >= 4 && (dma_align & (dma_align - 1)) == 0;
+
+    switch (config->dma_mode) {
+    case CAMERA_DMA_MODE_AUTO:
+        cam_obj->psram_mode = direct_ok && config->xclk_freq_hz == 16000000;
+        break;
+    case CAMERA_DMA_MODE_COPY:
+        cam_obj->psram_mode = false;
+        break;
+    case CAMERA_DMA_MODE_DIRECT:
+        CAM_CHECK(direct_ok, "direct DMA mode is not supported on " CONFIG_IDF_TARGET, ESP_ERR_NOT_SUPPORTED);
+        cam_obj->psram_mode = true;
+        break;
+    default:
+        CAM_CHECK(false, "invalid dma_mode", ESP_ERR_INVALID_ARG);
+    }
+    ESP_LOGI(TAG, "DMA mode: %s", cam_obj->psram_mode ? "direct" : "copy");
+    return ESP_OK;
+}
+
+/* Scale raw frames down while copying them out of the DMA buffer, see camera_config_t.decimate */
+static esp_err_t cam_decimate_config(const camera_config_t *config, framesize_t frame_size)
+{
+    if (cam_decimate_shift(config->decimate) && config->pixel_format != PIXFORMAT_JPEG) {
+        CAM_CHECK(!cam_obj->psram_mode, "decimation needs the copy DMA mode", ESP_ERR_NOT_SUPPORTED);
+#if CONFIG_CAMERA_CONVERTER_ENABLED
+        CAM_CHECK(config->conv_mode == CONV_DISABLE, "decimation can't be combined with conv_mode", ESP_ERR_NOT_SUPPORTED);
+#endif
     }
+    esp_err_t ret = cam_decimate_init(&cam_obj->decimate, config->decimate, config->pixel_format,
+                                      resolution[frame_size].width, resolution[frame_size].height);
+    CAM_CHECK(ret == ESP_OK, "decimation not supported for this pixel format or frame size", ret);
+    return ESP_OK;
+}
+
+esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint16_t sensor_pid)
+{
+    CAM_CHECK(NULL != config, "config pointer is invalid", ESP_ERR_INVALID_ARG);
+    esp_err_t ret = ESP_OK;
+
+    ret = ll_cam_set_sample_mode(cam_obj, (pixformat_t)config->pixel_format, config->xclk_freq_hz, sensor_pid);
+    CAM_CHECK_GOTO(ret == ESP_OK, "ll_cam_set_sample_mode failed", err);
+    
+    cam_obj->jpeg_mode = config->pixel_format == PIXFORMAT_JPEG;
+    ret = cam_dma_mode_config(config);
+    CAM_CHECK_GOTO(ret == ESP_OK, "cam_dma_mode_config failed", err);
+    cam_obj->frame_cnt = config->fb_count;
+    CAM_CHECK_GOTO(cam_obj->frame_cnt <= CAM_FRAME_CNT_MAX, "fb_count too large", err);
+    ret = cam_decimate_config(config, frame_size);
+    CAM_CHECK_GOTO(ret == ESP_OK, "cam_decimate_config failed", err);
+    cam_set_frame_size(frame_size);
 
     ret = cam_dma_config(config);
     CAM_CHECK_GOTO(ret == ESP_OK, "cam_dma_config failed", err);
@@ -485,6 +958,9 @@ esp_err_t cam_deinit(void)
     if (cam_obj->frame_buffer_queue) {
         vQueueDelete(cam_obj->frame_buffer_queue);
     }
+    if (cam_obj->pause_done) {
+        vSemaphoreDelete(cam_obj->pause_done);
+    }
 
     ll_cam_deinit(cam_obj);
 
@@ -496,27 +972,105 @@ esp_err_t cam_deinit(void)
     }
     if (cam_obj->frames) {
         for (int x = 0; x < cam_obj->frame_cnt; x++) {
-            free(cam_obj->frames[x].fb.buf - cam_obj->frames[x].fb_offset);
+            if (cam_obj->frames[x].fb.buf) {
+                free(cam_obj->frames[x].fb.buf - cam_obj->frames[x].fb_offset);
+            }
             if (cam_obj->frames[x].dma) {
                 free(cam_obj->frames[x].dma);
             }
         }
         free(cam_obj->frames);
     }
+    cam_decimate_deinit(&cam_obj->decimate);
 
     free(cam_obj);
     cam_obj = NULL;
     return ESP_OK;
 }
 
+esp_err_t cam_pause(void)
+{
+    const TickType_t timeout = 1000 / portTICK_PERIOD_MS;
+
+    CAM_CHECK(NULL != cam_obj, "camera is not initialized", ESP_ERR_INVALID_STATE);
+    CAM_CHECK(xTaskGetCurrentTaskHandle() != cam_obj->task_handle, "can't pause from the camera task", ESP_ERR_INVALID_STATE);
+    cam_stop();
+    if (!cam_obj->pause_done) {
+        cam_obj->pause_done = xSemaphoreCreateBinary();
+        CAM_CHECK(cam_obj->pause_done != NULL, "pause semaphore create failed", ESP_ERR_NO_MEM);
+    }
+    cam_event_t cam_event = CAM_PAUSE_EVENT;
+    CAM_CHECK(xQueueSend(cam_obj->event_queue, (void *)&cam_event, timeout) == pdTRUE, "cam_task not responding", ESP_ERR_TIMEOUT);
+    CAM_CHECK(xSemaphoreTake(cam_obj->pause_done, timeout) == pdTRUE, "cam_task not responding", ESP_ERR_TIMEOUT);
+    return ESP_OK;
+}
+
+esp_err_t cam_reconfig(const camera_config_t *config, framesize_t frame_size, uint16_t sensor_pid)
+{
+    CAM_CHECK(NULL != cam_obj, "camera is not initialized", ESP_ERR_INVALID_STATE);
+    CAM_CHECK(!cam_obj->started, "capture is running, call cam_pause() first", ESP_ERR_INVALID_STATE);
+    esp_err_t ret = ESP_OK;
+
+    /* queued frames have the old format, nobody has taken them yet */
+    camera_fb_t *fb = NULL;
+    while (xQueueReceive(cam_obj->frame_buffer_queue, &fb, 0) == pdTRUE) {
+        cam_give(fb);
+    }
+
+    ret = ll_cam_set_sample_mode(cam_obj, (pixformat_t)config->pixel_format, config->xclk_freq_hz, sensor_pid);
+    CAM_CHECK(ret == ESP_OK, "ll_cam_set_sample_mode failed", ret);
+    cam_obj->jpeg_mode = config->pixel_format == PIXFORMAT_JPEG;
+    ret = cam_decimate_config(config, frame_size);
+    CAM_CHECK(ret == ESP_OK, "cam_decimate_config failed", ret);
+    cam_set_frame_size(frame_size);
+
+    /* the event queue keeps its length, it only sets how many DMA events may be pending */
+    uint32_t dma_buffer_size = cam_obj->dma_buffer_size;
+    ret = cam_dma_sizes();
+    CAM_CHECK(ret == ESP_OK, "cam_dma_sizes failed", ret);
+
+    /* growing moves a buffer, so the frames to grow may not be held by the application */
+    size_t needed = cam_fb_needed_size();
+    unsigned int free_mask = atomic_load(&cam_obj->frames_free);
+    for (int x = 0; x < cam_obj->frame_cnt; x++) {
+        CAM_CHECK(cam_obj->frames[x].buf_size >= needed || (free_mask & (1u << x)),
+                  "frame buffers still in use, can't grow them", ESP_ERR_INVALID_STATE);
+    }
+    for (int x = 0; x < cam_obj->frame_cnt; x++) {
+        if (cam_obj->frames[x].buf_size < needed) {
+            ret = cam_frame_alloc(x, needed);
+        } else if (cam_obj->psram_mode) {
+            /* big enough already, only the descriptor chain depends on the frame size */
+            ret = cam_frame_dma_alloc(x);
+        }
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    if (!cam_obj->psram_mode) {
+        if (cam_obj->dma_buffer_size != dma_buffer_size) {
+            ret = cam_dma_buffer_alloc();
+        } else {
+            free(cam_obj->dma);
+            cam_obj->dma = allocate_dma_descriptors(cam_obj->dma_node_cnt, cam_obj->dma_node_buffer_size, cam_obj->dma_buffer);
+            CAM_CHECK(cam_obj->dma != NULL, "dma malloc failed", ESP_ERR_NO_MEM);
+        }
+    }
+    ESP_LOGI(TAG, "cam reconfig ok: %ux%u, %u Byte frames", cam_obj->width, cam_obj->height, (unsigned) needed);
+    return ret;
+}
+
 void cam_stop(void)
 {
+    cam_obj->started = false;
     ll_cam_vsync_intr_enable(cam_obj, false);
     ll_cam_stop(cam_obj);
 }
 
 void cam_start(void)
 {
+    cam_obj->started = true;
     ll_cam_vsync_intr_enable(cam_obj, true);
 }
 
@@ -531,9 +1085,6 @@ camera_fb_t *cam_take(TickType_t timeout)
     /* throttle repeated NULL frame warnings */
     static uint16_t warn_null_cnt = 0;
 #endif
-    /* throttle repeated NO-EOI warnings */
-    static uint16_t warn_eoi_miss_cnt = 0;
-
     for (;;)
     {
         TickType_t elapsed = xTaskGetTickCount() - start; /* TickType_t is unsigned so rollover is safe */
@@ -553,6 +1104,7 @@ camera_fb_t *cam_take(TickType_t timeout)
 #if CONFIG_IDF_TARGET_ESP32S3
             if (dma_reset_counter < MAX_GDMA_RESETS) {
                 ll_cam_dma_reset(cam_obj);
+                CAM_STAT_INC(dma_resets);
                 dma_reset_counter++;
                 continue; /* retry with queue timeout */
             }
@@ -570,42 +1122,109 @@ camera_fb_t *cam_take(TickType_t timeout)
             continue;             /* go to top of loop */
         }
 
-        if (cam_obj->jpeg_mode) {
-            /* find the end marker for JPEG. Data after that can be discarded */
-            int offset_e = cam_verify_jpeg_eoi(dma_buffer->buf, dma_buffer->len);
-            if (offset_e >= 0) {
-                dma_buffer->len = offset_e + sizeof(JPEG_EOI_MARKER);
-                return dma_buffer;
-            }
-
-            CAM_WARN_THROTTLE(warn_eoi_miss_cnt,
-                              "NO-EOI - JPEG end marker missing");
-            cam_give(dma_buffer);
-            continue; /* wait for another frame */
-        } else if (cam_obj->psram_mode &&
+        /* JPEG frames were trimmed to their end marker in cam_task */
+        if (!cam_obj->jpeg_mode && cam_obj->psram_mode &&
                    cam_obj->in_bytes_per_pixel != cam_obj->fb_bytes_per_pixel) {
             /* currently used only for YUV to GRAYSCALE */
             dma_buffer->len = ll_cam_memcpy(cam_obj, dma_buffer->buf, dma_buffer->buf, dma_buffer->len);
         }
 
+        dma_buffer->take_us = esp_timer_get_time();
         return dma_buffer;
     }
 }
 
+bool cam_ref(camera_fb_t *dma_buffer)
+{
+    int x = cam_frame_index(dma_buffer);
+    if (x < 0) {
+        return false;
+    }
+    /* a frame with no holders may already be refilling, it can't be brought back to life */
+    unsigned int refs = atomic_load(&cam_obj->frames[x].refs);
+    do {
+        if (refs == 0) {
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak(&cam_obj->frames[x].refs, &refs, refs + 1));
+    return true;
+}
+
 void cam_give(camera_fb_t *dma_buffer)
 {
-    for (int x = 0; x < cam_obj->frame_cnt; x++) {
-        if (&cam_obj->frames[x].fb == dma_buffer) {
-            cam_obj->frames[x].en = 1;
-            break;
+    int x = cam_frame_index(dma_buffer);
+    if (x < 0) {
+        return;
+    }
+    /* ignore a give on a frame nobody holds, like a second return of the same buffer */
+    unsigned int refs = atomic_load(&cam_obj->frames[x].refs);
+    do {
+        if (refs == 0) {
+            return;
         }
+    } while (!atomic_compare_exchange_weak(&cam_obj->frames[x].refs, &refs, refs - 1));
+    if (refs == 1) {
+        cam_frame_release(x);
+        cam_notify_frame_free();
     }
 }
 
 void cam_give_all(void) {
     for (int x = 0; x < cam_obj->frame_cnt; x++) {
-        cam_obj->frames[x].en = 1;
+        atomic_store(&cam_obj->frames[x].refs, 0);
     }
+    unsigned int all = cam_obj->frame_cnt >= CAM_FRAME_CNT_MAX ? ~0u : (1u << cam_obj->frame_cnt) - 1;
+    atomic_store(&cam_obj->frames_free, all);
+    cam_notify_frame_free();
+}
+
+void cam_set_frame_cb(cam_frame_cb_t cb, void *arg)
+{
+    portENTER_CRITICAL(&s_frame_cb_lock);
+    s_frame_cb = cb;
+    s_frame_cb_arg = arg;
+    portEXIT_CRITICAL(&s_frame_cb_lock);
+}
+
+void cam_set_slice_cb(camera_slice_cb_t cb, void *arg)
+{
+    portENTER_CRITICAL(&s_frame_cb_lock);
+    s_slice_cb = cb;
+    s_slice_cb_arg = arg;
+    portEXIT_CRITICAL(&s_frame_cb_lock);
+}
+
+void cam_get_stats(camera_stats_t *stats)
+{
+    stats->frames_started = atomic_load(&s_stats.frames_started);
+    stats->frames_delivered = atomic_load(&s_stats.frames_delivered);
+    stats->fb_overflow = atomic_load(&s_stats.fb_overflow);
+    stats->no_soi = atomic_load(&s_stats.no_soi);
+    stats->no_eoi = atomic_load(&s_stats.no_eoi);
+    stats->repaired = atomic_load(&s_stats.repaired);
+    stats->bad_size = atomic_load(&s_stats.bad_size);
+    stats->event_overflow = atomic_load(&s_stats.event_overflow);
+    stats->queue_evicted = atomic_load(&s_stats.queue_evicted);
+    stats->queue_dropped = atomic_load(&s_stats.queue_dropped);
+    stats->no_free_fb = atomic_load(&s_stats.no_free_fb);
+    stats->dma_resets = atomic_load(&s_stats.dma_resets);
+    stats->fb_resizes = atomic_load(&s_stats.fb_resizes);
+    stats->fb_size = cam_obj->fb_size;
+    stats->queue_depth = uxQueueMessagesWaiting(cam_obj->frame_buffer_queue);
+}
+
+size_t cam_get_jpeg_capacity(void)
+{
+    if (!cam_obj || !cam_obj->jpeg_mode) {
+        return 0;
+    }
+#if CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE_ADAPTIVE
+    if (!cam_obj->psram_mode) {
+        /* the size the buffers may grow to, not the current one */
+        return cam_fb_adapt_clamp(cam_fb_adapt_max());
+    }
+#endif
+    return cam_fb_needed_size();
 }
 
 bool cam_get_available_frames(void)
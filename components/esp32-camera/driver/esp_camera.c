@@ -19,12 +19,15 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/gpio.h"
+#include "esp_timer.h"
 #include "esp_system.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "sensor.h"
 #include "sccb.h"
 #include "cam_hal.h"
+#include "rate_ctrl.h"
+#include "cam_decimate.h"
 #include "esp_camera.h"
 #include "xclk.h"
 #if CONFIG_OV2640_SUPPORT
@@ -90,11 +93,18 @@ static const char *TAG = "camera";
 typedef struct {
     sensor_t sensor;
     camera_fb_t fb;
+    camera_config_t config;         /* as passed to esp_camera_init(), updated by esp_camera_reconfigure() */
+    uint32_t reconfig_us;
+    camera_frame_cb_t frame_cb;
+    void *frame_cb_arg;
+    camera_slice_cb_t slice_cb;
+    void *slice_cb_arg;
 } camera_state_t;
 
 static const char *CAMERA_SENSOR_NVS_KEY = "sensor";
 static const char *CAMERA_PIXFORMAT_NVS_KEY = "pixformat";
 static camera_state_t *s_state = NULL;
+static portMUX_TYPE s_frame_cb_lock = portMUX_INITIALIZER_UNLOCKED;
 
 #if CONFIG_IDF_TARGET_ESP32S3 // LCD_CAM module of ESP32-S3 will generate xclk
 #define CAMERA_ENABLE_OUT_CLOCK(v)
@@ -311,6 +321,7 @@ esp_err_t esp_camera_init(const camera_config_t *config)
         goto fail;
     }
 
+    s_state->config = *config;
     framesize_t frame_size = (framesize_t) config->frame_size;
     pixformat_t pix_format = (pixformat_t) config->pixel_format;
 
@@ -356,6 +367,7 @@ esp_err_t esp_camera_init(const camera_config_t *config)
 
     if (pix_format == PIXFORMAT_JPEG) {
         s_state->sensor.set_quality(&s_state->sensor, config->jpeg_quality);
+        rate_ctrl_init(&s_state->sensor, &config->rate_ctrl, config->jpeg_quality, frame_size, cam_get_jpeg_capacity());
     }
     s_state->sensor.init_status(&s_state->sensor);
 
@@ -370,6 +382,9 @@ fail:
 
 esp_err_t esp_camera_deinit()
 {
+    cam_set_frame_cb(NULL, NULL);
+    cam_set_slice_cb(NULL, NULL);
+    rate_ctrl_deinit();
     esp_err_t ret = cam_deinit();
     CAMERA_DISABLE_OUT_CLOCK();
     if (s_state) {
@@ -384,6 +399,36 @@ esp_err_t esp_camera_deinit()
 
 #define FB_GET_TIMEOUT (4000 / portTICK_PERIOD_MS)
 
+static void camera_fb_set_properties(camera_fb_t *fb)
+{
+    fb->width = resolution[s_state->sensor.status.framesize].width;
+    fb->height = resolution[s_state->sensor.status.framesize].height;
+    fb->format = s_state->sensor.pixformat;
+    if (fb->format != PIXFORMAT_JPEG) {
+        uint8_t shift = cam_decimate_shift(s_state->config.decimate);
+        fb->width >>= shift;
+        fb->height >>= shift;
+    }
+}
+
+/* Runs in cam_task, see esp_camera_register_frame_cb() */
+static bool camera_frame_cb(camera_fb_t *fb, void *arg)
+{
+    portENTER_CRITICAL(&s_frame_cb_lock);
+    camera_frame_cb_t cb = s_state->frame_cb;
+    void *cb_arg = s_state->frame_cb_arg;
+    portEXIT_CRITICAL(&s_frame_cb_lock);
+
+    camera_fb_set_properties(fb);
+    if (!cb || !cb(fb, cb_arg)) {
+        return false;
+    }
+    /* taken frames never reach esp_camera_fb_get(), feed the rate controller here */
+    fb->take_us = esp_timer_get_time();
+    rate_ctrl_update(fb);
+    return true;
+}
+
 camera_fb_t *esp_camera_fb_get()
 {
     if (s_state == NULL) {
@@ -392,9 +437,8 @@ camera_fb_t *esp_camera_fb_get()
     camera_fb_t *fb = cam_take(FB_GET_TIMEOUT);
     //set the frame properties
     if (fb) {
-        fb->width = resolution[s_state->sensor.status.framesize].width;
-        fb->height = resolution[s_state->sensor.status.framesize].height;
-        fb->format = s_state->sensor.pixformat;
+        camera_fb_set_properties(fb);
+        rate_ctrl_update(fb);
     }
     return fb;
 }
@@ -407,6 +451,19 @@ void esp_camera_fb_return(camera_fb_t *fb)
     cam_give(fb);
 }
 
+camera_fb_t *esp_camera_fb_ref(camera_fb_t *fb)
+{
+    if (s_state == NULL || fb == NULL) {
+        return NULL;
+    }
+    return cam_ref(fb) ? fb : NULL;
+}
+
+void esp_camera_fb_unref(camera_fb_t *fb)
+{
+    esp_camera_fb_return(fb);
+}
+
 sensor_t *esp_camera_sensor_get()
 {
     if (s_state == NULL) {
@@ -517,3 +574,174 @@ bool esp_camera_available_frames(void)
     }
     return cam_get_available_frames();
 }
+
+esp_err_t esp_camera_rate_ctrl_get_status(camera_rate_ctrl_status_t *status)
+{
+    if (status == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    rate_ctrl_get_status(status);
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_rate_ctrl_set_target(size_t target_frame_bytes, uint32_t target_bytes_per_sec)
+{
+    if (s_state == NULL || s_state->sensor.pixformat != PIXFORMAT_JPEG) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    rate_ctrl_set_target(target_frame_bytes, target_bytes_per_sec);
+    return ESP_OK;
+}
+
+/* Runs in cam_task, see esp_camera_register_slice_cb() */
+static void camera_slice_cb(const camera_slice_t *slice, void *arg)
+{
+    portENTER_CRITICAL(&s_frame_cb_lock);
+    camera_slice_cb_t cb = s_state->slice_cb;
+    void *cb_arg = s_state->slice_cb_arg;
+    portEXIT_CRITICAL(&s_frame_cb_lock);
+
+    if (!cb) {
+        return;
+    }
+    if (slice->ok) {
+        camera_fb_set_properties(slice->fb);
+    }
+    cb(slice, cb_arg);
+}
+
+esp_err_t esp_camera_register_frame_cb(camera_frame_cb_t cb, void *arg)
+{
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    portENTER_CRITICAL(&s_frame_cb_lock);
+    s_state->frame_cb = cb;
+    s_state->frame_cb_arg = arg;
+    portEXIT_CRITICAL(&s_frame_cb_lock);
+    cam_set_frame_cb(cb ? camera_frame_cb : NULL, NULL);
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_register_slice_cb(camera_slice_cb_t cb, void *arg)
+{
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (cb && s_state->sensor.pixformat != PIXFORMAT_JPEG) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    portENTER_CRITICAL(&s_frame_cb_lock);
+    s_state->slice_cb = cb;
+    s_state->slice_cb_arg = arg;
+    portEXIT_CRITICAL(&s_frame_cb_lock);
+    cam_set_slice_cb(cb ? camera_slice_cb : NULL, NULL);
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_get_stats(camera_stats_t *stats)
+{
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    cam_get_stats(stats);
+    stats->reconfig_us = s_state->reconfig_us;
+    return ESP_OK;
+}
+
+/* Program the sensor for a new mode, like esp_camera_init() does after cam_config() */
+static esp_err_t camera_sensor_apply(const camera_config_t *config, framesize_t frame_size)
+{
+    sensor_t *sensor = &s_state->sensor;
+    pixformat_t pix_format = (pixformat_t) config->pixel_format;
+
+    sensor->status.framesize = frame_size;
+    sensor->pixformat = pix_format;
+    if (sensor->set_framesize(sensor, frame_size) != 0) {
+        ESP_LOGE(TAG, "Failed to set frame size");
+        return ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE;
+    }
+    if (sensor->set_pixformat(sensor, pix_format) != 0) {
+        ESP_LOGE(TAG, "Failed to set pixel format");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+#if CONFIG_CAMERA_CONVERTER_ENABLED
+    if(config->conv_mode) {
+        sensor->pixformat = get_output_data_format(config->conv_mode);
+    }
+#endif
+    if (pix_format == PIXFORMAT_JPEG) {
+        sensor->set_quality(sensor, config->jpeg_quality);
+        rate_ctrl_init(&s_state->sensor, &config->rate_ctrl, config->jpeg_quality, frame_size, cam_get_jpeg_capacity());
+    } else {
+        rate_ctrl_deinit();
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_reconfigure(framesize_t frame_size, pixformat_t pix_format, int quality)
+{
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    camera_sensor_info_t *info = esp_camera_sensor_get_info(&s_state->sensor.id);
+    if (PIXFORMAT_JPEG == pix_format && info && !info->support_jpeg) {
+        ESP_LOGE(TAG, "JPEG format is not supported on this sensor");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (frame_size >= FRAMESIZE_INVALID || (info && frame_size > info->max_size)) {
+        ESP_LOGE(TAG, "Frame size not supported on this sensor");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    camera_config_t config = s_state->config;
+    config.frame_size = frame_size;
+    config.pixel_format = pix_format;
+    if (quality > 0) {
+        config.jpeg_quality = quality;
+    }
+
+    esp_err_t err = cam_pause();
+    if (err != ESP_OK) {
+        if (err == ESP_ERR_TIMEOUT) {
+            cam_start();
+        }
+        return err;
+    }
+    err = cam_reconfig(&config, frame_size, s_state->sensor.id.PID);
+    if (err == ESP_OK) {
+        err = camera_sensor_apply(&config, frame_size);
+    }
+    if (err != ESP_OK) {
+        /* the previous mode fits the buffers we have, go back to it */
+        ESP_LOGE(TAG, "Reconfigure failed with error 0x%x, restoring the previous mode", err);
+        config = s_state->config;
+        if (cam_reconfig(&config, (framesize_t) config.frame_size, s_state->sensor.id.PID) != ESP_OK ||
+            camera_sensor_apply(&config, (framesize_t) config.frame_size) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to restore the previous mode, camera stays stopped");
+            return err;
+        }
+    } else {
+        s_state->config = config;
+    }
+
+    /* slices are JPEG only, pause them while another format is captured */
+    portENTER_CRITICAL(&s_frame_cb_lock);
+    bool slices = s_state->slice_cb != NULL;
+    portEXIT_CRITICAL(&s_frame_cb_lock);
+    cam_set_slice_cb(slices && config.pixel_format == PIXFORMAT_JPEG ? camera_slice_cb : NULL, NULL);
+
+    cam_start();
+    s_state->reconfig_us = (uint32_t)(esp_timer_get_time() - start_us);
+    ESP_LOGI(TAG, "Mode switch to %ux%u format %d took %u ms",
+             resolution[config.frame_size].width, resolution[config.frame_size].height,
+             config.pixel_format, (unsigned)(s_state->reconfig_us / 1000));
+    return err;
+}
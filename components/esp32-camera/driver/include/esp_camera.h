@@ -66,11 +66,19 @@
 
 #pragma once
 
+#include "sdkconfig.h"
 #include "esp_err.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "driver/ledc.h"
+#else
+/* The host simulation has no LEDC, the XCLK fields are kept for source compatibility */
+typedef int ledc_timer_t;
+typedef int ledc_channel_t;
+#define LEDC_TIMER_0    0
+#define LEDC_CHANNEL_0  0
+#endif
 #include "sensor.h"
 #include "sys/time.h"
-#include "sdkconfig.h"
 
 /**
  * @brief define for if chip supports camera
@@ -111,6 +119,64 @@ typedef enum {
 } camera_conv_mode_t;
 #endif
 
+/**
+ * @brief How captured data gets into the frame buffers, see camera_config_t.dma_mode
+ */
+typedef enum {
+    CAMERA_DMA_MODE_AUTO,           /*!< Direct when xclk_freq_hz is 16MHz on ESP32-S2/S3, copy otherwise (the behavior before dma_mode existed) */
+    CAMERA_DMA_MODE_COPY,           /*!< DMA fills a ring buffer in internal RAM, every half of it is copied into the frame buffer */
+    CAMERA_DMA_MODE_DIRECT,         /*!< DMA writes straight into the frame buffers, usually in PSRAM, with no copy. ESP32-S2/S3 only.
+                                         JPEG frame buffers keep their initial size and decimate is not available */
+} camera_dma_mode_t;
+
+/**
+ * @brief Reduced resolution frames, see camera_config_t.decimate
+ *
+ * Raw frames are scaled down while they are copied out of the DMA buffer, so a small
+ * frame for previews or motion detection costs no second pass and the frame buffers only
+ * hold the small image. Works with GRAYSCALE, YUV422 and RGB565, is ignored in JPEG mode
+ * and needs the copy DMA mode, see camera_dma_mode_t. Width and height of
+ * the frame size must be multiples of the factor, the width of twice the factor for YUV422.
+ */
+typedef enum {
+    CAMERA_DECIMATE_NONE,           /*!< Full resolution */
+    CAMERA_DECIMATE_2X,             /*!< Half width and height, the top left pixel of every 2x2 block */
+    CAMERA_DECIMATE_4X,             /*!< Quarter width and height, the top left pixel of every 4x4 block */
+    CAMERA_DECIMATE_2X_AVERAGE,     /*!< Half width and height, the average of every 2x2 block. Not for RGB565 */
+    CAMERA_DECIMATE_4X_AVERAGE,     /*!< Quarter width and height, the average of every 4x4 block. Not for RGB565 */
+} camera_decimate_t;
+
+/**
+ * @brief Closed-loop JPEG size control
+ *
+ * When enabled, the driver tracks the compressed size of recent frames and
+ * adjusts the sensor JPEG quality (and optionally the frame size) to hold the
+ * target. Leave both targets at 0 to disable. Only used in JPEG mode.
+ */
+typedef struct {
+    size_t target_frame_bytes;      /*!< Average JPEG frame size to hold, in bytes. Takes precedence over target_bytes_per_sec. Clamped to 3/4 of the frame buffer size */
+    uint32_t target_bytes_per_sec;  /*!< Throughput to hold (frame size x measured fps), in bytes per second */
+    int min_quality;                /*!< Best (lowest) jpeg_quality the controller may select. 0 selects the default (6) */
+    int max_quality;                /*!< Worst (highest) jpeg_quality the controller may select. 0 selects the default (40) */
+    uint8_t deadband_pct;           /*!< No adjustment while the measured size is within +/- this percentage of the target. 0 selects the default (15) */
+    bool adjust_framesize;          /*!< Step the frame size down when max_quality is still over target, and back up to frame_size when there is room */
+} camera_rate_ctrl_config_t;
+
+/**
+ * @brief Rate controller state, see esp_camera_rate_ctrl_get_status()
+ */
+typedef struct {
+    bool enabled;                   /*!< The controller is active */
+    uint32_t target_frame_bytes;    /*!< Current per-frame target, derived from target_bytes_per_sec when that is used */
+    uint32_t target_bytes_per_sec;  /*!< Configured throughput target, 0 in per-frame mode */
+    uint32_t frame_bytes;           /*!< Measured average frame size */
+    uint32_t bytes_per_sec;         /*!< Measured throughput */
+    uint32_t fps_x100;              /*!< Measured frame rate x100 */
+    int quality;                    /*!< jpeg_quality currently set on the sensor */
+    framesize_t framesize;          /*!< Frame size currently set on the sensor */
+    uint32_t adjustments;           /*!< Number of quality/frame size changes made so far */
+} camera_rate_ctrl_status_t;
+
 /**
  * @brief Configuration structure for camera initialization
  */
@@ -138,7 +204,7 @@ typedef struct {
     int pin_href;                   /*!< GPIO pin for camera HREF line */
     int pin_pclk;                   /*!< GPIO pin for camera PCLK line */
 
-    int xclk_freq_hz;               /*!< Frequency of XCLK signal, in Hz. EXPERIMENTAL: Set to 16MHz on ESP32-S2 or ESP32-S3 to enable EDMA mode */
+    int xclk_freq_hz;               /*!< Frequency of XCLK signal, in Hz. With dma_mode CAMERA_DMA_MODE_AUTO, 16MHz on ESP32-S2 or ESP32-S3 enables direct DMA */
 
     ledc_timer_t ledc_timer;        /*!< LEDC timer to be used for generating XCLK  */
     ledc_channel_t ledc_channel;    /*!< LEDC channel to be used for generating XCLK  */
@@ -155,6 +221,10 @@ typedef struct {
 #endif
 
     int sccb_i2c_port;              /*!< If pin_sccb_sda is -1, use the already configured I2C bus by number */
+
+    camera_rate_ctrl_config_t rate_ctrl; /*!< Optional JPEG size control, disabled when zeroed */
+    camera_decimate_t decimate;     /*!< Scale raw frames down while capturing them, full resolution when zeroed */
+    camera_dma_mode_t dma_mode;     /*!< Copy from a DMA ring buffer or DMA straight into the frame buffers, by XCLK when zeroed */
 } camera_config_t;
 
 /**
@@ -167,8 +237,50 @@ typedef struct {
     size_t height;              /*!< Height of the buffer in pixels */
     pixformat_t format;         /*!< Format of the pixel data */
     struct timeval timestamp;   /*!< Timestamp since boot of the first DMA buffer of the frame */
+    uint32_t seq;               /*!< Sequence number, counts every frame the driver started, so gaps are dropped frames */
+    int64_t vsync_us;           /*!< esp_timer time of the VSYNC that started the frame */
+    int64_t eof_us;             /*!< esp_timer time when the frame was complete and queued by the camera task */
+    int64_t take_us;            /*!< esp_timer time when the frame was handed out by esp_camera_fb_get() */
+    bool repaired;              /*!< JPEG was cut off and completed by the driver, the bottom of the image repeats the last decoded colors */
 } camera_fb_t;
 
+/**
+ * @brief Frame callback, see esp_camera_register_frame_cb()
+ *
+ * Runs in the camera task right after a frame is complete, so it must not block.
+ * width, height and format are already set, like for esp_camera_fb_get().
+ *
+ * @param fb    The new frame
+ * @param arg   User argument passed at registration
+ *
+ * @return true to take the frame: it is not queued for esp_camera_fb_get() and the callback owns
+ *         the reference, to be dropped later with esp_camera_fb_return().
+ *         false to leave it in the frame queue; take an esp_camera_fb_ref() to keep it past the callback.
+ */
+typedef bool (*camera_frame_cb_t)(camera_fb_t *fb, void *arg);
+
+/**
+ * @brief Part of a JPEG frame that is still being captured, see esp_camera_register_slice_cb()
+ *
+ * The bytes are at fb->buf + offset. The driver holds the frame from the first slice to the final one,
+ * so esp_camera_fb_ref(fb) succeeds in between. A frame with references left is neither refilled
+ * nor resized, even if it was dropped, until they are all returned with esp_camera_fb_unref().
+ * fb->seq is valid from the first slice.
+ */
+typedef struct {
+    camera_fb_t *fb;            /*!< Frame being filled. len, width, height and format are only valid in the final slice when ok is set */
+    size_t offset;              /*!< Offset of this slice in fb->buf */
+    size_t len;                 /*!< Bytes in this slice, can be 0 in the final slice */
+    bool first;                 /*!< First slice of a new frame. An unfinished previous frame was dropped */
+    bool last;                  /*!< Final slice: the frame is complete, or dropped if ok is false */
+    bool ok;                    /*!< Final slice only: the frame is valid and fb->len is its length after trimming to EOI */
+} camera_slice_t;
+
+/**
+ * @brief Slice callback, runs in the camera task and must not block
+ */
+typedef void (*camera_slice_cb_t)(const camera_slice_t *slice, void *arg);
+
 #define ESP_ERR_CAMERA_BASE 0x20000
 #define ESP_ERR_CAMERA_NOT_DETECTED             (ESP_ERR_CAMERA_BASE + 1)
 #define ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE (ESP_ERR_CAMERA_BASE + 2)
@@ -210,10 +322,34 @@ camera_fb_t* esp_camera_fb_get(void);
 /**
  * @brief Return the frame buffer to be reused again.
  *
+ * Drops the reference obtained from esp_camera_fb_get(). The buffer goes back to the
+ * driver once every reference taken with esp_camera_fb_ref() has been dropped too.
+ *
  * @param fb    Pointer to the frame buffer
  */
 void esp_camera_fb_return(camera_fb_t * fb);
 
+/**
+ * @brief Take an additional reference to a frame buffer
+ *
+ * Lets several consumers (streaming, recording, motion detection, ...) read the same
+ * frame without copying it. Each reference is dropped with esp_camera_fb_unref().
+ * The caller must already hold a reference to fb.
+ *
+ * @param fb    Pointer to the frame buffer
+ *
+ * @return fb, or NULL if the driver isn't initialized, fb isn't a camera frame buffer or it has already
+ *         been returned by all of its holders
+ */
+camera_fb_t *esp_camera_fb_ref(camera_fb_t *fb);
+
+/**
+ * @brief Drop one reference to a frame buffer, same as esp_camera_fb_return()
+ *
+ * @param fb    Pointer to the frame buffer
+ */
+void esp_camera_fb_unref(camera_fb_t *fb);
+
 /**
  * @brief Get a pointer to the image sensor control structure
  *
@@ -245,6 +381,133 @@ void esp_camera_return_all(void);
  */
 bool esp_camera_available_frames(void);
 
+/**
+ * @brief Read back the JPEG rate controller targets and measurements
+ *
+ * @param status  Filled with the current state. status->enabled is false when rate control is off
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if status is NULL
+ *      - ESP_ERR_INVALID_STATE if the driver hasn't been initialized yet
+ */
+esp_err_t esp_camera_rate_ctrl_get_status(camera_rate_ctrl_status_t *status);
+
+/**
+ * @brief Change the JPEG rate controller target at runtime
+ *
+ * Passing 0 for both targets disables the controller and leaves the sensor at its current quality.
+ * The quality range and deadband from camera_config_t::rate_ctrl are kept.
+ *
+ * @param target_frame_bytes    Per-frame target in bytes, takes precedence when non-zero. Clamped to 3/4 of the frame buffer size
+ * @param target_bytes_per_sec  Throughput target in bytes per second
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if the driver hasn't been initialized yet or is not in JPEG mode
+ */
+esp_err_t esp_camera_rate_ctrl_set_target(size_t target_frame_bytes, uint32_t target_bytes_per_sec);
+
+/**
+ * @brief Get complete frames pushed from the camera task instead of polling esp_camera_fb_get()
+ *
+ * The callback fires as soon as a frame is complete, before it is queued. A consumer task can
+ * block on a task notification given from the callback instead of waiting in esp_camera_fb_get().
+ * Only one callback is registered at a time; it may still run once after being replaced.
+ *
+ * @param cb    Callback, NULL to unregister
+ * @param arg   Passed to the callback
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if the driver hasn't been initialized yet
+ */
+esp_err_t esp_camera_register_frame_cb(camera_frame_cb_t cb, void *arg);
+
+/**
+ * @brief Get each JPEG frame in slices while it is still being captured
+ *
+ * Every completed DMA half buffer is passed to the callback as soon as it is in the frame buffer,
+ * so a consumer can start sending a frame before the sensor has finished it. The final slice
+ * arrives right before the frame is delivered through the frame callback or queue. Only the
+ * final slice's length takes the trim to the JPEG end marker into account, so fb->len can be
+ * smaller than the bytes already sliced; trailing bytes after EOI are harmless to decoders.
+ *
+ * @param cb    Callback, NULL to unregister
+ * @param arg   Passed to the callback
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if the driver hasn't been initialized yet
+ *      - ESP_ERR_NOT_SUPPORTED if the pixel format is not JPEG
+ */
+esp_err_t esp_camera_register_slice_cb(camera_slice_cb_t cb, void *arg);
+
+/**
+ * @brief Driver counters, see esp_camera_get_stats()
+ *
+ * Every started frame (camera_fb_t.seq) is either delivered or counted under exactly one of the
+ * frame drop reasons: fb_overflow, no_soi, no_eoi, bad_size, event_overflow or queue_dropped.
+ * A delivered frame can still be evicted from the queue later (queue_evicted).
+ */
+typedef struct {
+    uint32_t frames_started;    /*!< Frames the driver started capturing */
+    uint32_t frames_delivered;  /*!< Frames handed to the frame callback or the frame queue */
+    uint32_t fb_overflow;       /*!< FB-OVF: the frame didn't fit into the frame buffer */
+    uint32_t no_soi;            /*!< NO-SOI: JPEG start marker missing in the first DMA buffer, or no data before VSYNC */
+    uint32_t no_eoi;            /*!< NO-EOI: JPEG end marker missing at VSYNC */
+    uint32_t repaired;          /*!< JPEG frames missing EOI that were completed and delivered instead of dropped */
+    uint32_t bad_size;          /*!< FB-SIZE: raw frame of unexpected size */
+    uint32_t event_overflow;    /*!< Camera event queue full in the ISR, the frame in progress was aborted */
+    uint32_t queue_evicted;     /*!< Older frames dropped from the full frame queue to make room (CAMERA_GRAB_LATEST) */
+    uint32_t queue_dropped;     /*!< New frames dropped because the frame queue stayed full */
+    uint32_t no_free_fb;        /*!< Times capture paused because every frame buffer was in use */
+    uint32_t dma_resets;        /*!< GDMA resets done to recover from a stalled DMA */
+    uint32_t queue_depth;       /*!< Frames waiting in the frame queue right now */
+    uint32_t fb_size;           /*!< Current frame buffer size, changes over time with adaptive JPEG buffers */
+    uint32_t fb_resizes;        /*!< Frame buffers reallocated by the adaptive JPEG buffer sizing */
+    uint32_t reconfig_us;       /*!< Duration of the last esp_camera_reconfigure(), 0 if there was none */
+} camera_stats_t;
+
+/**
+ * @brief Read the driver counters
+ *
+ * Counters are reset by esp_camera_init() and only ever increase, except queue_depth.
+ *
+ * @param stats  Filled with the current values
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if the driver hasn't been initialized yet
+ *      - ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t esp_camera_get_stats(camera_stats_t *stats);
+
+/**
+ * @brief Switch frame size, pixel format and JPEG quality without esp_camera_deinit()
+ *
+ * Stops capture, recomputes the DMA layout, programs the sensor and restarts. Existing frame
+ * buffers are reused when the new mode fits into them, so switching to a smaller mode and back
+ * needs no allocation. Switching to a mode that needs bigger buffers requires every frame to be
+ * returned first. Frames still queued in the driver are dropped; frames the application holds
+ * stay valid and keep their old width, height and format. The time the switch took is logged
+ * and reported in camera_stats_t.reconfig_us.
+ *
+ * Must not be called from the frame or slice callback.
+ *
+ * @param frame_size    New frame size
+ * @param pix_format    New pixel format
+ * @param quality       JPEG quality, 0 or negative keeps the current one
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if the driver isn't initialized, or buffers must grow while frames are held
+ *      - ESP_ERR_INVALID_ARG / ESP_ERR_NOT_SUPPORTED if the sensor doesn't support the mode
+ *      - ESP_ERR_NO_MEM if bigger buffers could not be allocated
+ *      On failure the previous mode is restored and capture continues.
+ */
+esp_err_t esp_camera_reconfigure(framesize_t frame_size, pixformat_t pix_format, int quality);
+
 
 #ifdef __cplusplus
 }
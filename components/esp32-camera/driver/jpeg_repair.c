@@ -0,0 +1,577 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jpeg_repair.h"
+
+#define JR_MAX_COMPS        4
+#define JR_MAX_TABLES       2       /* baseline allows two DC and two AC tables */
+#define JR_LOOKAHEAD        8
+#define JR_RING             8       /* must be a power of 2 and hold the bytes of a full accumulator */
+
+typedef struct {
+    bool present;
+    uint8_t bits[17];               /* number of codes of each length */
+    uint8_t huffval[256];
+    int32_t maxcode[18];            /* largest code of each length, -1 if none */
+    int32_t valoff[17];             /* index into huffval of a code of each length, minus the code */
+    uint8_t look_len[1 << JR_LOOKAHEAD];    /* 0 = code longer than JR_LOOKAHEAD bits */
+    uint8_t look_sym[1 << JR_LOOKAHEAD];
+} jr_huff_t;
+
+typedef struct {
+    uint8_t id;
+    uint8_t h, v;
+    uint8_t td, ta;
+    uint16_t fill_code;             /* DC category 0 followed by EOB */
+    uint8_t fill_len;
+} jr_comp_t;
+
+typedef struct {
+    jr_huff_t dc[JR_MAX_TABLES];
+    jr_huff_t ac[JR_MAX_TABLES];
+    jr_comp_t comps[JR_MAX_COMPS];
+    uint8_t ncomps;
+    uint16_t width, height;
+    uint16_t restart_interval;
+    uint32_t total_mcus;
+    uint32_t fill_bits;             /* bits per filled MCU */
+} jr_ctx_t;
+
+/* Entropy-coded data reader, remembers where its bytes came from so it can report a cut point */
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;                     /* next byte to load */
+    uint32_t acc;
+    int cnt;                        /* unread bits at the bottom of acc */
+    uint32_t loaded;
+    size_t src[JR_RING];            /* offsets of the last loaded bytes */
+    bool marker;                    /* stopped in front of a marker */
+} jr_reader_t;
+
+/* Keep buf[0, off) and the top nbits of buf[off] */
+typedef struct {
+    size_t off;
+    uint8_t nbits;
+    uint32_t mcu;                   /* MCUs before this point */
+} jr_cut_t;
+
+typedef struct {
+    uint8_t *buf;
+    size_t pos;
+    size_t cap;
+    uint32_t acc;
+    int cnt;
+    bool dry;                       /* only count the bytes */
+} jr_writer_t;
+
+static uint16_t jr_be16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static bool jr_huff_build(jr_huff_t *h)
+{
+    int32_t code = 0;
+    int k = 0;
+    memset(h->look_len, 0, sizeof(h->look_len));
+    for (int l = 1; l <= 16; l++) {
+        if (!h->bits[l]) {
+            h->maxcode[l] = -1;
+            h->valoff[l] = 0;
+            code <<= 1;
+            continue;
+        }
+        h->valoff[l] = k - code;
+        for (int i = 0; i < h->bits[l]; i++, k++, code++) {
+            if (l <= JR_LOOKAHEAD) {
+                int shift = JR_LOOKAHEAD - l;
+                for (int s = 0; s < (1 << shift); s++) {
+                    h->look_len[(code << shift) | s] = l;
+                    h->look_sym[(code << shift) | s] = h->huffval[k];
+                }
+            }
+        }
+        h->maxcode[l] = code - 1;
+        /* more codes than fit in l bits */
+        if (code > (1 << l)) {
+            return false;
+        }
+        code <<= 1;
+    }
+    h->maxcode[17] = INT32_MAX;
+    h->present = true;
+    return true;
+}
+
+/* Canonical code of sym, false if the table has none */
+static bool jr_huff_code(const jr_huff_t *h, uint8_t sym, uint16_t *code, uint8_t *len)
+{
+    uint32_t c = 0;
+    int k = 0;
+    for (int l = 1; l <= 16; l++) {
+        for (int i = 0; i < h->bits[l]; i++, k++, c++) {
+            if (h->huffval[k] == sym) {
+                *code = c;
+                *len = l;
+                return true;
+            }
+        }
+        c <<= 1;
+    }
+    return false;
+}
+
+static bool jr_parse_dht(jr_ctx_t *ctx, const uint8_t *p, size_t n)
+{
+    while (n) {
+        if (n < 17) {
+            return false;
+        }
+        uint8_t tc = p[0] >> 4, th = p[0] & 0x0F;
+        if (tc > 1 || th >= JR_MAX_TABLES) {
+            return false;
+        }
+        jr_huff_t *h = tc ? &ctx->ac[th] : &ctx->dc[th];
+        size_t count = 0;
+        h->bits[0] = 0;
+        for (int l = 1; l <= 16; l++) {
+            h->bits[l] = p[l];
+            count += p[l];
+        }
+        if (count > 256 || n < 17 + count) {
+            return false;
+        }
+        memcpy(h->huffval, &p[17], count);
+        if (!jr_huff_build(h)) {
+            return false;
+        }
+        p += 17 + count;
+        n -= 17 + count;
+    }
+    return true;
+}
+
+static bool jr_parse_sof(jr_ctx_t *ctx, const uint8_t *p, size_t n)
+{
+    if (n < 6 || p[0] != 8) {
+        return false;
+    }
+    ctx->height = jr_be16(&p[1]);
+    ctx->width = jr_be16(&p[3]);
+    ctx->ncomps = p[5];
+    if (!ctx->height || !ctx->width || !ctx->ncomps || ctx->ncomps > JR_MAX_COMPS || n < 6 + 3 * (size_t)ctx->ncomps) {
+        return false;
+    }
+    for (int i = 0; i < ctx->ncomps; i++) {
+        jr_comp_t *c = &ctx->comps[i];
+        c->id = p[6 + 3 * i];
+        c->h = p[7 + 3 * i] >> 4;
+        c->v = p[7 + 3 * i] & 0x0F;
+        if (c->h < 1 || c->h > 4 || c->v < 1 || c->v > 4) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Only single-scan images with every component interleaved, which is what the sensors produce */
+static bool jr_parse_sos(jr_ctx_t *ctx, const uint8_t *p, size_t n)
+{
+    if (!ctx->ncomps || n < 1 || p[0] != ctx->ncomps || n < 4 + 2 * (size_t)p[0]) {
+        return false;
+    }
+    for (int i = 0; i < p[0]; i++) {
+        jr_comp_t *c = &ctx->comps[i];
+        if (c->id != p[1 + 2 * i]) {
+            return false;
+        }
+        c->td = p[2 + 2 * i] >> 4;
+        c->ta = p[2 + 2 * i] & 0x0F;
+        if (c->td >= JR_MAX_TABLES || c->ta >= JR_MAX_TABLES ||
+            !ctx->dc[c->td].present || !ctx->ac[c->ta].present) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Walk the marker segments up to SOS, return the offset of the entropy-coded data or 0 */
+static size_t jr_parse_headers(jr_ctx_t *ctx, const uint8_t *buf, size_t len)
+{
+    if (len < 2 || buf[0] != 0xFF || buf[1] != 0xD8) {
+        return 0;
+    }
+    bool sof = false;
+    size_t pos = 2;
+    while (pos + 4 <= len) {
+        if (buf[pos] != 0xFF) {
+            return 0;
+        }
+        uint8_t m = buf[pos + 1];
+        if (m == 0xFF) {
+            pos++;
+            continue;
+        }
+        if (m == 0x01 || (m >= 0xD0 && m <= 0xD8)) {
+            pos += 2;
+            continue;
+        }
+        size_t seg = jr_be16(&buf[pos + 2]);
+        if (seg < 2 || pos + 2 + seg > len) {
+            return 0;
+        }
+        const uint8_t *p = &buf[pos + 4];
+        size_t n = seg - 2;
+        switch (m) {
+        case 0xC0:
+        case 0xC1:
+            if (!jr_parse_sof(ctx, p, n)) {
+                return 0;
+            }
+            sof = true;
+            break;
+        case 0xC4:
+            if (!jr_parse_dht(ctx, p, n)) {
+                return 0;
+            }
+            break;
+        case 0xDD:
+            if (n < 2) {
+                return 0;
+            }
+            ctx->restart_interval = jr_be16(p);
+            break;
+        case 0xDA:
+            if (!sof || !jr_parse_sos(ctx, p, n)) {
+                return 0;
+            }
+            return pos + 2 + seg;
+        case 0xD9:
+            return 0;
+        default:
+            /* progressive, lossless and arithmetic coded frames can't be completed this way */
+            if (m >= 0xC2 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC) {
+                return 0;
+            }
+            break;
+        }
+        pos += 2 + seg;
+    }
+    return 0;
+}
+
+static bool jr_setup_mcus(jr_ctx_t *ctx)
+{
+    uint8_t hmax = 1, vmax = 1;
+    uint32_t blocks = 0;
+    if (ctx->ncomps == 1) {
+        /* a non-interleaved scan codes one block per MCU whatever the sampling factors */
+        ctx->comps[0].h = ctx->comps[0].v = 1;
+    }
+    for (int i = 0; i < ctx->ncomps; i++) {
+        hmax = ctx->comps[i].h > hmax ? ctx->comps[i].h : hmax;
+        vmax = ctx->comps[i].v > vmax ? ctx->comps[i].v : vmax;
+        blocks += ctx->comps[i].h * ctx->comps[i].v;
+    }
+    if (blocks > 10) {
+        return false;
+    }
+    uint32_t mcux = (ctx->width + 8 * hmax - 1) / (8 * hmax);
+    uint32_t mcuy = (ctx->height + 8 * vmax - 1) / (8 * vmax);
+    ctx->total_mcus = mcux * mcuy;
+
+    ctx->fill_bits = 0;
+    for (int i = 0; i < ctx->ncomps; i++) {
+        jr_comp_t *c = &ctx->comps[i];
+        uint16_t dc_code, eob_code;
+        uint8_t dc_len, eob_len;
+        if (!jr_huff_code(&ctx->dc[c->td], 0x00, &dc_code, &dc_len) ||
+            !jr_huff_code(&ctx->ac[c->ta], 0x00, &eob_code, &eob_len)) {
+            return false;
+        }
+        c->fill_code = (dc_code << eob_len) | eob_code;
+        c->fill_len = dc_len + eob_len;
+        ctx->fill_bits += c->h * c->v * c->fill_len;
+    }
+    return true;
+}
+
+static void jr_reader_init(jr_reader_t *r, const uint8_t *buf, size_t len, size_t start)
+{
+    memset(r, 0, sizeof(*r));
+    r->buf = buf;
+    r->len = len;
+    r->pos = start;
+}
+
+/* Top up the accumulator to more than 24 bits, unstuffing FF 00; stops at a marker or the end */
+static void jr_fill(jr_reader_t *r)
+{
+    while (r->cnt <= 24 && !r->marker && r->pos < r->len) {
+        uint8_t b = r->buf[r->pos];
+        size_t next = r->pos + 1;
+        if (b == 0xFF) {
+            if (next >= r->len) {
+                /* cut between FF and its stuffing byte */
+                return;
+            }
+            if (r->buf[next] != 0x00) {
+                r->marker = true;
+                return;
+            }
+            next++;
+        }
+        r->src[r->loaded++ & (JR_RING - 1)] = r->pos;
+        r->pos = next;
+        r->acc = (r->acc << 8) | b;
+        r->cnt += 8;
+    }
+}
+
+static int jr_decode(jr_reader_t *r, const jr_huff_t *h)
+{
+    jr_fill(r);
+    if (r->cnt >= JR_LOOKAHEAD) {
+        uint32_t peek = (r->acc >> (r->cnt - JR_LOOKAHEAD)) & ((1 << JR_LOOKAHEAD) - 1);
+        if (h->look_len[peek]) {
+            r->cnt -= h->look_len[peek];
+            return h->look_sym[peek];
+        }
+    }
+    int32_t code = 0;
+    for (int l = 1; l <= 16; l++) {
+        if (!r->cnt) {
+            return -1;
+        }
+        code = (code << 1) | ((r->acc >> (r->cnt - 1)) & 1);
+        r->cnt--;
+        if (code <= h->maxcode[l]) {
+            return h->huffval[h->valoff[l] + code];
+        }
+    }
+    return -1;
+}
+
+static bool jr_skip_bits(jr_reader_t *r, int n)
+{
+    jr_fill(r);
+    if (r->cnt < n) {
+        return false;
+    }
+    r->cnt -= n;
+    return true;
+}
+
+/* Decode one block without reconstructing it, only to find where it ends */
+static bool jr_skip_block(jr_reader_t *r, const jr_huff_t *dc, const jr_huff_t *ac)
+{
+    int s = jr_decode(r, dc);
+    if (s < 0 || s > 15 || !jr_skip_bits(r, s)) {
+        return false;
+    }
+    for (int k = 1; k < 64; k++) {
+        int rs = jr_decode(r, ac);
+        if (rs < 0) {
+            return false;
+        }
+        s = rs & 0x0F;
+        if (!s) {
+            if ((rs >> 4) != 15) {
+                break;
+            }
+            k += 15;
+            continue;
+        }
+        k += rs >> 4;
+        if (!jr_skip_bits(r, s)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool jr_skip_mcu(const jr_ctx_t *ctx, jr_reader_t *r)
+{
+    for (int i = 0; i < ctx->ncomps; i++) {
+        const jr_comp_t *c = &ctx->comps[i];
+        for (int b = 0; b < c->h * c->v; b++) {
+            if (!jr_skip_block(r, &ctx->dc[c->td], &ctx->ac[c->ta])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Step over the RST marker expected after an interval, dropping the padding bits before it */
+static bool jr_skip_restart(jr_reader_t *r)
+{
+    r->cnt = 0;
+    jr_fill(r);
+    if (!r->marker || r->buf[r->pos + 1] < 0xD0 || r->buf[r->pos + 1] > 0xD7) {
+        return false;
+    }
+    r->pos += 2;
+    r->marker = false;
+    return true;
+}
+
+static jr_cut_t jr_position(const jr_reader_t *r, uint32_t mcu)
+{
+    jr_cut_t cut = { .off = r->pos, .nbits = 0, .mcu = mcu };
+    if (r->cnt) {
+        cut.off = r->src[(r->loaded - (r->cnt + 7) / 8) & (JR_RING - 1)];
+        cut.nbits = (8 - r->cnt % 8) % 8;
+    }
+    return cut;
+}
+
+/* Restart markers the fill has to write from MCU mcu on */
+static uint32_t jr_fill_restarts(const jr_ctx_t *ctx, uint32_t mcu)
+{
+    uint32_t ri = ctx->restart_interval;
+    if (!ri || ctx->total_mcus < 2) {
+        return 0;
+    }
+    return (ctx->total_mcus - 1) / ri - (mcu ? (mcu - 1) / ri : 0);
+}
+
+/* Bytes needed after the cut, with room for byte stuffing */
+static size_t jr_fill_estimate(const jr_ctx_t *ctx, const jr_cut_t *cut)
+{
+    uint64_t bits = cut->nbits + (uint64_t)(ctx->total_mcus - cut->mcu) * ctx->fill_bits + 7;
+    size_t bytes = bits / 8;
+    return bytes + bytes / 8 + jr_fill_restarts(ctx, cut->mcu) * 3 + 2;
+}
+
+static void jr_put_byte(jr_writer_t *w, uint8_t b)
+{
+    if (!w->dry && w->pos < w->cap) {
+        w->buf[w->pos] = b;
+    }
+    w->pos++;
+}
+
+static void jr_put_bits(jr_writer_t *w, uint32_t code, int len)
+{
+    w->acc = (w->acc << len) | code;
+    w->cnt += len;
+    while (w->cnt >= 8) {
+        uint8_t b = w->acc >> (w->cnt - 8);
+        jr_put_byte(w, b);
+        if (b == 0xFF) {
+            jr_put_byte(w, 0x00);
+        }
+        w->cnt -= 8;
+    }
+}
+
+static void jr_put_align(jr_writer_t *w)
+{
+    if (w->cnt) {
+        int pad = 8 - w->cnt;
+        jr_put_bits(w, (1 << pad) - 1, pad);
+    }
+}
+
+/* Write (or with dry set, measure) the fill from the cut to EOI, return the end offset */
+static size_t jr_write_fill(const jr_ctx_t *ctx, uint8_t *buf, size_t cap, const jr_cut_t *cut, bool dry)
+{
+    jr_writer_t w = {
+        .buf = buf,
+        .pos = cut->off,
+        .cap = cap,
+        .acc = cut->nbits ? buf[cut->off] >> (8 - cut->nbits) : 0,
+        .cnt = cut->nbits,
+        .dry = dry,
+    };
+    uint32_t ri = ctx->restart_interval;
+    for (uint32_t m = cut->mcu; m < ctx->total_mcus; m++) {
+        if (ri && m && m % ri == 0) {
+            jr_put_align(&w);
+            jr_put_byte(&w, 0xFF);
+            jr_put_byte(&w, 0xD0 + ((m / ri - 1) & 7));
+        }
+        for (int i = 0; i < ctx->ncomps; i++) {
+            const jr_comp_t *c = &ctx->comps[i];
+            for (int b = 0; b < c->h * c->v; b++) {
+                jr_put_bits(&w, c->fill_code, c->fill_len);
+            }
+        }
+    }
+    jr_put_align(&w);
+    jr_put_byte(&w, 0xFF);
+    jr_put_byte(&w, 0xD9);
+    return w.pos;
+}
+
+/* Decode up to the last complete MCU. With cap set, stop instead at the last MCU whose fill still fits. */
+static jr_cut_t jr_find_cut(const jr_ctx_t *ctx, const uint8_t *buf, size_t len, size_t start, size_t cap)
+{
+    jr_reader_t r;
+    jr_reader_init(&r, buf, len, start);
+    jr_cut_t cut = jr_position(&r, 0);
+    uint32_t ri = ctx->restart_interval;
+    for (uint32_t m = 0; m < ctx->total_mcus; m++) {
+        if (ri && m && m % ri == 0 && !jr_skip_restart(&r)) {
+            break;
+        }
+        if (!jr_skip_mcu(ctx, &r)) {
+            break;
+        }
+        jr_cut_t next = jr_position(&r, m + 1);
+        if (cap && next.off + jr_fill_estimate(ctx, &next) > cap) {
+            break;
+        }
+        cut = next;
+    }
+    return cut;
+}
+
+size_t jpeg_repair_truncated(uint8_t *buf, size_t len, size_t cap)
+{
+    if (!buf || len > cap) {
+        return 0;
+    }
+    jr_ctx_t *ctx = calloc(1, sizeof(jr_ctx_t));
+    if (!ctx) {
+        return 0;
+    }
+    size_t out = 0;
+    size_t start = jr_parse_headers(ctx, buf, len);
+    if (!start || !jr_setup_mcus(ctx)) {
+        goto done;
+    }
+
+    jr_cut_t cut = jr_find_cut(ctx, buf, len, start, 0);
+    size_t end = jr_write_fill(ctx, buf, cap, &cut, true);
+    if (end > cap) {
+        /* decode again, keeping only as much as leaves room for the fill */
+        cut = jr_find_cut(ctx, buf, len, start, cap);
+        end = jr_write_fill(ctx, buf, cap, &cut, true);
+        if (end > cap) {
+            goto done;
+        }
+    }
+    out = jr_write_fill(ctx, buf, cap, &cut, false);
+
+done:
+    free(ctx);
+    return out;
+}
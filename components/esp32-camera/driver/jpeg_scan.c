@@ -0,0 +1,141 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdbool.h>
+#include <string.h>
+#include "jpeg_scan.h"
+
+#define SWAR_ONES   0x01010101u
+#define SWAR_HIGHS  0x80808080u
+
+/* A byte of w is 0xFF exactly when the same byte of ~w is zero */
+static inline bool word_has_ff(uint32_t w)
+{
+    uint32_t x = ~w;
+    return ((x - SWAR_ONES) & ~x & SWAR_HIGHS) != 0;
+}
+
+static inline uint32_t load_word(const uint8_t *p)
+{
+    uint32_t w;
+    memcpy(&w, p, sizeof(w)); /* p is aligned, this is a single load */
+    return w;
+}
+
+const uint8_t *jpeg_scan_ff(const uint8_t *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    const uint8_t *end = buf + len;
+
+    while (p < end && ((uintptr_t)p & 3)) {
+        if (*p == 0xFF) {
+            return p;
+        }
+        p++;
+    }
+    while (end - p >= 4 && !word_has_ff(load_word(p))) {
+        p += 4;
+    }
+    /* at most one word left to check byte by byte before a hit */
+    while (p < end) {
+        if (*p == 0xFF) {
+            return p;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+const uint8_t *jpeg_scan_ff_rev(const uint8_t *buf, size_t len)
+{
+    const uint8_t *p = buf + len;
+
+    while (p > buf && ((uintptr_t)p & 3)) {
+        p--;
+        if (*p == 0xFF) {
+            return p;
+        }
+    }
+    while (p - buf >= 4 && !word_has_ff(load_word(p - 4))) {
+        p -= 4;
+    }
+    while (p > buf) {
+        p--;
+        if (*p == 0xFF) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+int32_t jpeg_scan_marker(const uint8_t *buf, size_t len, uint8_t code)
+{
+    if (len < 2) {
+        return -1;
+    }
+    const uint8_t *p = buf;
+    const uint8_t *last = buf + len - 1; /* a marker needs one byte after the 0xFF */
+    while (p < last && (p = jpeg_scan_ff(p, last - p)) != NULL) {
+        if (p[1] == code) {
+            return p - buf;
+        }
+        p++;
+    }
+    return -1;
+}
+
+int32_t jpeg_scan_marker_rev(const uint8_t *buf, size_t len, uint8_t code)
+{
+    if (len < 2) {
+        return -1;
+    }
+    size_t n = len - 1;
+    const uint8_t *p;
+    while (n && (p = jpeg_scan_ff_rev(buf, n)) != NULL) {
+        if (p[1] == code) {
+            return p - buf;
+        }
+        n = p - buf;
+    }
+    return -1;
+}
+
+size_t jpeg_scan_markers(const uint8_t *buf, size_t len, jpeg_marker_t *markers, size_t max)
+{
+    size_t count = 0;
+    if (len < 2) {
+        return 0;
+    }
+    const uint8_t *p = buf;
+    const uint8_t *last = buf + len - 1;
+    while (p < last && (p = jpeg_scan_ff(p, last - p)) != NULL) {
+        uint8_t code = p[1];
+        if (code == 0x00) {
+            p += 2;
+            continue;
+        }
+        if (code == 0xFF) {
+            p++;
+            continue;
+        }
+        if (markers && count < max) {
+            markers[count].offset = p - buf;
+            markers[count].code = code;
+        }
+        count++;
+        p += 2;
+    }
+    return count;
+}
@@ -0,0 +1,95 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_camera.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief State of a frame being scaled down line by line, see camera_decimate_t
+ *
+ * The input are whole lines in frame buffer format (Y8, YUYV or RGB565), handed over
+ * in chunks as they come out of the DMA buffer.
+ */
+typedef struct {
+    uint8_t factor;             /*!< 1 (off), 2 or 4 */
+    uint8_t shift;              /*!< log2(factor) */
+    bool average;               /*!< Box average instead of keeping the top left pixel */
+    bool yuyv;                  /*!< 2-byte pixels are YUYV pairs, each output pair keeps a U and a V */
+    uint8_t bytes_per_pixel;    /*!< 1 or 2 */
+    uint16_t width;             /*!< Input pixels per line */
+    uint32_t line;              /*!< Input line of the frame the next chunk starts with */
+    uint16_t *sum;              /*!< Average: sums of the block row in progress, one per output byte */
+} cam_decimate_t;
+
+/* log2 of the factor of mode, 0 for CAMERA_DECIMATE_NONE */
+static inline uint8_t cam_decimate_shift(camera_decimate_t mode)
+{
+    switch (mode) {
+    case CAMERA_DECIMATE_2X:
+    case CAMERA_DECIMATE_2X_AVERAGE:
+        return 1;
+    case CAMERA_DECIMATE_4X:
+    case CAMERA_DECIMATE_4X_AVERAGE:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Set up decimation of width x height frames
+ *
+ * JPEG frames are never decimated, mode is ignored for them.
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_NOT_SUPPORTED for averaged RGB565
+ *      - ESP_ERR_INVALID_SIZE if width or height isn't a multiple of the factor
+ *        (width of twice the factor for YUV422)
+ *      - ESP_ERR_NO_MEM if the average sums can't be allocated
+ */
+esp_err_t cam_decimate_init(cam_decimate_t *dec, camera_decimate_t mode, pixformat_t format, uint16_t width, uint16_t height);
+
+/**
+ * @brief Free the average sums, dec is left in the off state
+ */
+void cam_decimate_deinit(cam_decimate_t *dec);
+
+/**
+ * @brief Bytes cam_decimate_lines() will write for the next len input bytes
+ */
+size_t cam_decimate_out_size(const cam_decimate_t *dec, size_t len);
+
+/**
+ * @brief Scale down the next len bytes of the frame, which must be whole lines
+ *
+ * Reset dec->line to 0 at the start of every frame.
+ *
+ * @return Number of bytes written to out
+ */
+size_t cam_decimate_lines(cam_decimate_t *dec, uint8_t *out, const uint8_t *in, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
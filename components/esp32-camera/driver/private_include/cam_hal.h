@@ -47,18 +47,58 @@ esp_err_t cam_init(const camera_config_t *config);
 
 esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint16_t sensor_pid);
 
+/**
+ * @brief Stop capture and wait until the camera task has dropped the frame in progress
+ *
+ * @return
+ *     - ESP_OK Success, restart with cam_start()
+ *     - ESP_ERR_INVALID_STATE Not initialized or called from the camera task, capture keeps running
+ *     - ESP_ERR_TIMEOUT The camera task didn't respond, capture is stopped
+ */
+esp_err_t cam_pause(void);
+
+/**
+ * @brief Change frame size and pixel format of a paused driver
+ *
+ * Drops queued frames and recomputes the DMA layout. Frame buffers are reused when big
+ * enough; growing them requires every frame to be returned first. On failure the driver
+ * must be reconfigured back to a layout that fits before cam_start().
+ *
+ * @return
+ *     - ESP_OK Success, call cam_start() after programming the sensor
+ *     - ESP_ERR_INVALID_STATE Not initialized, not paused, or frames still held
+ *     - ESP_ERR_NO_MEM Not enough memory for the bigger buffers
+ */
+esp_err_t cam_reconfig(const camera_config_t *config, framesize_t frame_size, uint16_t sensor_pid);
+
 void cam_stop(void);
 
 void cam_start(void);
 
 camera_fb_t *cam_take(TickType_t timeout);
 
+/* Take another reference to a frame handed out by cam_take(), false if it isn't one or has already been fully given back */
+bool cam_ref(camera_fb_t *dma_buffer);
+
+/* Drop one reference, the frame is refilled after the last one */
 void cam_give(camera_fb_t *dma_buffer);
 
 void cam_give_all(void);
 
 bool cam_get_available_frames(void);
 
+/* Called by cam_task for every complete frame before it is queued, true if the callback took it */
+typedef bool (*cam_frame_cb_t)(camera_fb_t *fb, void *arg);
+
+void cam_set_frame_cb(cam_frame_cb_t cb, void *arg);
+
+void cam_set_slice_cb(camera_slice_cb_t cb, void *arg);
+
+void cam_get_stats(camera_stats_t *stats);
+
+/* Largest JPEG frame the frame buffers can hold (with adaptive sizing, the most they can grow to), 0 if not in JPEG mode */
+size_t cam_get_jpeg_capacity(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,47 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Complete a baseline JPEG that was cut off inside its entropy-coded data
+ *
+ * The headers must be intact: SOI at offset 0, Huffman tables, a baseline SOF and the SOS header.
+ * The scan is Huffman-decoded (no IDCT) up to the last complete MCU, the remaining MCUs are
+ * written as "DC unchanged, end of block" and EOI is appended, so strict decoders accept the
+ * result. The missing part of the image repeats the last decoded colors.
+ * When the fill doesn't fit in cap, more trailing MCUs are dropped to make room.
+ *
+ * Only bytes from the cut point on are rewritten, and only once the fill is known to fit:
+ * on failure buf is left as it was.
+ *
+ * @param buf   JPEG data without EOI
+ * @param len   Number of valid bytes in buf
+ * @param cap   Size of buf
+ *
+ * @return New length including EOI, or 0 if the data can't be repaired
+ */
+size_t jpeg_repair_truncated(uint8_t *buf, size_t len, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,79 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JPEG_MARKER_SOI     0xD8
+#define JPEG_MARKER_EOI     0xD9
+
+/**
+ * @brief One marker found by jpeg_scan_markers()
+ */
+typedef struct {
+    uint32_t offset;    /*!< Offset of the 0xFF byte */
+    uint8_t code;       /*!< Byte following 0xFF */
+} jpeg_marker_t;
+
+/**
+ * @brief Find the first 0xFF byte, reading a 32-bit word at a time
+ *
+ * @return Pointer to the byte, or NULL if there is none in buf[0, len)
+ */
+const uint8_t *jpeg_scan_ff(const uint8_t *buf, size_t len);
+
+/**
+ * @brief Find the last 0xFF byte, reading a 32-bit word at a time
+ *
+ * @return Pointer to the byte, or NULL if there is none in buf[0, len)
+ */
+const uint8_t *jpeg_scan_ff_rev(const uint8_t *buf, size_t len);
+
+/**
+ * @brief Find the first "FF <code>" marker in buf[0, len)
+ *
+ * @return Offset of the 0xFF byte, or -1 if not found
+ */
+int32_t jpeg_scan_marker(const uint8_t *buf, size_t len, uint8_t code);
+
+/**
+ * @brief Find the last "FF <code>" marker in buf[0, len)
+ *
+ * @return Offset of the 0xFF byte, or -1 if not found
+ */
+int32_t jpeg_scan_marker_rev(const uint8_t *buf, size_t len, uint8_t code);
+
+/**
+ * @brief List every marker in buf[0, len), in order
+ *
+ * Byte stuffing (FF 00) and fill bytes (FF FF) are not markers. This is a raw scan:
+ * segment payloads are not skipped, so it is meant for validating frames, not parsing them.
+ *
+ * @param markers   Output array, may be NULL when only counting
+ * @param max       Capacity of markers
+ *
+ * @return Number of markers found, which can be larger than max
+ */
+size_t jpeg_scan_markers(const uint8_t *buf, size_t len, jpeg_marker_t *markers, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,60 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "esp_camera.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Set up the JPEG rate controller
+ *
+ * Starts a low-priority worker that writes the controller's decisions to the sensor,
+ * so rate_ctrl_update() never touches SCCB. Calling it again only resets the state.
+ *
+ * @param sensor            Sensor to adjust
+ *
+ * @param config            Rate control settings from camera_config_t
+ * @param quality           jpeg_quality currently programmed into the sensor
+ * @param framesize         Frame size currently programmed into the sensor, also the upper bound when stepping back up
+ * @param fb_capacity       Largest JPEG frame the frame buffers can hold, bounds the per-frame target. 0 if unknown
+ */
+void rate_ctrl_init(sensor_t *sensor, const camera_rate_ctrl_config_t *config, int quality, framesize_t framesize,
+                    size_t fb_capacity);
+
+/**
+ * @brief Disable the rate controller and wait for its worker to exit
+ */
+void rate_ctrl_deinit(void);
+
+/**
+ * @brief Feed one completed JPEG frame
+ *
+ * Only measures and decides, a needed sensor change is handed to the worker.
+ * Safe to call from cam_task: it doesn't block and doesn't touch SCCB.
+ *
+ * @param fb        Frame just taken from the driver
+ */
+void rate_ctrl_update(const camera_fb_t *fb);
+
+void rate_ctrl_set_target(size_t target_frame_bytes, uint32_t target_bytes_per_sec);
+
+void rate_ctrl_get_status(camera_rate_ctrl_status_t *status);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,410 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "rate_ctrl.h"
+
+static const char *TAG = "rate_ctrl";
+
+#define RATE_CTRL_DEFAULT_MIN_QUALITY   6
+#define RATE_CTRL_DEFAULT_MAX_QUALITY   40
+#define RATE_CTRL_DEFAULT_DEADBAND_PCT  15
+/* Frames to skip after a quality change: the sensor applies new tables a frame or two later */
+#define RATE_CTRL_SETTLE_QUALITY        3
+/* A frame size change also restarts the sensor pipeline and invalidates the size average */
+#define RATE_CTRL_SETTLE_FRAMESIZE      8
+/* Biggest quality step per decision, to avoid overshooting on scene changes */
+#define RATE_CTRL_MAX_STEP              4
+/* Frames averaged after settling before the next decision */
+#define RATE_CTRL_MIN_SAMPLES           4
+/* EWMA weight of a new sample is 1/(1 << RATE_CTRL_EWMA_SHIFT) */
+#define RATE_CTRL_EWMA_SHIFT            3
+/* Highest per-frame target as a share of the frame buffer, frames above the average must still fit */
+#define RATE_CTRL_MAX_FB_PCT            75
+/* The worker only writes sensor registers, a late change costs a frame or two at the old quality */
+#define RATE_CTRL_TASK_STACK            3072
+#define RATE_CTRL_TASK_PRIO             1
+
+typedef struct {
+    bool enabled;
+    size_t target_frame_bytes;
+    uint32_t target_bytes_per_sec;
+    size_t fb_capacity;             /* largest frame the frame buffers hold, 0 if unknown */
+    int min_quality;
+    int max_quality;
+    uint8_t deadband_pct;
+    bool adjust_framesize;
+
+    int quality;
+    framesize_t framesize;
+    framesize_t max_framesize;
+
+    uint32_t avg_frame_bytes;
+    uint32_t avg_interval_us;
+    int64_t last_frame_us;
+    uint8_t settle;
+    uint8_t samples;
+    uint32_t adjustments;
+
+    /* decided by rate_ctrl_update(), written to the sensor by the worker */
+    bool pending;
+    int pending_quality;
+    framesize_t pending_framesize;
+    uint32_t pending_avg;
+    uint32_t pending_target;
+} rate_ctrl_t;
+
+static rate_ctrl_t s_rc;
+static portMUX_TYPE s_rc_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static sensor_t *s_rc_sensor;
+static TaskHandle_t s_rc_task;
+static SemaphoreHandle_t s_rc_task_done;
+static volatile bool s_rc_task_stop;
+
+static uint32_t framesize_area(framesize_t size)
+{
+    return (uint32_t)resolution[size].width * resolution[size].height;
+}
+
+static bool framesize_landscape(framesize_t size)
+{
+    return resolution[size].width >= resolution[size].height;
+}
+
+/* Next smaller (down) or larger (up) frame size of the same orientation, or the current one if none */
+static framesize_t framesize_step(framesize_t cur, bool up, framesize_t limit)
+{
+    framesize_t best = cur;
+    uint32_t cur_area = framesize_area(cur);
+    for (int i = 0; i < FRAMESIZE_INVALID; i++) {
+        framesize_t fs = (framesize_t)i;
+        uint32_t area = framesize_area(fs);
+        if (framesize_landscape(fs) != framesize_landscape(cur)) {
+            continue;
+        }
+        if (up) {
+            if (area > cur_area && area <= framesize_area(limit) &&
+                (best == cur || area < framesize_area(best))) {
+                best = fs;
+            }
+        } else if (area < cur_area && (best == cur || area > framesize_area(best))) {
+            best = fs;
+        }
+    }
+    return best;
+}
+
+static uint32_t ewma(uint32_t avg, uint32_t sample)
+{
+    return (uint32_t)((int64_t)avg + (((int64_t)sample - (int64_t)avg) >> RATE_CTRL_EWMA_SHIFT));
+}
+
+/* Frames bigger than the frame buffer are dropped before the controller sees them, so a target
+ * close to the buffer size makes it read "under target" and raise the quality until frames overflow */
+static size_t max_target(size_t fb_capacity)
+{
+    return fb_capacity * RATE_CTRL_MAX_FB_PCT / 100;
+}
+
+static size_t clamp_target(size_t target, size_t fb_capacity)
+{
+    size_t max = max_target(fb_capacity);
+    if (max && target > max) {
+        ESP_LOGW(TAG, "target %u B/frame doesn't fit the %u B frame buffers, using %u",
+                 (unsigned) target, (unsigned) fb_capacity, (unsigned) max);
+        return max;
+    }
+    return target;
+}
+
+static void rate_ctrl_apply(void);
+
+static void rate_ctrl_task(void *arg)
+{
+    while (!s_rc_task_stop) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (!s_rc_task_stop) {
+            rate_ctrl_apply();
+        }
+    }
+    xSemaphoreGive(s_rc_task_done);
+    vTaskDelete(NULL);
+}
+
+static void rate_ctrl_task_stop(void)
+{
+    portENTER_CRITICAL(&s_rc_lock);
+    TaskHandle_t task = s_rc_task;
+    s_rc_task = NULL;
+    portEXIT_CRITICAL(&s_rc_lock);
+    if (!task) {
+        return;
+    }
+    /* wait for the worker, the sensor may be freed right after */
+    s_rc_task_stop = true;
+    xTaskNotifyGive(task);
+    xSemaphoreTake(s_rc_task_done, portMAX_DELAY);
+}
+
+void rate_ctrl_init(sensor_t *sensor, const camera_rate_ctrl_config_t *config, int quality, framesize_t framesize,
+                    size_t fb_capacity)
+{
+    rate_ctrl_t rc = {0};
+
+    rc.fb_capacity = fb_capacity;
+    rc.target_frame_bytes = clamp_target(config->target_frame_bytes, fb_capacity);
+    rc.target_bytes_per_sec = config->target_bytes_per_sec;
+    rc.enabled = rc.target_frame_bytes || rc.target_bytes_per_sec;
+    rc.min_quality = config->min_quality ? config->min_quality : RATE_CTRL_DEFAULT_MIN_QUALITY;
+    rc.max_quality = config->max_quality ? config->max_quality : RATE_CTRL_DEFAULT_MAX_QUALITY;
+    if (rc.max_quality < rc.min_quality) {
+        rc.max_quality = rc.min_quality;
+    }
+    rc.deadband_pct = config->deadband_pct ? config->deadband_pct : RATE_CTRL_DEFAULT_DEADBAND_PCT;
+    rc.adjust_framesize = config->adjust_framesize;
+    rc.quality = quality;
+    rc.framesize = framesize;
+    rc.max_framesize = framesize;
+
+    portENTER_CRITICAL(&s_rc_lock);
+    TaskHandle_t task = s_rc_task;
+    s_rc = rc;
+    portEXIT_CRITICAL(&s_rc_lock);
+
+    /* started even when disabled, esp_camera_rate_ctrl_set_target() may enable it later */
+    s_rc_sensor = sensor;
+    if (!task) {
+        if (!s_rc_task_done) {
+            s_rc_task_done = xSemaphoreCreateBinary();
+        }
+        s_rc_task_stop = false;
+        if (!s_rc_task_done ||
+            xTaskCreate(rate_ctrl_task, "rate_ctrl", RATE_CTRL_TASK_STACK, NULL, RATE_CTRL_TASK_PRIO, &task) != pdPASS) {
+            ESP_LOGE(TAG, "failed to start the worker, rate control disabled");
+            portENTER_CRITICAL(&s_rc_lock);
+            s_rc.enabled = false;
+            portEXIT_CRITICAL(&s_rc_lock);
+            return;
+        }
+        portENTER_CRITICAL(&s_rc_lock);
+        s_rc_task = task;
+        portEXIT_CRITICAL(&s_rc_lock);
+    }
+
+    if (rc.enabled) {
+        ESP_LOGI(TAG, "target %u B/frame, %u B/s, quality %d..%d, deadband %u%%",
+                 (unsigned) rc.target_frame_bytes, (unsigned) rc.target_bytes_per_sec,
+                 rc.min_quality, rc.max_quality, rc.deadband_pct);
+    }
+}
+
+void rate_ctrl_deinit(void)
+{
+    portENTER_CRITICAL(&s_rc_lock);
+    s_rc.enabled = false;
+    s_rc.pending = false;
+    portEXIT_CRITICAL(&s_rc_lock);
+    rate_ctrl_task_stop();
+}
+
+void rate_ctrl_set_target(size_t target_frame_bytes, uint32_t target_bytes_per_sec)
+{
+    portENTER_CRITICAL(&s_rc_lock);
+    size_t fb_capacity = s_rc.fb_capacity;
+    portEXIT_CRITICAL(&s_rc_lock);
+    target_frame_bytes = clamp_target(target_frame_bytes, fb_capacity);
+
+    portENTER_CRITICAL(&s_rc_lock);
+    s_rc.target_frame_bytes = target_frame_bytes;
+    s_rc.target_bytes_per_sec = target_bytes_per_sec;
+    s_rc.enabled = target_frame_bytes || target_bytes_per_sec;
+    portEXIT_CRITICAL(&s_rc_lock);
+}
+
+/* Per-frame target in bytes, 0 while the frame rate is still unknown in throughput mode */
+static uint32_t current_target(const rate_ctrl_t *rc)
+{
+    if (rc->target_frame_bytes) {
+        return rc->target_frame_bytes;
+    }
+    if (!rc->avg_interval_us) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)rc->target_bytes_per_sec * rc->avg_interval_us / 1000000;
+    /* a throughput target at a low frame rate must not ask for frames that don't fit either */
+    size_t max = max_target(rc->fb_capacity);
+    if (max && target > max) {
+        target = max;
+    }
+    return (uint32_t)target;
+}
+
+void rate_ctrl_get_status(camera_rate_ctrl_status_t *status)
+{
+    portENTER_CRITICAL(&s_rc_lock);
+    rate_ctrl_t rc = s_rc;
+    portEXIT_CRITICAL(&s_rc_lock);
+
+    memset(status, 0, sizeof(*status));
+    status->enabled = rc.enabled;
+    status->target_frame_bytes = current_target(&rc);
+    status->target_bytes_per_sec = rc.target_bytes_per_sec;
+    status->frame_bytes = rc.avg_frame_bytes;
+    if (rc.avg_interval_us) {
+        status->bytes_per_sec = (uint32_t)((uint64_t)rc.avg_frame_bytes * 1000000 / rc.avg_interval_us);
+        status->fps_x100 = 100000000 / rc.avg_interval_us;
+    }
+    status->quality = rc.quality;
+    status->framesize = rc.framesize;
+    status->adjustments = rc.adjustments;
+}
+
+void rate_ctrl_update(const camera_fb_t *fb)
+{
+    if (!s_rc.enabled || fb->format != PIXFORMAT_JPEG) {
+        return;
+    }
+
+    /* Only arithmetic in here, it runs in cam_task and under the lock so the worker sees a consistent state */
+    portENTER_CRITICAL(&s_rc_lock);
+    rate_ctrl_t *rc = &s_rc;
+    TaskHandle_t task = s_rc_task;
+    bool notify = false;
+
+    /* Measure: EWMA of frame size and frame interval */
+    int64_t now = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    if (rc->last_frame_us && now > rc->last_frame_us) {
+        uint32_t interval = (uint32_t)(now - rc->last_frame_us);
+        rc->avg_interval_us = rc->avg_interval_us ? ewma(rc->avg_interval_us, interval) : interval;
+    }
+    rc->last_frame_us = now;
+
+    if (!rc->enabled || rc->pending || !task) {
+        goto out;
+    }
+    if (rc->settle) {
+        /* Frames still encoded with the previous settings, keep them out of the average */
+        rc->settle--;
+        goto out;
+    }
+    rc->avg_frame_bytes = rc->samples ? ewma(rc->avg_frame_bytes, fb->len) : fb->len;
+    if (rc->samples < RATE_CTRL_MIN_SAMPLES) {
+        rc->samples++;
+        goto out;
+    }
+
+    uint32_t target = current_target(rc);
+    if (!target) {
+        goto out;
+    }
+
+    /* Decide: act only outside the deadband so small fluctuations don't make it oscillate */
+    uint32_t pct = (uint32_t)((uint64_t)rc->avg_frame_bytes * 100 / target);
+    int quality = rc->quality;
+    framesize_t framesize = rc->framesize;
+
+    if (pct > 100u + rc->deadband_pct) {
+        if (rc->quality < rc->max_quality) {
+            int step = 1 + (int)(pct - 100) / 25;
+            if (step > RATE_CTRL_MAX_STEP) {
+                step = RATE_CTRL_MAX_STEP;
+            }
+            quality = rc->quality + step;
+            if (quality > rc->max_quality) {
+                quality = rc->max_quality;
+            }
+        } else if (rc->adjust_framesize) {
+            framesize = framesize_step(rc->framesize, false, rc->max_framesize);
+        }
+    } else if (pct < 100u - rc->deadband_pct) {
+        framesize_t bigger = rc->adjust_framesize ? framesize_step(rc->framesize, true, rc->max_framesize) : rc->framesize;
+        /* Go back up in size only when the predicted size at the larger resolution still fits */
+        uint64_t predicted = (uint64_t)rc->avg_frame_bytes * framesize_area(bigger) / framesize_area(rc->framesize);
+        if (bigger != rc->framesize && predicted * 100 < (uint64_t)target * (100u - rc->deadband_pct)) {
+            framesize = bigger;
+        } else if (rc->quality > rc->min_quality) {
+            quality = rc->quality - 1;
+        }
+    }
+
+    if (framesize != rc->framesize || quality != rc->quality) {
+        rc->pending = true;
+        rc->pending_quality = quality;
+        rc->pending_framesize = framesize;
+        rc->pending_avg = rc->avg_frame_bytes;
+        rc->pending_target = target;
+        notify = true;
+    }
+
+out:
+    portEXIT_CRITICAL(&s_rc_lock);
+    if (notify) {
+        /* SCCB writes take milliseconds and may block, leave them to the worker */
+        xTaskNotifyGive(task);
+    }
+}
+
+/* Apply: write the decided change to the sensor, called by the worker only */
+static void rate_ctrl_apply(void)
+{
+    sensor_t *sensor = s_rc_sensor;
+
+    portENTER_CRITICAL(&s_rc_lock);
+    rate_ctrl_t rc = s_rc;
+    portEXIT_CRITICAL(&s_rc_lock);
+    if (!rc.pending) {
+        return;
+    }
+
+    bool applied = false;
+    uint8_t settle = 0;
+    if (rc.pending_framesize != rc.framesize) {
+        if (sensor->set_framesize(sensor, rc.pending_framesize) == 0) {
+            ESP_LOGI(TAG, "%u B/frame vs target %u: frame size %ux%u -> %ux%u",
+                     (unsigned) rc.pending_avg, (unsigned) rc.pending_target,
+                     resolution[rc.framesize].width, resolution[rc.framesize].height,
+                     resolution[rc.pending_framesize].width, resolution[rc.pending_framesize].height);
+            sensor->status.framesize = rc.pending_framesize;
+            settle = RATE_CTRL_SETTLE_FRAMESIZE;
+            applied = true;
+        }
+    } else if (sensor->set_quality(sensor, rc.pending_quality) == 0) {
+        ESP_LOGD(TAG, "%u B/frame vs target %u: quality %d -> %d",
+                 (unsigned) rc.pending_avg, (unsigned) rc.pending_target, rc.quality, rc.pending_quality);
+        settle = RATE_CTRL_SETTLE_QUALITY;
+        applied = true;
+    }
+
+    portENTER_CRITICAL(&s_rc_lock);
+    /* rate_ctrl_init() or rate_ctrl_deinit() may have reset the state meanwhile */
+    if (s_rc.pending) {
+        s_rc.pending = false;
+        if (applied) {
+            if (rc.pending_framesize != rc.framesize) {
+                s_rc.framesize = rc.pending_framesize;
+            } else {
+                s_rc.quality = rc.pending_quality;
+            }
+            s_rc.settle = settle;
+            s_rc.samples = 0;
+            s_rc.adjustments++;
+        }
+    }
+    portEXIT_CRITICAL(&s_rc_lock);
+}
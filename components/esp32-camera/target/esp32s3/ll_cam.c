@@ -533,20 +533,33 @@ bool ll_cam_dma_sizes(cam_obj_t *cam)
     return 1;
 }
 
+static size_t IRAM_ATTR ll_cam_yuv_to_grayscale(uint8_t *out, const uint8_t *in, size_t len)
+{
+    size_t end = len / 8;
+    for (size_t i = 0; i < end; ++i) {
+        out[0] = in[0];
+        out[1] = in[2];
+        out[2] = in[4];
+        out[3] = in[6];
+        out += 4;
+        in += 8;
+    }
+    return len / 2;
+}
+
 size_t IRAM_ATTR ll_cam_memcpy(cam_obj_t *cam, uint8_t *out, const uint8_t *in, size_t len)
 {
+    if (cam->decimate.factor > 1) {
+        /* YUV to Grayscale in place, then scale the lines down into the frame buffer */
+        if (cam->in_bytes_per_pixel == 2 && cam->fb_bytes_per_pixel == 1) {
+            len = ll_cam_yuv_to_grayscale((uint8_t *)in, in, len);
+        }
+        return cam_decimate_lines(&cam->decimate, out, in, len);
+    }
+
     // YUV to Grayscale
     if (cam->in_bytes_per_pixel == 2 && cam->fb_bytes_per_pixel == 1) {
-        size_t end = len / 8;
-        for (size_t i = 0; i < end; ++i) {
-            out[0] = in[0];
-            out[1] = in[2];
-            out[2] = in[4];
-            out[3] = in[6];
-            out += 4;
-            in += 8;
-        }
-        return len / 2;
+        return ll_cam_yuv_to_grayscale(out, in, len);
     }
 
     // just memcpy
@@ -0,0 +1,80 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Settings of the simulated sensor on the linux target
+ *
+ * On the linux target cam_hal runs on top of a simulated LCD_CAM: a task replays frames as the
+ * DMA half buffer EOF and VSYNC events the hardware would raise, so the camera task, its buffer
+ * handling and the frame queue run unchanged. There is no sensor and no SCCB, the host
+ * application drives the driver through cam_init(), cam_config(), cam_start() and cam_take().
+ *
+ * Events are timed against esp_timer but released at FreeRTOS tick granularity, events due
+ * within the same tick are raised back to back.
+ */
+typedef struct {
+    const char *const *files;   /*!< Frames replayed in order and then looped, one JPEG image or one raw frame per file.
+                                     Raw formats may leave this empty to get a synthetic pattern */
+    size_t file_count;          /*!< Number of entries in files */
+    uint32_t pclk_hz;           /*!< Bytes per second on the camera bus, 0 = the configured XCLK frequency */
+    uint32_t frame_interval_us; /*!< VSYNC to VSYNC time, 0 = transfer time plus vblank_us. Longer frames stretch it */
+    uint32_t vblank_us;         /*!< Gap between the last byte of a frame and the next VSYNC */
+    uint32_t jitter_us;         /*!< Every event is delayed by a random 0..jitter_us, without drifting the schedule */
+    uint32_t overflow_every;    /*!< Every Nth frame is sent at once with the scheduler suspended, so the camera task
+                                     is starved until the frame ends and its events overflow the event queue when the
+                                     frame needs more DMA buffers than it holds. 0 = never */
+    uint32_t seed;              /*!< Seed of the jitter generator */
+} ll_cam_sim_config_t;
+
+/**
+ * @brief What the simulated sensor did, see ll_cam_sim_get_stats()
+ */
+typedef struct {
+    uint32_t frames;            /*!< Frames sent on the simulated bus */
+    uint32_t vsync_events;      /*!< VSYNC events raised, VSYNC is masked while the driver waits for a free frame */
+    uint32_t eof_events;        /*!< DMA EOF events raised */
+    uint32_t bytes_dropped;     /*!< Bytes sent while DMA was stopped */
+    uint32_t stalls;            /*!< Frames sent with the camera task starved (overflow_every) */
+} ll_cam_sim_stats_t;
+
+/**
+ * @brief Set up the simulated sensor, call before cam_init()
+ *
+ * The file names are copied, the files are read by cam_init().
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if config is NULL
+ *      - ESP_ERR_NO_MEM if the file names can't be copied
+ */
+esp_err_t ll_cam_sim_set_config(const ll_cam_sim_config_t *config);
+
+/**
+ * @brief Read the counters of the simulated sensor, reset by cam_init()
+ */
+void ll_cam_sim_get_stats(ll_cam_sim_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
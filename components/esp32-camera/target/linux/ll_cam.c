@@ -0,0 +1,447 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "esp_timer.h"
+#include "ll_cam.h"
+#include "cam_hal.h"
+#include "ll_cam_sim.h"
+
+static const char *TAG = "linux ll_cam";
+
+/* The simulated bus task stands in for the interrupts, it runs just below cam_task */
+#define LL_CAM_SIM_TASK_PRIORITY    (configMAX_PRIORITIES - 3)
+#define LL_CAM_SIM_TASK_STACK       16384   /* a host thread, not a chip task */
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+} ll_cam_sim_frame_t;
+
+typedef struct {
+    ll_cam_sim_config_t config;
+    char **files;
+    ll_cam_sim_frame_t *frames;
+    size_t frame_count;
+    TaskHandle_t task;
+    uint32_t rand_state;
+
+    /* DMA and interrupt state, written by cam_task and read by the bus task */
+    atomic_bool vsync_en;
+    atomic_bool dma_running;
+    atomic_uint dma_starts;     /* bumped by ll_cam_start(), DMA restarts at the first descriptor */
+    atomic_int dma_frame;
+
+    struct {
+        atomic_uint frames;
+        atomic_uint vsync_events;
+        atomic_uint eof_events;
+        atomic_uint bytes_dropped;
+        atomic_uint stalls;
+    } stats;
+} ll_cam_sim_t;
+
+static ll_cam_sim_t s_sim;
+
+static void ll_cam_sim_free_files(void)
+{
+    if (s_sim.files) {
+        for (size_t i = 0; i < s_sim.config.file_count; i++) {
+            free(s_sim.files[i]);
+        }
+        free(s_sim.files);
+        s_sim.files = NULL;
+    }
+    s_sim.config.files = NULL;
+    s_sim.config.file_count = 0;
+}
+
+esp_err_t ll_cam_sim_set_config(const ll_cam_sim_config_t *config)
+{
+    CAM_CHECK(config != NULL, "config is NULL", ESP_ERR_INVALID_ARG);
+    ll_cam_sim_free_files();
+    s_sim.config = *config;
+    s_sim.config.files = NULL;
+    s_sim.config.file_count = 0;
+    if (config->file_count) {
+        s_sim.files = calloc(config->file_count, sizeof(char *));
+        CAM_CHECK(s_sim.files != NULL, "file list malloc failed", ESP_ERR_NO_MEM);
+        s_sim.config.file_count = config->file_count;
+        for (size_t i = 0; i < config->file_count; i++) {
+            s_sim.files[i] = strdup(config->files[i]);
+            if (!s_sim.files[i]) {
+                ll_cam_sim_free_files();
+                return ESP_ERR_NO_MEM;
+            }
+        }
+        s_sim.config.files = (const char *const *)s_sim.files;
+    }
+    return ESP_OK;
+}
+
+void ll_cam_sim_get_stats(ll_cam_sim_stats_t *stats)
+{
+    stats->frames = atomic_load(&s_sim.stats.frames);
+    stats->vsync_events = atomic_load(&s_sim.stats.vsync_events);
+    stats->eof_events = atomic_load(&s_sim.stats.eof_events);
+    stats->bytes_dropped = atomic_load(&s_sim.stats.bytes_dropped);
+    stats->stalls = atomic_load(&s_sim.stats.stalls);
+}
+
+static void ll_cam_sim_unload(void)
+{
+    for (size_t i = 0; i < s_sim.frame_count; i++) {
+        free(s_sim.frames[i].data);
+    }
+    free(s_sim.frames);
+    s_sim.frames = NULL;
+    s_sim.frame_count = 0;
+}
+
+static esp_err_t ll_cam_sim_load(void)
+{
+    ll_cam_sim_unload();
+    if (!s_sim.config.file_count) {
+        return ESP_OK;
+    }
+    s_sim.frames = calloc(s_sim.config.file_count, sizeof(ll_cam_sim_frame_t));
+    CAM_CHECK(s_sim.frames != NULL, "frame list malloc failed", ESP_ERR_NO_MEM);
+    for (size_t i = 0; i < s_sim.config.file_count; i++) {
+        const char *name = s_sim.config.files[i];
+        FILE *f = fopen(name, "rb");
+        CAM_CHECK_GOTO(f != NULL, name, err);
+        fseek(f, 0, SEEK_END);
+        long len = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        uint8_t *data = len > 0 ? malloc(len) : NULL;
+        size_t got = data ? fread(data, 1, len, f) : 0;
+        fclose(f);
+        if (!data || got != (size_t)len) {
+            free(data);
+            ESP_LOGE(TAG, "can't read %s", name);
+            goto err;
+        }
+        s_sim.frames[i].data = data;
+        s_sim.frames[i].len = len;
+        s_sim.frame_count = i + 1;
+    }
+    ESP_LOGI(TAG, "%u frames loaded", (unsigned) s_sim.frame_count);
+    return ESP_OK;
+
+err:
+    ll_cam_sim_unload();
+    return ESP_FAIL;
+}
+
+static uint32_t ll_cam_sim_rand(void)
+{
+    /* xorshift32, the state must not be 0 */
+    uint32_t x = s_sim.rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_sim.rand_state = x;
+    return x;
+}
+
+/* Sleep until the given esp_timer time, to the tick below it */
+static void ll_cam_sim_wait(int64_t until_us)
+{
+    int64_t now = esp_timer_get_time();
+    if (until_us > now) {
+        TickType_t ticks = (until_us - now) / (portTICK_PERIOD_MS * 1000);
+        if (ticks) {
+            vTaskDelay(ticks);
+        }
+    }
+}
+
+/* Raise an event like the ISRs do; a starved camera task is not switched to until the frame ends */
+static void ll_cam_sim_event(cam_obj_t *cam, cam_event_t event, bool stall)
+{
+    BaseType_t HPTaskAwoken = pdFALSE;
+    ll_cam_send_event(cam, event, &HPTaskAwoken);
+    if (HPTaskAwoken == pdTRUE && !stall) {
+        taskYIELD();
+    }
+}
+
+/* Bytes [offset, offset + len) of the frame as the sensor sends it */
+static void ll_cam_sim_fill(uint8_t *out, const ll_cam_sim_frame_t *frame, uint32_t frame_no, size_t offset, size_t len)
+{
+    if (!frame) {
+        for (size_t i = 0; i < len; i++) {
+            out[i] = (uint8_t)(offset + i + frame_no);
+        }
+        return;
+    }
+    /* raw frames shorter than the frame size repeat */
+    for (size_t i = 0; i < len; i++) {
+        out[i] = frame->data[(offset + i) % frame->len];
+    }
+}
+
+static void ll_cam_sim_task(void *arg)
+{
+    cam_obj_t *cam = (cam_obj_t *)arg;
+    const ll_cam_sim_config_t *config = &s_sim.config;
+    uint32_t pclk = config->pclk_hz ? config->pclk_hz : 20000000;
+    int64_t t = esp_timer_get_time();
+    uint32_t frame_no = 0;
+    unsigned dma_starts = atomic_load(&s_sim.dma_starts);
+    size_t chunk = 0;
+
+    while (1) {
+        const ll_cam_sim_frame_t *frame = s_sim.frame_count ? &s_sim.frames[frame_no % s_sim.frame_count] : NULL;
+        size_t frame_len = cam->jpeg_mode ? frame->len : cam->recv_size;
+        bool stall = config->overflow_every && (frame_no + 1) % config->overflow_every == 0;
+        int64_t frame_start = t;
+
+        /* VSYNC ends the previous frame and starts this one */
+        ll_cam_sim_wait(t + (config->jitter_us ? ll_cam_sim_rand() % (config->jitter_us + 1) : 0));
+        if (stall) {
+            /* no task switch until the frame is sent, a sleep or a tick would let the camera task run */
+            vTaskSuspendAll();
+            atomic_fetch_add(&s_sim.stats.stalls, 1);
+        }
+        if (atomic_load(&s_sim.vsync_en)) {
+            atomic_fetch_add(&s_sim.stats.vsync_events, 1);
+            ll_cam_sim_event(cam, CAM_VSYNC_EVENT, stall);
+        }
+
+        size_t half = cam->dma_half_buffer_size;
+        for (size_t sent = 0; sent < frame_len;) {
+            size_t len = frame_len - sent < half ? frame_len - sent : half;
+            t += (int64_t)len * 1000000 / pclk;
+            if (!stall) {
+                ll_cam_sim_wait(t + (config->jitter_us ? ll_cam_sim_rand() % (config->jitter_us + 1) : 0));
+            }
+
+            unsigned starts = atomic_load(&s_sim.dma_starts);
+            if (starts != dma_starts) {
+                dma_starts = starts;
+                chunk = 0;
+            }
+            if (!atomic_load(&s_sim.dma_running)) {
+                atomic_fetch_add(&s_sim.stats.bytes_dropped, len);
+                sent += len;
+                continue;
+            }
+            uint8_t *out;
+            if (cam->psram_mode) {
+                /* the descriptor chain over the frame buffer is circular */
+                out = cam->frames[atomic_load(&s_sim.dma_frame)].fb.buf + (chunk * half) % cam->dma_buffer_size;
+            } else {
+                out = cam->dma_buffer + (chunk % cam->dma_half_buffer_cnt) * half;
+            }
+            ll_cam_sim_fill(out, frame, frame_no, sent, len);
+            sent += len;
+            /* in_suc_eof fires on a full half buffer, a partial one is picked up at VSYNC; raw psram mode has no EOF */
+            if (len == half) {
+                chunk++;
+                if (cam->jpeg_mode || !cam->psram_mode) {
+                    atomic_fetch_add(&s_sim.stats.eof_events, 1);
+                    ll_cam_sim_event(cam, CAM_IN_SUC_EOF_EVENT, stall);
+                }
+            }
+        }
+        if (stall) {
+            /* let the camera task catch up with what piled up, the schedule catches up at the next VSYNC */
+            xTaskResumeAll();
+        }
+
+        atomic_fetch_add(&s_sim.stats.frames, 1);
+        frame_no++;
+        t += config->vblank_us;
+        if (t < frame_start + config->frame_interval_us) {
+            t = frame_start + config->frame_interval_us;
+        }
+    }
+}
+
+bool IRAM_ATTR ll_cam_stop(cam_obj_t *cam)
+{
+    atomic_store(&s_sim.dma_running, false);
+    return true;
+}
+
+bool ll_cam_start(cam_obj_t *cam, int frame_pos)
+{
+    atomic_store(&s_sim.dma_frame, frame_pos);
+    atomic_fetch_add(&s_sim.dma_starts, 1);
+    atomic_store(&s_sim.dma_running, true);
+    return true;
+}
+
+esp_err_t ll_cam_deinit(cam_obj_t *cam)
+{
+    atomic_store(&s_sim.vsync_en, false);
+    atomic_store(&s_sim.dma_running, false);
+    if (s_sim.task) {
+        vTaskDelete(s_sim.task);
+        s_sim.task = NULL;
+    }
+    ll_cam_sim_unload();
+    return ESP_OK;
+}
+
+esp_err_t ll_cam_config(cam_obj_t *cam, const camera_config_t *config)
+{
+    memset(&s_sim.stats, 0, sizeof(s_sim.stats));
+    atomic_store(&s_sim.vsync_en, false);
+    atomic_store(&s_sim.dma_running, false);
+    if (!s_sim.config.pclk_hz) {
+        s_sim.config.pclk_hz = config->xclk_freq_hz;
+    }
+    s_sim.rand_state = s_sim.config.seed ? s_sim.config.seed : 1;
+    return ll_cam_sim_load();
+}
+
+void ll_cam_vsync_intr_enable(cam_obj_t *cam, bool en)
+{
+    atomic_store(&s_sim.vsync_en, en);
+}
+
+esp_err_t ll_cam_set_pin(cam_obj_t *cam, const camera_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t ll_cam_init_isr(cam_obj_t *cam)
+{
+    CAM_CHECK(!cam->jpeg_mode || s_sim.frame_count, "JPEG needs frame files, see ll_cam_sim_set_config()", ESP_ERR_INVALID_STATE);
+    BaseType_t ret = xTaskCreate(ll_cam_sim_task, "cam_sim", LL_CAM_SIM_TASK_STACK, cam, LL_CAM_SIM_TASK_PRIORITY, &s_sim.task);
+    CAM_CHECK(ret == pdPASS, "simulated bus task create failed", ESP_ERR_NO_MEM);
+    return ESP_OK;
+}
+
+void ll_cam_do_vsync(cam_obj_t *cam)
+{
+    /* frames start on the VSYNC of the simulated bus */
+}
+
+uint8_t ll_cam_get_dma_align(cam_obj_t *cam)
+{
+    return 16;
+}
+
+/* Whole lines per half buffer with the height a multiple of them, like the LCD_CAM layout */
+static bool ll_cam_calc_rgb_dma(cam_obj_t *cam)
+{
+    size_t line_width = cam->width * cam->in_bytes_per_pixel;
+    size_t dma_half_buffer_max = CONFIG_CAMERA_DMA_BUFFER_SIZE_MAX / 2;
+    if (line_width > dma_half_buffer_max) {
+        ESP_LOGE(TAG, "Resolution too high");
+        return 0;
+    }
+    size_t lines_per_half_buffer = dma_half_buffer_max / line_width;
+    while (cam->height % lines_per_half_buffer) {
+        lines_per_half_buffer--;
+    }
+    cam->dma_half_buffer_size = lines_per_half_buffer * line_width;
+
+    size_t node_size = LCD_CAM_DMA_NODE_BUFFER_MAX_SIZE;
+    while (cam->dma_half_buffer_size % node_size) {
+        node_size--;
+    }
+    cam->dma_node_buffer_size = node_size;
+
+    if (cam->psram_mode) {
+        cam->dma_buffer_size = cam->recv_size;
+    } else {
+        cam->dma_buffer_size = (2 * dma_half_buffer_max / cam->dma_half_buffer_size) * cam->dma_half_buffer_size;
+    }
+    cam->dma_half_buffer_cnt = cam->dma_buffer_size / cam->dma_half_buffer_size;
+    return 1;
+}
+
+bool ll_cam_dma_sizes(cam_obj_t *cam)
+{
+    cam->dma_bytes_per_item = 1;
+    if (cam->jpeg_mode) {
+        if (cam->psram_mode) {
+            cam->dma_buffer_size = cam->recv_size;
+            cam->dma_half_buffer_size = 1024;
+            cam->dma_half_buffer_cnt = cam->dma_buffer_size / cam->dma_half_buffer_size;
+            cam->dma_node_buffer_size = cam->dma_half_buffer_size;
+        } else {
+            cam->dma_half_buffer_cnt = 16;
+            cam->dma_buffer_size = cam->dma_half_buffer_cnt * 1024;
+            cam->dma_half_buffer_size = cam->dma_buffer_size / cam->dma_half_buffer_cnt;
+            cam->dma_node_buffer_size = cam->dma_half_buffer_size;
+        }
+    } else {
+        return ll_cam_calc_rgb_dma(cam);
+    }
+    return 1;
+}
+
+static size_t IRAM_ATTR ll_cam_yuv_to_grayscale(uint8_t *out, const uint8_t *in, size_t len)
+{
+    size_t end = len / 8;
+    for (size_t i = 0; i < end; ++i) {
+        out[0] = in[0];
+        out[1] = in[2];
+        out[2] = in[4];
+        out[3] = in[6];
+        out += 4;
+        in += 8;
+    }
+    return len / 2;
+}
+
+size_t IRAM_ATTR ll_cam_memcpy(cam_obj_t *cam, uint8_t *out, const uint8_t *in, size_t len)
+{
+    if (cam->decimate.factor > 1) {
+        /* YUV to Grayscale in place, then scale the lines down into the frame buffer */
+        if (cam->in_bytes_per_pixel == 2 && cam->fb_bytes_per_pixel == 1) {
+            len = ll_cam_yuv_to_grayscale((uint8_t *)in, in, len);
+        }
+        return cam_decimate_lines(&cam->decimate, out, in, len);
+    }
+
+    // YUV to Grayscale
+    if (cam->in_bytes_per_pixel == 2 && cam->fb_bytes_per_pixel == 1) {
+        return ll_cam_yuv_to_grayscale(out, in, len);
+    }
+
+    // just memcpy
+    memcpy(out, in, len);
+    return len;
+}
+
+esp_err_t ll_cam_set_sample_mode(cam_obj_t *cam, pixformat_t pix_format, uint32_t xclk_freq_hz, uint16_t sensor_pid)
+{
+    if (pix_format == PIXFORMAT_GRAYSCALE) {
+        if (sensor_pid == OV3660_PID || sensor_pid == OV5640_PID || sensor_pid == NT99141_PID || sensor_pid == SC031GS_PID || sensor_pid == BF20A6_PID || sensor_pid == GC0308_PID || sensor_pid == HM0360_PID) {
+            cam->in_bytes_per_pixel = 1;       // camera sends Y8
+        } else {
+            cam->in_bytes_per_pixel = 2;       // camera sends YU/YV
+        }
+        cam->fb_bytes_per_pixel = 1;       // frame buffer stores Y8
+    } else if (pix_format == PIXFORMAT_YUV422 || pix_format == PIXFORMAT_RGB565) {
+        cam->in_bytes_per_pixel = 2;       // for DMA receive
+        cam->fb_bytes_per_pixel = 2;       // frame buffer stores YU/YV/RGB565
+    } else if (pix_format == PIXFORMAT_JPEG) {
+        cam->in_bytes_per_pixel = 1;
+        cam->fb_bytes_per_pixel = 1;
+    } else {
+        ESP_LOGE(TAG, "Requested format is not supported");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return ESP_OK;
+}
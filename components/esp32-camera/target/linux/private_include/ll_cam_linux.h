@@ -0,0 +1,43 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include "esp_attr.h"
+
+/* What cam_hal needs from the ROM and the interrupt allocator of the chips */
+
+typedef struct lldesc_s {
+    volatile uint32_t size  : 12,
+             length: 12,
+             offset: 5,
+             sosf  : 1,
+             eof   : 1,
+             owner : 1;
+    volatile const uint8_t *buf;
+    union {
+        volatile uint32_t empty;
+        struct lldesc_s *qe;
+    };
+} lldesc_t;
+
+typedef void *intr_handle_t;
+
+#define ets_printf printf
+
+#ifndef DRAM_STR
+#define DRAM_STR(str) (str)
+#endif
@@ -15,6 +15,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdatomic.h>
 #include "sdkconfig.h"
 #include "esp_idf_version.h"
 #if CONFIG_IDF_TARGET_ESP32
@@ -27,9 +28,12 @@
 #include "esp32s2/rom/lldesc.h"
 #elif CONFIG_IDF_TARGET_ESP32S3
 #include "esp32s3/rom/lldesc.h"
+#elif CONFIG_IDF_TARGET_LINUX
+#include "ll_cam_linux.h"
 #endif
 #include "esp_log.h"
 #include "esp_camera.h"
+#include "cam_decimate.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
@@ -77,7 +81,9 @@
 
 typedef enum {
     CAM_IN_SUC_EOF_EVENT = 0,
-    CAM_VSYNC_EVENT
+    CAM_VSYNC_EVENT,
+    CAM_FB_FREE_EVENT,  // a frame buffer was returned while cam_task had none to fill
+    CAM_PAUSE_EVENT,    // capture was stopped for cam_reconfig(), drop the frame in progress and report back
 } cam_event_t;
 
 typedef enum {
@@ -87,10 +93,11 @@ typedef enum {
 
 typedef struct {
     camera_fb_t fb;
-    uint8_t en;
+    atomic_uint refs;   // holders of a queued or taken frame, the frame is refilled when it drops to 0
     //for RGB/YUV modes
     lldesc_t *dma;
     size_t fb_offset;
+    size_t buf_size;    // usable bytes at fb.buf, can differ between frames with adaptive JPEG buffers
 } cam_frame_t;
 
 typedef struct {
@@ -107,6 +114,10 @@ typedef struct {
     uint8_t  *dma_buffer;
 
     cam_frame_t *frames;
+    atomic_uint frames_free;    // bit x set: frames[x] is not owned by the consumer or the frame queue
+    atomic_bool frame_wait;     // cam_task ran out of frames and paused VSYNC until one is returned
+    volatile bool started;
+    SemaphoreHandle_t pause_done;   // given by cam_task after handling CAM_PAUSE_EVENT
 
     QueueHandle_t event_queue;
     QueueHandle_t frame_buffer_queue;
@@ -139,6 +150,8 @@ typedef struct {
     uint8_t fb_bytes_per_pixel;
 #endif
     uint32_t fb_size;
+    uint32_t fb_caps;
+    cam_decimate_t decimate;    // raw frames are scaled down in ll_cam_memcpy() when decimate.factor > 1
 
     cam_state_t state;
 } cam_obj_t;
@@ -0,0 +1,160 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_attr.h"
+
+/*
+ * Sample filters of the ESP32 I2S camera mode: every 32-bit word of the DMA buffer carries
+ * one or two camera bytes, the filters gather them into the frame buffer.
+ *
+ * They are plain C with no hardware access, so they can be tested on any target.
+ * The DMA buffer (src) is word aligned; dst can have any alignment. The words are read
+ * whole and the samples are packed four to a 32-bit store, with byte stores only to
+ * align dst and for the tail.
+ *
+ * dst can also be src: the output never gets ahead of the words still to be read, so the
+ * samples can be gathered in place in the DMA buffer (see ll_cam_memcpy() of the esp32 target).
+ */
+
+typedef union {
+    struct {
+        uint32_t sample2:8;
+        uint32_t unused2:8;
+        uint32_t sample1:8;
+        uint32_t unused1:8;
+    };
+    uint32_t val;
+} dma_elem_t;
+
+typedef size_t (*dma_filter_t)(uint8_t* dst, const uint8_t* src, size_t len);
+
+#define LL_CAM_DMA_S1(w)    ((uint8_t)((w) >> 16))
+#define LL_CAM_DMA_S2(w)    ((uint8_t)(w))
+
+/* dst[i] = sample1 of in[i * stride], for i < count */
+static inline IRAM_ATTR uint8_t *ll_cam_dma_pack_sample1(uint8_t *dst, const uint32_t *in, size_t count, size_t stride)
+{
+    while (count && ((uintptr_t)dst & 3)) {
+        *dst++ = LL_CAM_DMA_S1(in[0]);
+        in += stride;
+        count--;
+    }
+    uint32_t *out = (uint32_t *)dst;
+    for (; count >= 4; count -= 4) {
+        *out++ = ((in[0] >> 16) & 0x000000FF)
+               | ((in[stride] >> 8) & 0x0000FF00)
+               | (in[2 * stride] & 0x00FF0000)
+               | ((in[3 * stride] << 8) & 0xFF000000);
+        in += 4 * stride;
+    }
+    dst = (uint8_t *)out;
+    while (count--) {
+        *dst++ = LL_CAM_DMA_S1(in[0]);
+        in += stride;
+    }
+    return dst;
+}
+
+/* sample1 of every word */
+static inline size_t IRAM_ATTR ll_cam_dma_filter_jpeg(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    size_t elements = len / sizeof(dma_elem_t);
+    ll_cam_dma_pack_sample1(dst, (const uint32_t *)src, elements, 1);
+    return elements;
+}
+
+/* the Y bytes of YUYV sent as 0A0B_0C0D */
+static inline size_t IRAM_ATTR ll_cam_dma_filter_grayscale(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    size_t elements = len / sizeof(dma_elem_t);
+    ll_cam_dma_pack_sample1(dst, (const uint32_t *)src, elements, 1);
+    return elements;
+}
+
+/* sample1 of every other word, YUYV sent as 0A00_0B00 */
+static inline size_t IRAM_ATTR ll_cam_dma_filter_grayscale_highspeed(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const uint32_t *in = (const uint32_t *)src;
+    size_t elements = len / sizeof(dma_elem_t);
+    size_t end = elements / 8;
+    dst = ll_cam_dma_pack_sample1(dst, in, end * 4, 2);
+    // the final sample of a line in SM_0A0B_0B0C sampling mode needs special handling
+    if ((elements & 0x7) != 0) {
+        in += end * 8;
+        dst[0] = LL_CAM_DMA_S1(in[0]);
+        dst[1] = LL_CAM_DMA_S1(in[2]);
+        elements += 1;
+    }
+    return elements / 2;
+}
+
+/* sample1 and sample2 of every word, YUYV sent as 0A0B_0C0D */
+static inline size_t IRAM_ATTR ll_cam_dma_filter_yuyv(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const uint32_t *in = (const uint32_t *)src;
+    size_t elements = len / sizeof(dma_elem_t);
+    size_t count = elements;
+    if ((uintptr_t)dst & 1) {
+        /* the samples come in pairs, dst never gets aligned */
+        for (; count; count--, in++) {
+            *dst++ = LL_CAM_DMA_S1(in[0]);
+            *dst++ = LL_CAM_DMA_S2(in[0]);
+        }
+        return elements * 2;
+    }
+    if (count && ((uintptr_t)dst & 2)) {
+        *dst++ = LL_CAM_DMA_S1(in[0]);
+        *dst++ = LL_CAM_DMA_S2(in[0]);
+        in++;
+        count--;
+    }
+    uint32_t *out = (uint32_t *)dst;
+    for (; count >= 2; count -= 2) {
+        *out++ = ((in[0] >> 16) & 0x000000FF)
+               | ((in[0] << 8) & 0x0000FF00)
+               | (in[1] & 0x00FF0000)
+               | (in[1] << 24);
+        in += 2;
+    }
+    if (count) {
+        /* read the word first, in place dst[0] is one of its bytes when it is the only one */
+        uint32_t w = in[0];
+        dst = (uint8_t *)out;
+        dst[0] = LL_CAM_DMA_S1(w);
+        dst[1] = LL_CAM_DMA_S2(w);
+    }
+    return elements * 2;
+}
+
+/* sample1 of every word, YUYV sent as 0A00_0B00 or 0A0B_0B0C */
+static inline size_t IRAM_ATTR ll_cam_dma_filter_yuyv_highspeed(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const uint32_t *in = (const uint32_t *)src;
+    size_t elements = len / sizeof(dma_elem_t);
+    size_t end = elements / 8;
+    dst = ll_cam_dma_pack_sample1(dst, in, end * 8, 1);
+    if ((elements & 0x7) != 0) {
+        in += end * 8;
+        dst[0] = LL_CAM_DMA_S1(in[0]);//y0
+        dst[1] = LL_CAM_DMA_S1(in[1]);//u
+        dst[2] = LL_CAM_DMA_S1(in[2]);//y1
+        dst[3] = LL_CAM_DMA_S2(in[2]);//v
+        elements += 4;
+    }
+    return elements;
+}
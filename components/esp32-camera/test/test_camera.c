@@ -341,6 +341,43 @@ TEST_CASE("Camera driver take JPEG picture test", "[camera]")
     TEST_ASSERT_NOT_NULL(pic);
 }
 
+TEST_CASE("Camera driver reconfigure test", "[camera]")
+{
+    static const struct {
+        framesize_t frame_size;
+        pixformat_t pix_format;
+    } modes[] = {
+        {FRAMESIZE_VGA, PIXFORMAT_JPEG},
+        {FRAMESIZE_QVGA, PIXFORMAT_RGB565},
+        {FRAMESIZE_QVGA, PIXFORMAT_JPEG},
+    };
+    camera_stats_t stats;
+
+    TEST_ESP_OK(init_camera(20000000, PIXFORMAT_JPEG, FRAMESIZE_QVGA, 2, SIOD_GPIO_NUM, -1));
+    vTaskDelay(500 / portTICK_RATE_MS);
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        TEST_ESP_OK(esp_camera_reconfigure(modes[i].frame_size, modes[i].pix_format, 0));
+        TEST_ESP_OK(esp_camera_get_stats(&stats));
+        ESP_LOGI(TAG, "%s %ux%u: switch took %u us", get_cam_format_name(modes[i].pix_format),
+                 resolution[modes[i].frame_size].width, resolution[modes[i].frame_size].height, (unsigned) stats.reconfig_us);
+        TEST_ASSERT_LESS_THAN_UINT32(1000000, stats.reconfig_us);
+
+        /* the first frames after a switch may still be in the old mode */
+        camera_fb_t *pic = NULL;
+        for (int n = 0; n < 4; n++) {
+            pic = esp_camera_fb_get();
+            TEST_ASSERT_NOT_NULL(pic);
+            if (n < 3) {
+                esp_camera_fb_return(pic);
+            }
+        }
+        TEST_ASSERT_EQUAL(resolution[modes[i].frame_size].width, pic->width);
+        TEST_ASSERT_EQUAL(modes[i].pix_format, pic->format);
+        esp_camera_fb_return(pic);
+    }
+    TEST_ESP_OK(esp_camera_deinit());
+}
+
 TEST_CASE("Camera driver performance test", "[camera]")
 {
     camera_performance_test(20 * 1000000, 16);
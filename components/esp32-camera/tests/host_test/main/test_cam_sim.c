@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "unity.h"
+#include "esp_camera.h"
+#include "cam_hal.h"
+#include "ll_cam_sim.h"
+#include "test_common.h"
+
+/* cam_hal on top of the simulated bus of target/linux, replaying the pictures in test/pictures */
+
+#define SIM_TAKE_TIMEOUT    pdMS_TO_TICKS(1000)
+
+static const char *s_files[TEST_PICTURE_COUNT];
+
+static void sim_start(uint32_t overflow_every)
+{
+    for (int n = 0; n < TEST_PICTURE_COUNT; n++) {
+        s_files[n] = test_picture(n)->path;
+    }
+    ll_cam_sim_config_t sim = {
+        .files = s_files,
+        .file_count = TEST_PICTURE_COUNT,
+        .frame_interval_us = 10000,
+        .overflow_every = overflow_every,
+    };
+    /* SVGA makes the automatic JPEG buffer (width * height / 5) big enough for every picture */
+    camera_config_t config = {
+        .xclk_freq_hz = 20000000,
+        .pixel_format = PIXFORMAT_JPEG,
+        .frame_size = FRAMESIZE_SVGA,
+        .fb_count = 3,
+        .fb_location = CAMERA_FB_IN_DRAM,
+        .grab_mode = CAMERA_GRAB_WHEN_EMPTY,
+    };
+    TEST_ESP_OK(ll_cam_sim_set_config(&sim));
+    TEST_ESP_OK(cam_init(&config));
+    TEST_ESP_OK(cam_config(&config, config.frame_size, 0));
+    cam_start();
+}
+
+/* Index of the picture the frame is a copy of, -1 if it is none of them */
+static int sim_match(const camera_fb_t *fb)
+{
+    for (int n = 0; n < TEST_PICTURE_COUNT; n++) {
+        const test_picture_t *pic = test_picture(n);
+        if (fb->len == pic->len && memcmp(fb->buf, pic->buf, pic->len) == 0) {
+            return n;
+        }
+    }
+    return -1;
+}
+
+/* Take 'count' frames, each must be one of the pictures, byte for byte */
+static void sim_take(int count, int matches[TEST_PICTURE_COUNT])
+{
+    uint32_t seq = 0;
+    memset(matches, 0, TEST_PICTURE_COUNT * sizeof(int));
+    for (int i = 0; i < count; i++) {
+        camera_fb_t *fb = cam_take(SIM_TAKE_TIMEOUT);
+        TEST_ASSERT_NOT_NULL(fb);
+        TEST_ASSERT_GREATER_THAN(seq, fb->seq);
+        seq = fb->seq;
+        int n = sim_match(fb);
+        TEST_ASSERT_GREATER_OR_EQUAL(0, n);
+        matches[n]++;
+        cam_give(fb);
+    }
+}
+
+/* Stop capture and check that every started frame was either delivered or dropped for one reason */
+static void sim_stop(camera_stats_t *stats, ll_cam_sim_stats_t *sim_stats)
+{
+    cam_stop();
+    cam_get_stats(stats);
+    uint32_t ended = stats->frames_delivered + stats->fb_overflow + stats->no_soi + stats->no_eoi
+                     + stats->bad_size + stats->event_overflow + stats->queue_dropped;
+    printf("started %u, delivered %u, no_soi %u, no_eoi %u, event_overflow %u, no_free_fb %u\n",
+           (unsigned) stats->frames_started, (unsigned) stats->frames_delivered, (unsigned) stats->no_soi,
+           (unsigned) stats->no_eoi, (unsigned) stats->event_overflow, (unsigned) stats->no_free_fb);
+    /* the frame in progress when capture stopped is neither */
+    TEST_ASSERT_LESS_OR_EQUAL(stats->frames_started, ended);
+    TEST_ASSERT_LESS_OR_EQUAL(ended + 1, stats->frames_started);
+
+    /* the simulated bus is stopped with the driver, its counters stay until the next cam_init() */
+    TEST_ESP_OK(cam_deinit());
+    ll_cam_sim_get_stats(sim_stats);
+    printf("sim: frames %u, vsync %u, eof %u, dropped %u bytes, stalls %u\n",
+           (unsigned) sim_stats->frames, (unsigned) sim_stats->vsync_events, (unsigned) sim_stats->eof_events,
+           (unsigned) sim_stats->bytes_dropped, (unsigned) sim_stats->stalls);
+    /* every frame starts on a VSYNC the bus raised */
+    TEST_ASSERT_LESS_OR_EQUAL(sim_stats->vsync_events, stats->frames_started);
+    TEST_ASSERT_LESS_OR_EQUAL(sim_stats->frames + 1, stats->frames_started);
+}
+
+TEST_CASE("Simulated camera replays the test pictures", "[cam_sim]")
+{
+    const int count = 30;
+    int matches[TEST_PICTURE_COUNT];
+    camera_stats_t stats;
+    ll_cam_sim_stats_t sim_stats;
+
+    sim_start(0);
+    sim_take(count, matches);
+    sim_stop(&stats, &sim_stats);
+
+    /* the pictures come back in turn, nothing is lost while the frames are returned in time */
+    for (int n = 0; n < TEST_PICTURE_COUNT; n++) {
+        TEST_ASSERT_GREATER_THAN(0, matches[n]);
+    }
+    TEST_ASSERT_GREATER_OR_EQUAL(count, stats.frames_delivered);
+    TEST_ASSERT_EQUAL(0, stats.event_overflow);
+    TEST_ASSERT_EQUAL(0, stats.fb_overflow);
+    TEST_ASSERT_EQUAL(0, stats.no_soi);
+    TEST_ASSERT_EQUAL(0, stats.no_eoi);
+    TEST_ASSERT_EQUAL(0, stats.queue_dropped);
+    TEST_ASSERT_EQUAL(0, sim_stats.stalls);
+    /* the bus sent at least what was delivered, in 1 KB DMA half buffers */
+    TEST_ASSERT_GREATER_OR_EQUAL(stats.frames_delivered, sim_stats.frames);
+    TEST_ASSERT_GREATER_THAN(0, sim_stats.eof_events);
+}
+
+TEST_CASE("Simulated camera event queue overflow", "[cam_sim]")
+{
+    const uint32_t overflow_every = 3;
+    const int count = 10;
+    int matches[TEST_PICTURE_COUNT];
+    camera_stats_t stats;
+    ll_cam_sim_stats_t sim_stats;
+
+    /* every third frame is test_outside.jpeg, 80 DMA buffers against an event queue of 15 */
+    sim_start(overflow_every);
+    sim_take(count, matches);
+    sim_stop(&stats, &sim_stats);
+
+    /* a stall is counted when its frame starts, a frame when it ends */
+    TEST_ASSERT_TRUE(sim_stats.stalls == sim_stats.frames / overflow_every
+                     || sim_stats.stalls == (sim_stats.frames + 1) / overflow_every);
+    TEST_ASSERT_GREATER_OR_EQUAL(count / 2, sim_stats.stalls);
+    /* each stalled frame overflows the queue once and is cut off, the rest of it is sent with DMA stopped;
+     * the last stall may have come after cam_stop() */
+    TEST_ASSERT_LESS_OR_EQUAL(sim_stats.stalls, stats.event_overflow);
+    TEST_ASSERT_GREATER_OR_EQUAL(sim_stats.stalls - 1, stats.event_overflow);
+    TEST_ASSERT_GREATER_THAN(0, sim_stats.bytes_dropped);
+    /* nothing broken is delivered: the stalled pictures never come through, the others still do */
+    TEST_ASSERT_EQUAL(0, matches[2]);
+    TEST_ASSERT_GREATER_THAN(0, matches[0]);
+}
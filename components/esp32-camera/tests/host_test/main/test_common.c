@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "unity.h"
+#include "test_common.h"
+
+static test_picture_t s_pictures[TEST_PICTURE_COUNT] = {
+    {.path = TEST_PICTURES_DIR "/testimg.jpeg",      .width = 227, .height = 149},
+    {.path = TEST_PICTURES_DIR "/test_inside.jpeg",  .width = 320, .height = 240},
+    {.path = TEST_PICTURES_DIR "/test_outside.jpeg", .width = 480, .height = 320},
+};
+
+const test_picture_t *test_picture(int n)
+{
+    test_picture_t *pic = &s_pictures[n];
+    if (pic->buf) {
+        return pic;
+    }
+    FILE *f = fopen(pic->path, "rb");
+    TEST_ASSERT_NOT_NULL(f);
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = len > 0 ? malloc(len) : NULL;
+    size_t got = buf ? fread(buf, 1, len, f) : 0;
+    fclose(f);
+    TEST_ASSERT_NOT_NULL(buf);
+    TEST_ASSERT_EQUAL(len, got);
+    /* kept for the whole run, like the pictures the on-target suite embeds */
+    pic->buf = buf;
+    pic->len = len;
+    return pic;
+}
+
+int64_t test_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+float test_mbps(size_t len, uint32_t times, int64_t us)
+{
+    return us ? (float)len * times / us : 0;
+}
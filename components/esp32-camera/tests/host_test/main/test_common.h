@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The JPEG pictures of test/pictures, shared by the test cases */
+#define TEST_PICTURE_COUNT 3
+
+typedef struct {
+    const char *path;
+    const uint8_t *buf;
+    size_t len;
+    uint16_t width;
+    uint16_t height;
+} test_picture_t;
+
+/**
+ * @brief Picture n, read from disk on first use, fails the test if it can't be read
+ */
+const test_picture_t *test_picture(int n);
+
+/**
+ * @brief Monotonic time for the benchmarks
+ */
+int64_t test_time_us(void);
+
+/**
+ * @brief Throughput of 'times' runs over 'len' bytes that took 'us' in total
+ */
+float test_mbps(size_t len, uint32_t times, int64_t us);
+
+/**
+ * @brief Next value of a fixed-seed LCG, so failures can be reproduced
+ */
+static inline uint32_t test_rand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed;
+}
@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_camera.h"
+#include "cam_decimate.h"
+#include "ll_cam_dma_filter.h"
+#include "test_common.h"
+
+/* Per-pixel decimation straight from the definition in camera_decimate_t, the reference for cam_decimate */
+static void ref_decimate(uint8_t *out, const uint8_t *in, pixformat_t format, int width, int height, int f, bool average)
+{
+    int bpp = format == PIXFORMAT_GRAYSCALE ? 1 : 2;
+    int n = average ? f : 1;
+    for (int y = 0; y < height / f; y++) {
+        for (int x = 0; x < width / f; x++) {
+            for (int c = 0; c < bpp; c++) {
+                int sum = 0;
+                for (int dy = 0; dy < n; dy++) {
+                    const uint8_t *line = in + (y * f + dy) * width * bpp;
+                    for (int dx = 0; dx < n; dx++) {
+                        if (format == PIXFORMAT_YUV422 && c == 1) {
+                            /* U of even output pixels, V of odd ones, from the pairs at the start of the block */
+                            sum += line[4 * ((x / 2) * f + dx) + (x & 1 ? 3 : 1)];
+                        } else {
+                            sum += line[(x * f + dx) * bpp + c];
+                        }
+                    }
+                }
+                *out++ = (sum + n * n / 2) / (n * n);
+            }
+        }
+    }
+}
+
+static const pixformat_t s_formats[] = {PIXFORMAT_GRAYSCALE, PIXFORMAT_YUV422, PIXFORMAT_RGB565};
+static const camera_decimate_t s_modes[] = {CAMERA_DECIMATE_2X, CAMERA_DECIMATE_4X,
+                                            CAMERA_DECIMATE_2X_AVERAGE, CAMERA_DECIMATE_4X_AVERAGE};
+
+#define DECIMATE_WIDTH      96
+#define DECIMATE_HEIGHT     48
+#define DECIMATE_FRAME_SIZE (DECIMATE_WIDTH * DECIMATE_HEIGHT * 2)
+
+static uint8_t *decimate_frame(uint32_t *seed)
+{
+    uint8_t *in = malloc(DECIMATE_FRAME_SIZE);
+    TEST_ASSERT_NOT_NULL(in);
+    for (size_t i = 0; i < DECIMATE_FRAME_SIZE; i++) {
+        in[i] = test_rand(seed) >> 16;
+    }
+    return in;
+}
+
+/* Whole lines in a chunk of random size, like DMA half buffers */
+static size_t decimate_chunk(size_t line_size, size_t left, uint32_t *seed)
+{
+    size_t len = (1 + (test_rand(seed) >> 16) % 7) * line_size;
+    return len < left ? len : left;
+}
+
+TEST_CASE("Decimating frame copy test", "[decimate]")
+{
+    const int width = DECIMATE_WIDTH, height = DECIMATE_HEIGHT;
+    uint32_t seed = 0x2545F491;
+    uint8_t *in = decimate_frame(&seed);
+    uint8_t *out = malloc(DECIMATE_FRAME_SIZE / 4);
+    uint8_t *ref = malloc(DECIMATE_FRAME_SIZE / 4);
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_NOT_NULL(ref);
+
+    cam_decimate_t dec = {0};
+    for (int fmt = 0; fmt < sizeof(s_formats) / sizeof(s_formats[0]); fmt++) {
+        for (int m = 0; m < sizeof(s_modes) / sizeof(s_modes[0]); m++) {
+            bool average = s_modes[m] == CAMERA_DECIMATE_2X_AVERAGE || s_modes[m] == CAMERA_DECIMATE_4X_AVERAGE;
+            esp_err_t err = cam_decimate_init(&dec, s_modes[m], s_formats[fmt], width, height);
+            if (average && s_formats[fmt] == PIXFORMAT_RGB565) {
+                TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, err);
+                continue;
+            }
+            TEST_ESP_OK(err);
+            int f = dec.factor;
+            size_t line_size = width * dec.bytes_per_pixel;
+            size_t out_size = (width / f) * (height / f) * dec.bytes_per_pixel;
+            ref_decimate(ref, in, s_formats[fmt], width, height, f, average);
+
+            for (int frame = 0; frame < 2; frame++) {
+                memset(out, 0, DECIMATE_FRAME_SIZE / 4);
+                dec.line = 0;
+                size_t in_pos = 0, out_pos = 0;
+                while (in_pos < line_size * height) {
+                    size_t len = decimate_chunk(line_size, line_size * height - in_pos, &seed);
+                    size_t expected = cam_decimate_out_size(&dec, len);
+                    size_t written = cam_decimate_lines(&dec, out + out_pos, in + in_pos, len);
+                    TEST_ASSERT_EQUAL(expected, written);
+                    in_pos += len;
+                    out_pos += written;
+                }
+                TEST_ASSERT_EQUAL(out_size, out_pos);
+                TEST_ASSERT_EQUAL_MEMORY(ref, out, out_size);
+            }
+        }
+    }
+
+    /* JPEG is never decimated, YUV422 pairs must not be split */
+    TEST_ESP_OK(cam_decimate_init(&dec, CAMERA_DECIMATE_4X, PIXFORMAT_JPEG, width, height));
+    TEST_ASSERT_EQUAL(1, dec.factor);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, cam_decimate_init(&dec, CAMERA_DECIMATE_4X, PIXFORMAT_YUV422, 100, height));
+    cam_decimate_deinit(&dec);
+
+    free(in);
+    free(out);
+    free(ref);
+}
+
+/* How the ESP32 I2S sampling modes lay the frame bytes out in the DMA words, see ll_cam_set_sample_mode() */
+static const struct {
+    const char *name;
+    dma_filter_t filter;
+    bool y8_only;               /* picks the Y bytes of YUYV, only for grayscale frames */
+    uint8_t bytes_per_word;     /* 2 when sample2 carries a byte too */
+    uint8_t words_per_step;     /* 2 when every other word is skipped */
+} s_layouts[] = {
+    {"grayscale",           ll_cam_dma_filter_grayscale,            true,  1, 1},
+    {"grayscale_highspeed", ll_cam_dma_filter_grayscale_highspeed,  true,  1, 2},
+    {"yuyv",                ll_cam_dma_filter_yuyv,                 false, 2, 1},
+    {"yuyv_highspeed",      ll_cam_dma_filter_yuyv_highspeed,       false, 1, 1},
+};
+
+/* Spread len frame bytes over DMA words, the bytes the filter skips are random; returns the DMA length */
+static size_t dma_encode(uint32_t *dma, const uint8_t *in, size_t len, int layout, uint32_t *seed)
+{
+    size_t bpw = s_layouts[layout].bytes_per_word;
+    size_t step = s_layouts[layout].words_per_step;
+    size_t words = len / bpw * step;
+    for (size_t w = 0; w < words; w++) {
+        dma[w] = test_rand(seed);
+    }
+    for (size_t i = 0; i < len; i++) {
+        uint32_t *w = &dma[i / bpw * step];
+        int shift = (bpw == 2 && (i & 1)) ? 0 : 16;
+        *w = (*w & ~(0xFFu << shift)) | (uint32_t)in[i] << shift;
+    }
+    return words * sizeof(uint32_t);
+}
+
+/* ll_cam_memcpy() of the esp32 target when decimating: the samples are gathered in place in the DMA
+ * half buffer, then the lines are scaled down into the frame buffer */
+static size_t dma_decimate(cam_decimate_t *dec, dma_filter_t filter, uint8_t *out, uint8_t *in, size_t len, size_t *pixels)
+{
+    *pixels = filter(in, in, len);
+    return cam_decimate_lines(dec, out, in, *pixels);
+}
+
+TEST_CASE("Decimating DMA copy in place test", "[decimate]")
+{
+    const int width = DECIMATE_WIDTH, height = DECIMATE_HEIGHT;
+    uint32_t seed = 0x1B873593;
+    uint8_t *in = decimate_frame(&seed);
+    uint8_t *out = malloc(DECIMATE_FRAME_SIZE / 4);
+    uint8_t *ref = malloc(DECIMATE_FRAME_SIZE / 4);
+    /* the widest layout takes two words per frame byte */
+    uint32_t *dma = malloc(DECIMATE_FRAME_SIZE * 2 * sizeof(uint32_t));
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_NOT_NULL(ref);
+    TEST_ASSERT_NOT_NULL(dma);
+
+    cam_decimate_t dec = {0};
+    for (int fmt = 0; fmt < sizeof(s_formats) / sizeof(s_formats[0]); fmt++) {
+        for (int l = 0; l < sizeof(s_layouts) / sizeof(s_layouts[0]); l++) {
+            if (s_layouts[l].y8_only && s_formats[fmt] != PIXFORMAT_GRAYSCALE) {
+                continue;
+            }
+            for (int m = 0; m < sizeof(s_modes) / sizeof(s_modes[0]); m++) {
+                bool average = s_modes[m] == CAMERA_DECIMATE_2X_AVERAGE || s_modes[m] == CAMERA_DECIMATE_4X_AVERAGE;
+                if (cam_decimate_init(&dec, s_modes[m], s_formats[fmt], width, height) != ESP_OK) {
+                    continue;   // averaged RGB565, covered above
+                }
+                int f = dec.factor;
+                size_t line_size = width * dec.bytes_per_pixel;
+                size_t out_size = (width / f) * (height / f) * dec.bytes_per_pixel;
+                ref_decimate(ref, in, s_formats[fmt], width, height, f, average);
+
+                memset(out, 0, DECIMATE_FRAME_SIZE / 4);
+                dec.line = 0;
+                size_t in_pos = 0, out_pos = 0;
+                while (in_pos < line_size * height) {
+                    size_t len = decimate_chunk(line_size, line_size * height - in_pos, &seed);
+                    size_t dma_len = dma_encode(dma, in + in_pos, len, l, &seed);
+                    size_t expected = cam_decimate_out_size(&dec, len);
+                    size_t pixels;
+                    size_t written = dma_decimate(&dec, s_layouts[l].filter, out + out_pos, (uint8_t *)dma, dma_len, &pixels);
+                    TEST_ASSERT_EQUAL(len, pixels);
+                    TEST_ASSERT_EQUAL(expected, written);
+                    in_pos += len;
+                    out_pos += written;
+                }
+                TEST_ASSERT_EQUAL(out_size, out_pos);
+                TEST_ASSERT_EQUAL_MEMORY(ref, out, out_size);
+            }
+        }
+    }
+    cam_decimate_deinit(&dec);
+
+    free(in);
+    free(out);
+    free(ref);
+    free(dma);
+}
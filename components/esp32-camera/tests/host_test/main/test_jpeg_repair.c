@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "jpeg_decoder.h"
+#include "jpeg_scan.h"
+#include "jpeg_repair.h"
+#include "test_common.h"
+
+#define JPEG_MARKER_SOS 0xDA
+
+/* Decode with esp_jpeg like the on-target suite does, true if it took the image at its full size */
+static bool test_decode(const test_picture_t *pic, const uint8_t *jpg, size_t len, uint8_t *rgb)
+{
+    esp_jpeg_image_cfg_t jpeg_cfg = {
+        .indata = (uint8_t *)jpg,
+        .indata_size = len,
+        .outbuf = rgb,
+        .outbuf_size = pic->width * pic->height * 2,
+        .out_format = JPEG_IMAGE_FORMAT_RGB565,
+        .out_scale = JPEG_IMAGE_SCALE_0,
+    };
+    esp_jpeg_image_output_t output_img = {};
+    return esp_jpeg_decode(&jpeg_cfg, &output_img) == ESP_OK
+           && output_img.width == pic->width && output_img.height == pic->height;
+}
+
+/* Offset of the scan data: walk the header segments to SOS, an EXIF thumbnail has markers of its own */
+static size_t test_scan_offset(const uint8_t *jpg, size_t len)
+{
+    size_t pos = 2;
+    while (pos + 4 <= len && jpg[pos] == 0xFF) {
+        size_t end = pos + 2 + (jpg[pos + 2] << 8 | jpg[pos + 3]);
+        if (jpg[pos + 1] == JPEG_MARKER_SOS) {
+            return end;
+        }
+        pos = end;
+    }
+    return 0;
+}
+
+/* Repair the picture cut at 'cut' in a buffer of 'cap' bytes and check that it is closed and decodes */
+static size_t check_repair(const test_picture_t *pic, uint8_t *jpg, size_t cut, size_t cap, size_t scan, uint8_t *rgb)
+{
+    memcpy(jpg, pic->buf, cut);
+    size_t len = jpeg_repair_truncated(jpg, cut, cap);
+    TEST_ASSERT_NOT_EQUAL(0, len);
+    TEST_ASSERT_LESS_OR_EQUAL(cap, len);
+    /* the headers are kept, only the scan data is rewritten */
+    TEST_ASSERT_EQUAL_MEMORY(pic->buf, jpg, scan);
+    TEST_ASSERT_EQUAL(0xFF, jpg[len - 2]);
+    TEST_ASSERT_EQUAL(JPEG_MARKER_EOI, jpg[len - 1]);
+    TEST_ASSERT_EQUAL(len - 2, jpeg_scan_marker(jpg + scan, len - scan, JPEG_MARKER_EOI) + scan);
+    TEST_ASSERT_TRUE(test_decode(pic, jpg, len, rgb));
+    return len;
+}
+
+TEST_CASE("JPEG truncated frame repair test", "[jpeg_repair]")
+{
+    for (int n = 0; n < TEST_PICTURE_COUNT; n++) {
+        const test_picture_t *pic = test_picture(n);
+        size_t length = pic->len;
+        uint8_t *jpg = malloc(length);
+        uint8_t *rgb = malloc(pic->width * pic->height * 2);
+        TEST_ASSERT_NOT_NULL(jpg);
+        TEST_ASSERT_NOT_NULL(rgb);
+        TEST_ASSERT_TRUE(test_decode(pic, pic->buf, length, rgb));
+
+        size_t scan = test_scan_offset(pic->buf, length);
+        TEST_ASSERT_GREATER_THAN(0, scan);
+
+        /* only the EOI missing: every MCU is there, the image comes back unchanged */
+        memcpy(jpg, pic->buf, length);
+        TEST_ASSERT_EQUAL(length, jpeg_repair_truncated(jpg, length - 2, length));
+        TEST_ASSERT_EQUAL_MEMORY(pic->buf, jpg, length);
+
+        /* cut inside the scan data, with room to spare and with the fill squeezed into the cut length */
+        for (int part = 1; part <= 3; part++) {
+            for (int tight = 0; tight < 2; tight++) {
+                size_t cut = length * part / 4;
+                size_t cap = tight ? cut : length;
+                size_t len = check_repair(pic, jpg, cut, cap, scan, rgb);
+                printf("image %d: cut at %u of %u, cap %u -> %u bytes\n", n,
+                       (unsigned) cut, (unsigned) length, (unsigned) cap, (unsigned) len);
+            }
+        }
+
+        /* every byte boundary of the scan data can be a cut point, try a spread of them */
+        for (size_t cut = scan + 1; cut < length - 2; cut += 53) {
+            check_repair(pic, jpg, cut, length, scan, rgb);
+        }
+
+        /* cut inside the headers: nothing to repair, the data is left alone */
+        memcpy(jpg, pic->buf, 100);
+        TEST_ASSERT_EQUAL(0, jpeg_repair_truncated(jpg, 100, length));
+        TEST_ASSERT_EQUAL_MEMORY(pic->buf, jpg, 100);
+
+        free(jpg);
+        free(rgb);
+    }
+}
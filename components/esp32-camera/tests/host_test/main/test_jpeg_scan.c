@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "jpeg_scan.h"
+#include "test_common.h"
+
+/* Byte-at-a-time marker searches the driver used before jpeg_scan, kept as reference */
+static int ref_find_soi(const uint8_t *inbuf, uint32_t length)
+{
+    static const uint8_t soi[] = {0xFF, 0xD8, 0xFF};
+    for (uint32_t i = 0; i + sizeof(soi) <= length; i++) {
+        if (memcmp(&inbuf[i], soi, sizeof(soi)) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int ref_find_eoi(const uint8_t *inbuf, uint32_t length)
+{
+    static const uint8_t eoi[] = {0xFF, 0xD9};
+    for (const uint8_t *dptr = inbuf + length - sizeof(eoi); dptr > inbuf; dptr--) {
+        if (memcmp(dptr, eoi, sizeof(eoi)) == 0) {
+            return dptr - inbuf;
+        }
+    }
+    return -1;
+}
+
+static size_t ref_count_markers(const uint8_t *inbuf, uint32_t length)
+{
+    size_t count = 0;
+    for (uint32_t i = 0; i + 1 < length; i++) {
+        if (inbuf[i] == 0xFF && inbuf[i + 1] != 0x00 && inbuf[i + 1] != 0xFF) {
+            count++;
+            i++;
+        }
+    }
+    return count;
+}
+
+/* The definitions of the jpeg_scan functions, one byte at a time */
+static int32_t ref_marker(const uint8_t *buf, size_t len, uint8_t code, bool rev)
+{
+    int32_t found = -1;
+    for (size_t i = 0; i + 1 < len; i++) {
+        if (buf[i] == 0xFF && buf[i + 1] == code) {
+            found = i;
+            if (!rev) {
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+static size_t ref_markers(const uint8_t *buf, size_t len, jpeg_marker_t *markers, size_t max)
+{
+    size_t count = 0;
+    for (size_t i = 0; i + 1 < len; i++) {
+        if (buf[i] == 0xFF && buf[i + 1] != 0x00 && buf[i + 1] != 0xFF) {
+            if (count < max) {
+                markers[count].offset = i;
+                markers[count].code = buf[i + 1];
+            }
+            count++;
+            i++;
+        } else if (buf[i] == 0xFF && buf[i + 1] == 0x00) {
+            i++;
+        }
+    }
+    return count;
+}
+
+TEST_CASE("JPEG marker scan equivalence test", "[jpeg_scan]")
+{
+    /* the pictures, against the searches the driver used before */
+    for (int n = 0; n < TEST_PICTURE_COUNT; n++) {
+        const test_picture_t *pic = test_picture(n);
+        TEST_ASSERT_EQUAL(ref_find_soi(pic->buf, pic->len), jpeg_scan_marker(pic->buf, pic->len, JPEG_MARKER_SOI));
+        TEST_ASSERT_EQUAL(ref_find_eoi(pic->buf, pic->len), jpeg_scan_marker_rev(pic->buf, pic->len, JPEG_MARKER_EOI));
+        TEST_ASSERT_EQUAL(ref_count_markers(pic->buf, pic->len), jpeg_scan_markers(pic->buf, pic->len, NULL, 0));
+    }
+
+    /* random data dense in 0xFF, at every alignment and length around the word size */
+    enum { MAX_LEN = 96, MAX_MARKERS = MAX_LEN / 2 };
+    static const uint8_t bytes[] = {0xFF, 0xFF, 0xFF, 0x00, JPEG_MARKER_SOI, JPEG_MARKER_EOI, 0xD0, 0x12};
+    uint8_t *mem = malloc(MAX_LEN + 8);
+    TEST_ASSERT_NOT_NULL(mem);
+    jpeg_marker_t ref[MAX_MARKERS], got[MAX_MARKERS];
+    uint32_t seed = 0x5EED1234;
+    for (int n = 0; n < 20000; n++) {
+        size_t offset = test_rand(&seed) >> 8 & 7;
+        size_t len = (test_rand(&seed) >> 8) % (MAX_LEN + 1);
+        uint8_t *buf = mem + offset;
+        for (size_t i = 0; i < len; i++) {
+            buf[i] = bytes[(test_rand(&seed) >> 12) % sizeof(bytes)];
+        }
+        uint8_t code = bytes[(test_rand(&seed) >> 12) % sizeof(bytes)];
+
+        const uint8_t *ff = memchr(buf, 0xFF, len);
+        const uint8_t *ff_rev = NULL;
+        for (size_t i = len; i > 0 && !ff_rev; i--) {
+            ff_rev = buf[i - 1] == 0xFF ? &buf[i - 1] : NULL;
+        }
+        TEST_ASSERT_TRUE(ff == jpeg_scan_ff(buf, len));
+        TEST_ASSERT_TRUE(ff_rev == jpeg_scan_ff_rev(buf, len));
+        TEST_ASSERT_EQUAL(ref_marker(buf, len, code, false), jpeg_scan_marker(buf, len, code));
+        TEST_ASSERT_EQUAL(ref_marker(buf, len, code, true), jpeg_scan_marker_rev(buf, len, code));
+
+        size_t count = ref_markers(buf, len, ref, MAX_MARKERS);
+        TEST_ASSERT_EQUAL(count, jpeg_scan_markers(buf, len, got, MAX_MARKERS));
+        for (size_t i = 0; i < count; i++) {
+            TEST_ASSERT_EQUAL(ref[i].offset, got[i].offset);
+            TEST_ASSERT_EQUAL(ref[i].code, got[i].code);
+        }
+    }
+    free(mem);
+}
+
+TEST_CASE("JPEG marker scan performance test", "[jpeg_scan]")
+{
+    const uint32_t times = 200;
+
+    for (int n = 0; n < TEST_PICTURE_COUNT; n++) {
+        const test_picture_t *pic = test_picture(n);
+        const uint8_t *jpg = pic->buf;
+        uint32_t length = pic->len;
+        int eoi = jpeg_scan_marker_rev(jpg, length, JPEG_MARKER_EOI);
+        TEST_ASSERT_GREATER_THAN(0, eoi);
+
+        /* searches for markers that aren't there, so every variant walks the whole image:
+         * a second SOI forward, and EOI backwards from one byte short of the real one */
+        int64_t t_ref_fwd = 0, t_ref_rev = 0, t_swar_fwd = 0, t_swar_rev = 0, t_ref_all = 0, t_swar_all = 0;
+        volatile int sink = 0;
+        for (uint32_t i = 0; i < times; i++) {
+            int64_t t = test_time_us();
+            sink += ref_find_eoi(jpg, eoi + 1);
+            t_ref_rev += test_time_us() - t;
+            t = test_time_us();
+            sink += jpeg_scan_marker_rev(jpg, eoi + 1, JPEG_MARKER_EOI);
+            t_swar_rev += test_time_us() - t;
+            t = test_time_us();
+            sink += ref_find_soi(jpg + 2, length - 2);
+            t_ref_fwd += test_time_us() - t;
+            t = test_time_us();
+            sink += jpeg_scan_marker(jpg + 2, length - 2, JPEG_MARKER_SOI);
+            t_swar_fwd += test_time_us() - t;
+            t = test_time_us();
+            sink += ref_count_markers(jpg, length);
+            t_ref_all += test_time_us() - t;
+            t = test_time_us();
+            sink += jpeg_scan_markers(jpg, length, NULL, 0);
+            t_swar_all += test_time_us() - t;
+        }
+        (void)sink;
+
+        printf("image %d: %u bytes, EOI @%d\n", n, (unsigned) length, eoi);
+        printf("  forward  byte-wise %7.2f MB/s, SWAR %7.2f MB/s\n",
+               test_mbps(length, times, t_ref_fwd), test_mbps(length, times, t_swar_fwd));
+        printf("  reverse  byte-wise %7.2f MB/s, SWAR %7.2f MB/s\n",
+               test_mbps(eoi, times, t_ref_rev), test_mbps(eoi, times, t_swar_rev));
+        printf("  markers  byte-wise %7.2f MB/s, SWAR %7.2f MB/s\n",
+               test_mbps(length, times, t_ref_all), test_mbps(length, times, t_swar_all));
+    }
+}
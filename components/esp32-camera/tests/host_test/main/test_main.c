@@ -0,0 +1,10 @@
+#include <stdlib.h>
+#include "unity.h"
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    unity_run_all_tests();
+    int failures = UNITY_END();
+    exit(failures ? 1 : 0);
+}
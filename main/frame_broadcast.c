@@ -0,0 +1,413 @@
+#include "frame_broadcast.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char *TAG = "BROADCAST";
+
+// 每个相机帧缓冲对应一个槽位. 驱动只有在帧缓冲的引用全部释放后才会再次交出它,
+// 所以同一个帧缓冲再次发布时, 它的旧槽位一定没有持有者了, 可以直接复用
+#define FRAME_SLOT_COUNT FRAME_BROADCAST_FB_COUNT
+
+// 帧回调在 cam_task 里最多等锁这么久, 订阅者持锁的时间都很短, 等不到就丢掉这一帧,
+// 不让采集任务卡在客户端上. 分片回调每个 DMA 半缓冲都来一次, 完全不等
+#define PUBLISH_LOCK_TICKS 1
+
+typedef struct {
+    bool used;
+    SemaphoreHandle_t ready;    // 二值信号量: 有新帧或新分片时置位, 多次发布只保留一次(最新帧优先)
+    uint32_t partial_id;        // 低延迟模式正在读的帧编号, 0 表示没有
+    camera_fb_t *partial_fb;    // partial_begin 替该订阅者拿的引用, 由 partial_end 释放
+    bool partial_done;          // 这一帧已经完整结束, partial_fb->len 有效
+} subscriber_t;
+
+// 正在采集的帧: 由分片回调更新. 帧结束之前驱动还在往后写, 前面已到达的部分不会再变.
+// 驱动从第一个分片起就持有这个帧缓冲, 订阅者拿到引用后即使帧被丢弃也不会被复用
+typedef struct {
+    camera_fb_t *fb;
+    uint32_t fb_seq;            // 驱动的帧序号, 确认拿到引用的还是这一帧
+    uint32_t id;
+    size_t avail;
+    bool done;
+    bool ok;
+} partial_frame_t;
+
+static broadcast_frame_t s_slots[FRAME_SLOT_COUNT];
+static broadcast_frame_t *s_latest = NULL;
+static subscriber_t s_subs[FRAME_BROADCAST_MAX_SUBSCRIBERS];
+static SemaphoreHandle_t s_lock = NULL;
+static volatile bool s_running = false;
+static uint32_t s_seq = 0;
+static partial_frame_t s_partial;
+static uint32_t s_partial_id = 0;
+static bool s_partial_enabled = false;
+// 有分片因为拿不到锁被跳过, 当前帧的数据已经不连续. 只在 cam_task 里读写
+static bool s_slice_dropped = false;
+static uint32_t s_publish_dropped = 0;
+
+// 在驱动的 cam_task 里运行: 帧一完成就发布给所有客户端, 不再需要单独的采集任务轮询
+static bool frame_publish(camera_fb_t *fb, void *arg)
+{
+    broadcast_frame_t *slot = NULL;
+
+    if (xSemaphoreTake(s_lock, PUBLISH_LOCK_TICKS) != pdTRUE) {
+        // 接管后直接释放, 帧不会再进驱动队列, 订阅者下次拿到的是更新的帧
+        esp_camera_fb_unref(fb);
+        if (++s_publish_dropped % 100 == 1) {
+            ESP_LOGW(TAG, "广播锁忙，已丢弃 %lu 帧", (unsigned long)s_publish_dropped);
+        }
+        return true;
+    }
+    if (!s_running) {
+        // 注销之后回调还可能再来一次, 帧留给驱动队列
+        xSemaphoreGive(s_lock);
+        return false;
+    }
+    for (int i = 0; i < FRAME_SLOT_COUNT; i++) {
+        if (s_slots[i].fb == fb) {
+            slot = &s_slots[i];
+            break;
+        }
+        if (!slot && !s_slots[i].fb) {
+            slot = &s_slots[i];
+        }
+    }
+    if (!slot) {
+        // 相机帧缓冲数多于槽位时才会发生
+        xSemaphoreGive(s_lock);
+        ESP_LOGW(TAG, "没有空闲广播槽位，丢弃帧");
+        return false;
+    }
+
+    // 接管驱动交出的引用, 广播器持有最新帧直到有更新的帧
+    slot->fb = fb;
+    slot->seq = ++s_seq;
+    if (s_latest) {
+        esp_camera_fb_unref(s_latest->fb);
+    }
+    s_latest = slot;
+
+    for (int i = 0; i < FRAME_BROADCAST_MAX_SUBSCRIBERS; i++) {
+        if (s_subs[i].used) {
+            xSemaphoreGive(s_subs[i].ready);
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return true;
+}
+
+// 在驱动的 cam_task 里运行, 每个 DMA 半缓冲完成时调用一次
+static void frame_slice(const camera_slice_t *slice, void *arg)
+{
+    if (xSemaphoreTake(s_lock, 0) != pdTRUE) {
+        s_slice_dropped = true;
+        return;
+    }
+    if (!s_running) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    if (s_slice_dropped) {
+        s_slice_dropped = false;
+        if (!slice->first && s_partial.id && !s_partial.done) {
+            // 中间缺了一段, 作废这一帧, 正在读的订阅者会收到 ESP_ERR_INVALID_STATE
+            s_partial.done = true;
+            s_partial.ok = false;
+            for (int i = 0; i < FRAME_BROADCAST_MAX_SUBSCRIBERS; i++) {
+                if (s_subs[i].used && s_subs[i].partial_id == s_partial.id) {
+                    xSemaphoreGive(s_subs[i].ready);
+                }
+            }
+            xSemaphoreGive(s_lock);
+            return;
+        }
+    }
+    if (slice->first) {
+        // 上一帧没收到结束分片的话也就此作废, 正在读它的订阅者会发现编号变了
+        if (++s_partial_id == 0) {
+            s_partial_id = 1;
+        }
+        s_partial = (partial_frame_t) {.fb = slice->fb, .fb_seq = slice->fb->seq, .id = s_partial_id};
+    }
+    if (slice->fb != s_partial.fb || s_partial.done) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+
+    if (slice->offset + slice->len > s_partial.avail) {
+        s_partial.avail = slice->offset + slice->len;
+    }
+    if (slice->last) {
+        s_partial.done = true;
+        s_partial.ok = slice->ok;
+        if (slice->ok) {
+            // 去掉EOI之后的数据; 新帧开始后订阅者靠 partial_done 知道这一帧是完整的
+            s_partial.avail = slice->fb->len;
+            for (int i = 0; i < FRAME_BROADCAST_MAX_SUBSCRIBERS; i++) {
+                if (s_subs[i].used && s_subs[i].partial_id == s_partial.id) {
+                    s_subs[i].partial_done = true;
+                }
+            }
+        }
+    }
+    // 新帧开始时叫醒所有订阅者, 等下一帧的和还在读被作废帧的都要知道
+    for (int i = 0; i < FRAME_BROADCAST_MAX_SUBSCRIBERS; i++) {
+        if (s_subs[i].used && (slice->first || s_subs[i].partial_id == s_partial.id)) {
+            xSemaphoreGive(s_subs[i].ready);
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t frame_broadcast_start(void)
+{
+    if (s_running) {
+        return ESP_OK;
+    }
+
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_lock) {
+            ESP_LOGE(TAG, "创建信号量失败");
+            return ESP_ERR_NO_MEM;
+        }
+        for (int i = 0; i < FRAME_BROADCAST_MAX_SUBSCRIBERS; i++) {
+            s_subs[i].ready = xSemaphoreCreateBinary();
+            if (!s_subs[i].ready) {
+                ESP_LOGE(TAG, "创建订阅信号量失败");
+                return ESP_ERR_NO_MEM;
+            }
+        }
+    }
+
+    s_running = true;
+    esp_err_t err = esp_camera_register_frame_cb(frame_publish, NULL);
+    if (err != ESP_OK) {
+        s_running = false;
+        ESP_LOGE(TAG, "注册帧回调失败: %s", esp_err_to_name(err));
+        return err;
+    }
+    // 非 JPEG 格式不支持分片, 只是没有低延迟模式
+    s_partial_enabled = esp_camera_register_slice_cb(frame_slice, NULL) == ESP_OK;
+    if (!s_partial_enabled) {
+        ESP_LOGW(TAG, "分片回调不可用, 低延迟模式关闭");
+    }
+    ESP_LOGI(TAG, "帧广播已启动");
+    return ESP_OK;
+}
+
+void frame_broadcast_stop(void)
+{
+    if (!s_running) {
+        return;
+    }
+    esp_camera_register_frame_cb(NULL, NULL);
+    if (s_partial_enabled) {
+        esp_camera_register_slice_cb(NULL, NULL);
+        s_partial_enabled = false;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_running = false;
+    memset(&s_partial, 0, sizeof(s_partial));
+    if (s_latest) {
+        esp_camera_fb_unref(s_latest->fb);
+        s_latest = NULL;
+    }
+    // 订阅者还拿着的低延迟帧也还给驱动, 之后的 partial_wait 会返回 ESP_ERR_INVALID_STATE
+    for (int i = 0; i < FRAME_BROADCAST_MAX_SUBSCRIBERS; i++) {
+        if (s_subs[i].partial_fb) {
+            esp_camera_fb_unref(s_subs[i].partial_fb);
+            s_subs[i].partial_fb = NULL;
+        }
+        s_subs[i].partial_done = false;
+    }
+    xSemaphoreGive(s_lock);
+    ESP_LOGI(TAG, "帧广播已停止");
+}
+
+int frame_broadcast_subscribe(void)
+{
+    int sub = -1;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < FRAME_BROADCAST_MAX_SUBSCRIBERS; i++) {
+        if (!s_subs[i].used) {
+            s_subs[i].used = true;
+            s_subs[i].partial_id = 0;
+            // 清掉旧的通知, 已有最新帧时让新客户端立即拿到
+            xSemaphoreTake(s_subs[i].ready, 0);
+            if (s_latest) {
+                xSemaphoreGive(s_subs[i].ready);
+            }
+            sub = i;
+            break;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return sub;
+}
+
+void frame_broadcast_unsubscribe(int sub)
+{
+    if (sub < 0 || sub >= FRAME_BROADCAST_MAX_SUBSCRIBERS) {
+        return;
+    }
+    frame_broadcast_partial_end(sub);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_subs[sub].used = false;
+    xSemaphoreGive(s_lock);
+}
+
+broadcast_frame_t *frame_broadcast_acquire(int sub, uint32_t last_seq, TickType_t timeout)
+{
+    if (sub < 0 || sub >= FRAME_BROADCAST_MAX_SUBSCRIBERS) {
+        return NULL;
+    }
+    if (xSemaphoreTake(s_subs[sub].ready, timeout) != pdTRUE) {
+        return NULL;
+    }
+
+    broadcast_frame_t *frame = NULL;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_latest && s_latest->seq != last_seq) {
+        frame = s_latest;
+        esp_camera_fb_ref(frame->fb);
+    }
+    xSemaphoreGive(s_lock);
+    return frame;
+}
+
+broadcast_frame_t *frame_broadcast_acquire_latest(void)
+{
+    broadcast_frame_t *frame = NULL;
+
+    if (!s_lock) {
+        return NULL;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_latest) {
+        frame = s_latest;
+        esp_camera_fb_ref(frame->fb);
+    }
+    xSemaphoreGive(s_lock);
+    return frame;
+}
+
+uint32_t frame_broadcast_latest_seq(void)
+{
+    return s_seq;
+}
+
+void frame_broadcast_release(broadcast_frame_t *frame)
+{
+    if (!frame) {
+        return;
+    }
+    esp_camera_fb_unref(frame->fb);
+}
+
+bool frame_broadcast_partial_supported(void)
+{
+    return s_partial_enabled;
+}
+
+uint32_t frame_broadcast_partial_begin(int sub, TickType_t timeout)
+{
+    if (sub < 0 || sub >= FRAME_BROADCAST_MAX_SUBSCRIBERS) {
+        return 0;
+    }
+    subscriber_t *s = &s_subs[sub];
+    uint32_t last_id = s->partial_id;
+    TickType_t start = xTaskGetTickCount();
+
+    frame_broadcast_partial_end(sub);
+    for (;;) {
+        camera_fb_t *stale = NULL;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        // 只接还没结束的帧, 已经结束的帧从头发没有低延迟的意义, 等下一帧
+        if (s_running && s_partial.id && s_partial.id != last_id && !s_partial.done) {
+            // 驱动还持有这个帧缓冲时才拿得到引用; 分片被跳过时它可能已经换成了别的帧
+            camera_fb_t *fb = esp_camera_fb_ref(s_partial.fb);
+            if (fb && fb->seq == s_partial.fb_seq) {
+                s->partial_id = s_partial.id;
+                s->partial_fb = fb;
+                s->partial_done = false;
+                xSemaphoreGive(s_lock);
+                return s->partial_id;
+            }
+            stale = fb;
+        }
+        xSemaphoreGive(s_lock);
+        if (stale) {
+            esp_camera_fb_unref(stale);
+        }
+
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (waited >= timeout || xSemaphoreTake(s->ready, timeout - waited) != pdTRUE) {
+            return 0;
+        }
+    }
+}
+
+esp_err_t frame_broadcast_partial_wait(int sub, uint32_t id, camera_fb_t **fb, size_t *avail, bool *done,
+                                       TickType_t timeout)
+{
+    if (sub < 0 || sub >= FRAME_BROADCAST_MAX_SUBSCRIBERS || !id) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    subscriber_t *s = &s_subs[sub];
+    TickType_t start = xTaskGetTickCount();
+
+    for (;;) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        // 只交出订阅者自己持有引用的帧缓冲
+        if (s->partial_id != id || !s->partial_fb) {
+            xSemaphoreGive(s_lock);
+            return ESP_ERR_INVALID_STATE;
+        }
+        if (s->partial_done) {
+            // 帧已完整结束, 下一帧可能已经开始
+            *fb = s->partial_fb;
+            *avail = s->partial_fb->len;
+            *done = true;
+            xSemaphoreGive(s_lock);
+            return ESP_OK;
+        }
+        if (s_partial.id != id || s_partial.done) {
+            // 帧被丢弃或已被新帧取代
+            xSemaphoreGive(s_lock);
+            return ESP_ERR_INVALID_STATE;
+        }
+        if (s_partial.avail > *avail) {
+            *fb = s->partial_fb;
+            *avail = s_partial.avail;
+            *done = false;
+            xSemaphoreGive(s_lock);
+            return ESP_OK;
+        }
+        xSemaphoreGive(s_lock);
+
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (waited >= timeout || xSemaphoreTake(s->ready, timeout - waited) != pdTRUE) {
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+}
+
+void frame_broadcast_partial_end(int sub)
+{
+    if (sub < 0 || sub >= FRAME_BROADCAST_MAX_SUBSCRIBERS || !s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    camera_fb_t *fb = s_subs[sub].partial_fb;
+    s_subs[sub].partial_fb = NULL;
+    s_subs[sub].partial_done = false;
+    xSemaphoreGive(s_lock);
+    if (fb) {
+        esp_camera_fb_unref(fb);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef FRAME_BROADCAST_H
+#define FRAME_BROADCAST_H
+
+#include "esp_err.h"
+#include "esp_camera.h"
+#include "freertos/FreeRTOS.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// 同时观看的客户端上限
+#define FRAME_BROADCAST_MAX_SUBSCRIBERS 4
+// 相机帧缓冲数量: 每个客户端最多持有一帧, 再加上最新帧、/snapshot 正在发送的一帧
+// 和正在采集的一帧, 这样慢客户端不会卡住传感器
+#define FRAME_BROADCAST_FB_COUNT (FRAME_BROADCAST_MAX_SUBSCRIBERS + 3)
+
+// 广播帧: 驱动的帧回调发布一次, 各客户端通过驱动的引用计数(esp_camera_fb_ref/unref)
+// 共享同一个相机帧缓冲, 最后一个持有者释放后帧缓冲才回到驱动
+typedef struct {
+    camera_fb_t *fb;
+    uint32_t seq;       // 帧序号, 从1开始递增
+} broadcast_frame_t;
+
+// 启动/停止帧广播. 启动后由驱动的帧回调接管所有帧(esp_camera_register_frame_cb),
+// 其他地方不要再调用 esp_camera_fb_get
+esp_err_t frame_broadcast_start(void);
+void frame_broadcast_stop(void);
+
+// 订阅广播, 返回订阅槽位, 已满时返回 -1
+int frame_broadcast_subscribe(void);
+void frame_broadcast_unsubscribe(int sub);
+
+// 等待比 last_seq 更新的帧(只取最新帧, 中间的帧直接跳过)
+// 成功时持有一个引用, 用完后必须调用 frame_broadcast_release
+broadcast_frame_t *frame_broadcast_acquire(int sub, uint32_t last_seq, TickType_t timeout);
+void frame_broadcast_release(broadcast_frame_t *frame);
+
+// 不订阅, 直接取最近一帧的引用(用于 /snapshot), 还没有帧时返回 NULL
+// 用完后同样调用 frame_broadcast_release
+broadcast_frame_t *frame_broadcast_acquire_latest(void);
+
+// 最新已发布帧的序号, 还没有帧时为0
+uint32_t frame_broadcast_latest_seq(void);
+
+// 低延迟模式: 通过驱动的分片回调(esp_camera_register_slice_cb), 帧还在采集时就把
+// 已经到达帧缓冲的数据交给订阅者, 不用等整帧完成. 只支持 JPEG
+bool frame_broadcast_partial_supported(void);
+
+// 等待下一帧开始, 返回帧编号(非0), 超时返回0. 成功时替订阅者持有这个帧缓冲的引用,
+// 帧中途被丢弃也不会被驱动复用. 之后用 partial_wait 读数据, 读完(包括放弃这一帧时)调用 partial_end
+uint32_t frame_broadcast_partial_begin(int sub, TickType_t timeout);
+
+// 等待帧 id 到达比 *avail 更多的数据, 或者帧结束:
+// 返回 ESP_OK, *fb 为正在填充的帧缓冲, *avail 为 fb->buf 中已到达的字节数, 数据在 partial_end 之前一直可读;
+// *done 为真时 *avail 是帧的最终长度, fb 的其他字段也已有效;
+// 帧被驱动丢弃、已被新帧取代或中间的分片没能记录时返回 ESP_ERR_INVALID_STATE, 已发出的部分不完整;
+// 超时返回 ESP_ERR_TIMEOUT
+esp_err_t frame_broadcast_partial_wait(int sub, uint32_t id, camera_fb_t **fb, size_t *avail, bool *done,
+                                       TickType_t timeout);
+
+// 结束读取当前帧, 释放帧完成时替订阅者持有的引用
+void frame_broadcast_partial_end(int sub);
+
+#endif
@@ -0,0 +1,150 @@
+#include "frame_clock.h"
+#include "esp_log.h"
+#include "freertos/task.h"
+#include <string.h>
+
+static const char *TAG = "FRAME_CLOCK";
+
+static void frame_clock_timer_cb(void *arg)
+{
+    frame_clock_t *clock = (frame_clock_t *)arg;
+    xSemaphoreGive(clock->wake);
+}
+
+esp_err_t frame_clock_init(frame_clock_t *clock, const char *name, int64_t period_us)
+{
+    memset(clock, 0, sizeof(*clock));
+    clock->name = name;
+    clock->period_us = period_us;
+    clock->last.period_us = period_us;
+
+    clock->wake = xSemaphoreCreateBinary();
+    if (!clock->wake) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_timer_create_args_t args = {
+        .callback = frame_clock_timer_cb,
+        .arg = clock,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = name,
+    };
+    esp_err_t err = esp_timer_create(&args, &clock->timer);
+    if (err != ESP_OK) {
+        vSemaphoreDelete(clock->wake);
+        clock->wake = NULL;
+        return err;
+    }
+    return ESP_OK;
+}
+
+void frame_clock_deinit(frame_clock_t *clock)
+{
+    if (clock->timer) {
+        esp_timer_stop(clock->timer);
+        esp_timer_delete(clock->timer);
+        clock->timer = NULL;
+    }
+    if (clock->wake) {
+        vSemaphoreDelete(clock->wake);
+        clock->wake = NULL;
+    }
+}
+
+void frame_clock_set_period(frame_clock_t *clock, int64_t period_us)
+{
+    clock->period_us = period_us;
+}
+
+void frame_clock_reset(frame_clock_t *clock)
+{
+    clock->deadline_us = 0;
+    clock->last_release_us = 0;
+}
+
+// 记录一次放行, 窗口结束时输出统计
+static void frame_clock_release(frame_clock_t *clock, int64_t now)
+{
+    if (clock->last_release_us) {
+        int64_t dev = now - clock->last_release_us - clock->period_us;
+        uint32_t jitter = (uint32_t)(dev < 0 ? -dev : dev);
+        clock->jitter_sum_us += jitter;
+        if (jitter > clock->jitter_max_us) {
+            clock->jitter_max_us = jitter;
+        }
+    }
+    clock->last_release_us = now;
+    clock->periods++;
+
+    if (clock->window_start_us == 0) {
+        clock->window_start_us = now;
+        return;
+    }
+    int64_t elapsed = now - clock->window_start_us;
+    if (elapsed < FRAME_CLOCK_REPORT_US || elapsed < clock->period_us * 2) {
+        return;
+    }
+
+    // 窗口第一次放行只作为起点, 间隔数比放行数少一
+    uint32_t intervals = clock->periods - 1;
+    frame_clock_stats_t *s = &clock->last;
+    s->period_us = clock->period_us;
+    s->fps_milli = (uint32_t)((uint64_t)intervals * 1000000000ULL / elapsed);
+    s->periods = intervals;
+    s->overruns = clock->overruns;
+    s->jitter_avg_us = intervals ? (uint32_t)(clock->jitter_sum_us / intervals) : 0;
+    s->jitter_max_us = clock->jitter_max_us;
+
+    ESP_LOGI(TAG, "%s: 目标 %lu.%03lu fps, 实际 %lu.%03lu fps, 抖动 平均 %lu us / 最大 %lu us, 超时 %lu 次",
+             clock->name,
+             (unsigned long)(1000000 / s->period_us), (unsigned long)(1000000000LL / s->period_us % 1000),
+             (unsigned long)(s->fps_milli / 1000), (unsigned long)(s->fps_milli % 1000),
+             (unsigned long)s->jitter_avg_us, (unsigned long)s->jitter_max_us, (unsigned long)s->overruns);
+
+    // 本次放行作为新窗口的起点
+    clock->window_start_us = now;
+    clock->periods = 1;
+    clock->overruns = 0;
+    clock->jitter_sum_us = 0;
+    clock->jitter_max_us = 0;
+}
+
+bool frame_clock_wait(frame_clock_t *clock)
+{
+    int64_t now = esp_timer_get_time();
+    bool on_time = true;
+
+    if (clock->deadline_us == 0) {
+        // 刚开始或刚重置: 立即放行, 窗口也从这里重新算
+        clock->window_start_us = 0;
+        clock->periods = 0;
+        clock->overruns = 0;
+        clock->jitter_sum_us = 0;
+        clock->jitter_max_us = 0;
+    } else if (now >= clock->deadline_us) {
+        // 上一周期的处理超时: 不补发错过的周期, 从现在重新对齐
+        clock->overruns++;
+        on_time = false;
+    } else {
+        int64_t remain = clock->deadline_us - now;
+        if (esp_timer_start_once(clock->timer, (uint64_t)remain) == ESP_OK) {
+            xSemaphoreTake(clock->wake, portMAX_DELAY);
+        } else {
+            vTaskDelay(pdMS_TO_TICKS((remain + 999) / 1000));
+        }
+        now = esp_timer_get_time();
+    }
+
+    // 准时放行时截止时间按周期累加, 唤醒延迟不会累积
+    if (on_time && clock->deadline_us) {
+        clock->deadline_us += clock->period_us;
+    } else {
+        clock->deadline_us = now + clock->period_us;
+    }
+    frame_clock_release(clock, now);
+    return on_time;
+}
+
+void frame_clock_get_stats(const frame_clock_t *clock, frame_clock_stats_t *stats)
+{
+    *stats = clock->last;
+}
@@ -0,0 +1,62 @@
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// 帧节拍时钟: 按目标帧率周期性放行, 代替循环里的 vTaskDelay 固定延时
+//
+// 截止时间按周期累加(next += period), 不受每帧处理/发送耗时影响, 不会越跑越慢;
+// 由 esp_timer 在截止时间唤醒等待的任务, 精度不受 FreeRTOS tick 限制.
+// 处理超过一个周期时记为超时(overrun), 从当前时间重新对齐, 不补发错过的周期.
+// 每个时钟只能由一个任务使用, 不加锁
+
+#define FRAME_CLOCK_PERIOD_US(fps) (1000000LL / (fps))
+// 统计窗口: 每个窗口结束时输出一行日志并清零
+#define FRAME_CLOCK_REPORT_US (10 * 1000000LL)
+
+typedef struct {
+    int64_t period_us;          // 目标周期
+    uint32_t fps_milli;         // 上个窗口的实际帧率 x1000
+    uint32_t periods;           // 上个窗口放行的周期数
+    uint32_t overruns;          // 上个窗口的超时次数
+    uint32_t jitter_avg_us;     // 上个窗口相邻两次放行间隔与目标周期之差的平均值
+    uint32_t jitter_max_us;     // 及最大值
+} frame_clock_stats_t;
+
+typedef struct {
+    const char *name;
+    int64_t period_us;
+    int64_t deadline_us;        // 下一次放行的截止时间, 0 表示重新开始
+    int64_t last_release_us;
+    esp_timer_handle_t timer;
+    SemaphoreHandle_t wake;     // 定时器回调释放, 不占用任务通知
+    // 当前窗口
+    int64_t window_start_us;
+    uint32_t periods;
+    uint32_t overruns;
+    uint64_t jitter_sum_us;
+    uint32_t jitter_max_us;
+    frame_clock_stats_t last;   // 上一个完整窗口的统计
+} frame_clock_t;
+
+esp_err_t frame_clock_init(frame_clock_t *clock, const char *name, int64_t period_us);
+void frame_clock_deinit(frame_clock_t *clock);
+
+// 修改目标周期, 从下一次 wait 开始生效
+void frame_clock_set_period(frame_clock_t *clock, int64_t period_us);
+
+// 暂停后(如没有客户端)重新开始计时, 下一次 wait 立即放行, 暂停期间不算超时
+void frame_clock_reset(frame_clock_t *clock);
+
+// 等到下一个截止时间; 已经错过时立即返回 false(记一次超时), 否则返回 true
+bool frame_clock_wait(frame_clock_t *clock);
+
+// 上一个完整统计窗口的数据
+void frame_clock_get_stats(const frame_clock_t *clock, frame_clock_stats_t *stats);
+
+#endif
@@ -0,0 +1,212 @@
+#include "frame_pool.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char *TAG = "FRAME_POOL";
+
+typedef enum {
+    SLOT_FREE = 0,
+    SLOT_FILLING,
+    SLOT_QUEUED,
+    SLOT_SENDING,
+} slot_state_t;
+
+typedef struct {
+    frame_slot_t slot;      // 必须是第一个成员, 便于从 frame_slot_t* 换回
+    slot_state_t state;
+    uint32_t order;         // 提交顺序, 越小越早
+} pool_entry_t;
+
+static pool_entry_t *s_entries = NULL;
+static uint8_t *s_buffer = NULL;
+static size_t s_slot_count = 0;
+static size_t s_slot_size = 0;
+static uint32_t s_order = 0;
+static SemaphoreHandle_t s_lock = NULL;
+static SemaphoreHandle_t s_queued_sem = NULL;   // 计数信号量, 等于排队帧数
+static frame_pool_stats_t s_stats;
+
+esp_err_t frame_pool_init(size_t slot_count, size_t slot_size)
+{
+    if (s_entries) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (slot_count == 0 || slot_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // 槽位大小按4字节对齐, 整块一次分配
+    slot_size = (slot_size + 3) & ~(size_t)3;
+    s_buffer = heap_caps_malloc(slot_count * slot_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!s_buffer) {
+        ESP_LOGW(TAG, "PSRAM分配失败，改用内部RAM");
+        s_buffer = heap_caps_malloc(slot_count * slot_size, MALLOC_CAP_8BIT);
+    }
+    s_entries = heap_caps_calloc(slot_count, sizeof(pool_entry_t), MALLOC_CAP_8BIT);
+    s_lock = xSemaphoreCreateMutex();
+    s_queued_sem = xSemaphoreCreateCounting(slot_count, 0);
+    if (!s_buffer || !s_entries || !s_lock || !s_queued_sem) {
+        ESP_LOGE(TAG, "帧槽池分配失败 (%zu x %zu 字节)", slot_count, slot_size);
+        frame_pool_deinit();
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < slot_count; i++) {
+        s_entries[i].slot.data = s_buffer + i * slot_size;
+        s_entries[i].slot.len = 0;
+        s_entries[i].state = SLOT_FREE;
+    }
+    s_slot_count = slot_count;
+    s_slot_size = slot_size;
+    s_order = 0;
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stats.slot_count = slot_count;
+    s_stats.slot_size = slot_size;
+
+    ESP_LOGI(TAG, "帧槽池就绪: %zu 个槽位, 每个 %zu 字节", slot_count, slot_size);
+    return ESP_OK;
+}
+
+void frame_pool_deinit(void)
+{
+    if (s_queued_sem) {
+        vSemaphoreDelete(s_queued_sem);
+        s_queued_sem = NULL;
+    }
+    if (s_lock) {
+        vSemaphoreDelete(s_lock);
+        s_lock = NULL;
+    }
+    heap_caps_free(s_entries);
+    heap_caps_free(s_buffer);
+    s_entries = NULL;
+    s_buffer = NULL;
+    s_slot_count = 0;
+    s_slot_size = 0;
+}
+
+size_t frame_pool_slot_size(void)
+{
+    return s_slot_size;
+}
+
+// 找最早排队的槽位, 调用者须持有 s_lock
+static pool_entry_t *oldest_queued_locked(void)
+{
+    pool_entry_t *oldest = NULL;
+    for (size_t i = 0; i < s_slot_count; i++) {
+        pool_entry_t *e = &s_entries[i];
+        if (e->state == SLOT_QUEUED && (!oldest || (int32_t)(e->order - oldest->order) < 0)) {
+            oldest = e;
+        }
+    }
+    return oldest;
+}
+
+static void set_state_locked(pool_entry_t *e, slot_state_t state)
+{
+    if (e->state == SLOT_FREE && state != SLOT_FREE) {
+        s_stats.in_use++;
+        if (s_stats.in_use > s_stats.high_water) {
+            s_stats.high_water = s_stats.in_use;
+        }
+    } else if (e->state != SLOT_FREE && state == SLOT_FREE) {
+        s_stats.in_use--;
+    }
+    if (e->state == SLOT_QUEUED) {
+        s_stats.queued--;
+    }
+    if (state == SLOT_QUEUED) {
+        s_stats.queued++;
+    }
+    e->state = state;
+}
+
+frame_slot_t *frame_pool_alloc(size_t len)
+{
+    if (!s_entries) {
+        return NULL;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (len > s_slot_size) {
+        s_stats.oversize++;
+        xSemaphoreGive(s_lock);
+        return NULL;
+    }
+
+    pool_entry_t *entry = NULL;
+    for (size_t i = 0; i < s_slot_count; i++) {
+        if (s_entries[i].state == SLOT_FREE) {
+            entry = &s_entries[i];
+            break;
+        }
+    }
+    // 池满: 丢弃最旧的排队帧, 把它的信号量计数一并扣掉
+    if (!entry && xSemaphoreTake(s_queued_sem, 0) == pdTRUE) {
+        entry = oldest_queued_locked();
+        if (entry) {
+            s_stats.dropped++;
+        } else {
+            xSemaphoreGive(s_queued_sem);
+        }
+    }
+    if (entry) {
+        set_state_locked(entry, SLOT_FILLING);
+        entry->slot.len = 0;
+    }
+    xSemaphoreGive(s_lock);
+
+    return entry ? &entry->slot : NULL;
+}
+
+void frame_pool_commit(frame_slot_t *slot)
+{
+    pool_entry_t *entry = (pool_entry_t *)slot;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    entry->order = s_order++;
+    set_state_locked(entry, SLOT_QUEUED);
+    s_stats.committed++;
+    xSemaphoreGive(s_lock);
+    xSemaphoreGive(s_queued_sem);
+}
+
+frame_slot_t *frame_pool_take(TickType_t timeout)
+{
+    if (!s_queued_sem || xSemaphoreTake(s_queued_sem, timeout) != pdTRUE) {
+        return NULL;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    pool_entry_t *entry = oldest_queued_locked();
+    if (entry) {
+        set_state_locked(entry, SLOT_SENDING);
+    }
+    xSemaphoreGive(s_lock);
+
+    return entry ? &entry->slot : NULL;
+}
+
+void frame_pool_release(frame_slot_t *slot)
+{
+    if (!slot) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    set_state_locked((pool_entry_t *)slot, SLOT_FREE);
+    xSemaphoreGive(s_lock);
+}
+
+void frame_pool_get_stats(frame_pool_stats_t *stats)
+{
+    if (!s_lock) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,49 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// 固定帧槽池: 启动时在PSRAM里一次性分配, 之后采集/发送都不再申请堆内存
+// 槽位状态: 空闲 -> 填充中(采集任务) -> 待发送(排队) -> 发送中(发送任务) -> 空闲
+// 没有空闲槽位时, 丢弃最早排队的一帧(发送中的槽位不会被抢占)
+
+typedef struct {
+    uint8_t *data;      // 槽位缓冲区, 容量为 frame_pool_slot_size()
+    size_t len;         // 已写入的字节数, 由使用者填写
+} frame_slot_t;
+
+typedef struct {
+    size_t slot_count;
+    size_t slot_size;
+    size_t in_use;          // 当前非空闲的槽位数
+    size_t high_water;      // in_use 的历史最大值
+    size_t queued;          // 当前排队待发送的帧数
+    uint32_t committed;     // 累计提交的帧数
+    uint32_t dropped;       // 因池满被丢弃的最旧帧数
+    uint32_t oversize;      // 因超过槽位容量被拒绝的帧数
+} frame_pool_stats_t;
+
+// 分配 slot_count 个 slot_size 字节的槽位(优先PSRAM)
+esp_err_t frame_pool_init(size_t slot_count, size_t slot_size);
+// 释放整个池, 调用前须保证没有任务还在使用槽位
+void frame_pool_deinit(void);
+
+size_t frame_pool_slot_size(void);
+
+// 采集端: 取一个空闲槽位, 能容纳 len 字节; 池满时丢弃最旧的排队帧
+// len 超过槽位容量或没有可用槽位时返回 NULL
+frame_slot_t *frame_pool_alloc(size_t len);
+// 采集端: 写完后提交, 按提交顺序排队
+void frame_pool_commit(frame_slot_t *slot);
+
+// 发送端: 取最早排队的一帧, 超时返回 NULL; 用完后必须 frame_pool_release
+frame_slot_t *frame_pool_take(TickType_t timeout);
+// 归还槽位, 也可以用于放弃 frame_pool_alloc 得到但未提交的槽位
+void frame_pool_release(frame_slot_t *slot);
+
+void frame_pool_get_stats(frame_pool_stats_t *stats);
+
+#endif
@@ -7,6 +7,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "wifi_streaming.h"
+#include "frame_broadcast.h"
 #include "mdns.h"
 #include "wifi_udp.h"
 #ifndef portTICK_RATE_MS
@@ -63,9 +64,17 @@ static camera_config_t camera_config = {
     .frame_size = FRAMESIZE_QVGA,    //QQVGA-UXGA, For ESP32, do not use sizes above QVGA when not JPEG. The performance of the ESP32-S series has improved a lot, but JPEG mode always gives better frame rates.
 
     .jpeg_quality = 15, //0-63, for OV series camera sensors, lower number means higher quality
-    .fb_count = 1,       //When jpeg mode is used, if fb_count more than one, the driver will work in continuous mode.
+    .fb_count = FRAME_BROADCAST_FB_COUNT, //When jpeg mode is used, if fb_count more than one, the driver will work in continuous mode.
     .fb_location = CAMERA_FB_IN_PSRAM,
     .grab_mode = CAMERA_GRAB_LATEST,
+
+    // 闭环码率控制: 按最近帧的大小调整 jpeg_quality, 让QVGA帧稳定在10KB左右
+    // QVGA 的帧缓冲只有 320*240/5 = 15KB, 目标要给偏大的帧留余量, 驱动会把超过 3/4 缓冲的目标截断
+    .rate_ctrl = {
+        .target_frame_bytes = 10 * 1024,
+        .min_quality = 10,
+        .max_quality = 40,
+    },
 };
 
 static esp_err_t init_camera(void)
@@ -0,0 +1,219 @@
+#include "rtp_jpeg.h"
+#include <string.h>
+
+#define JPEG_QTABLE_LEN 64
+
+static inline uint16_t read_be16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static inline void write_be16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+
+static inline void write_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+static esp_err_t parse_dqt(const uint8_t *seg, size_t seg_len, rtp_jpeg_info_t *info)
+{
+    size_t pos = 0;
+    while (pos < seg_len) {
+        uint8_t precision = seg[pos] >> 4;
+        uint8_t id = seg[pos] & 0x0f;
+        // RFC 2435 的 Q=255 表头可以描述16位表, 但摄像头只输出8位表, 这里只支持8位
+        if (precision != 0 || id > 1 || pos + 1 + JPEG_QTABLE_LEN > seg_len) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        info->qtables[id] = &seg[pos + 1];
+        if (id + 1 > info->qtable_count) {
+            info->qtable_count = id + 1;
+        }
+        pos += 1 + JPEG_QTABLE_LEN;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t parse_sof0(const uint8_t *seg, size_t seg_len, rtp_jpeg_info_t *info)
+{
+    // 精度(1) 高(2) 宽(2) 分量数(1) 每个分量3字节
+    if (seg_len < 6 + 3 * 3 || seg[0] != 8 || seg[5] != 3) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    info->height = read_be16(&seg[1]);
+    info->width = read_be16(&seg[3]);
+    if (info->width == 0 || info->height == 0 || info->width > 2040 || info->height > 2040) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // 第一个分量(Y)的采样因子决定类型, 色度分量必须是 1x1
+    uint8_t y_sampling = seg[7];
+    if (seg[10] != 0x11 || seg[13] != 0x11) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (y_sampling == 0x21) {
+        info->type = 0;
+    } else if (y_sampling == 0x22) {
+        info->type = 1;
+    } else {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return ESP_OK;
+}
+
+esp_err_t rtp_jpeg_parse(const uint8_t *jpeg, size_t len, rtp_jpeg_info_t *info)
+{
+    if (!jpeg || !info || len < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(info, 0, sizeof(*info));
+
+    bool have_sof = false;
+    size_t pos = 2;
+    while (pos + 4 <= len) {
+        if (jpeg[pos] != 0xFF) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        uint8_t marker = jpeg[pos + 1];
+        if (marker == 0xFF) {
+            // 填充字节
+            pos++;
+            continue;
+        }
+        size_t seg_len = read_be16(&jpeg[pos + 2]);
+        if (seg_len < 2 || pos + 2 + seg_len > len) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        const uint8_t *seg = &jpeg[pos + 4];
+        size_t body_len = seg_len - 2;
+        esp_err_t err = ESP_OK;
+
+        switch (marker) {
+        case 0xDB:  // DQT
+            err = parse_dqt(seg, body_len, info);
+            break;
+        case 0xC0:  // SOF0 基线
+        case 0xC1:  // SOF1 扩展基线, 8位精度时与基线相同
+            err = parse_sof0(seg, body_len, info);
+            have_sof = true;
+            break;
+        case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+        case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+            // 渐进/无损/算术编码
+            return ESP_ERR_NOT_SUPPORTED;
+        case 0xDD:  // DRI, 重启间隔不为0时需要 RTP/JPEG 的 restart marker 头, 不支持
+            if (body_len >= 2 && read_be16(seg) != 0) {
+                return ESP_ERR_NOT_SUPPORTED;
+            }
+            break;
+        case 0xDA: {  // SOS, 后面就是熵编码数据
+            if (!have_sof || info->qtable_count == 0) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            // 只有色度表(id 1)时没有亮度表可用
+            if (!info->qtables[0]) {
+                return ESP_ERR_NOT_SUPPORTED;
+            }
+            size_t scan_start = pos + 2 + seg_len;
+            size_t scan_end = len;
+            // 去掉结尾的 EOI 以及之后可能残留的填充
+            while (scan_end >= scan_start + 2 &&
+                   !(jpeg[scan_end - 2] == 0xFF && jpeg[scan_end - 1] == 0xD9)) {
+                scan_end--;
+            }
+            if (scan_end < scan_start + 2) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            info->scan = &jpeg[scan_start];
+            info->scan_len = scan_end - 2 - scan_start;
+            return info->scan_len ? ESP_OK : ESP_ERR_INVALID_ARG;
+        }
+        default:
+            // APPn、COM、DHT 等: RTP/JPEG 使用标准霍夫曼表, 不需要传输
+            break;
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        pos += 2 + seg_len;
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t rtp_jpeg_packetize(rtp_jpeg_packetizer_t *p, const uint8_t *jpeg, size_t len, uint32_t timestamp,
+                             uint8_t *pkt_buf, rtp_jpeg_emit_t emit, void *arg)
+{
+    rtp_jpeg_info_t info;
+    esp_err_t err = rtp_jpeg_parse(jpeg, len, &info);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    size_t qtables_len = (size_t)info.qtable_count * JPEG_QTABLE_LEN;
+    size_t first_hdr_len = RTP_HEADER_LEN + RTP_JPEG_HEADER_LEN + RTP_JPEG_QTABLE_HEADER_LEN + qtables_len;
+    if (p->mtu <= first_hdr_len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    size_t offset = 0;
+    while (offset < info.scan_len) {
+        uint8_t *q = pkt_buf;
+        size_t hdr_len = RTP_HEADER_LEN + RTP_JPEG_HEADER_LEN;
+        if (offset == 0) {
+            hdr_len = first_hdr_len;
+        }
+        size_t chunk = p->mtu - hdr_len;
+        if (chunk > info.scan_len - offset) {
+            chunk = info.scan_len - offset;
+        }
+        bool last = offset + chunk == info.scan_len;
+
+        // RTP 头: V=2, 最后一个包置 marker
+        q[0] = 0x80;
+        q[1] = RTP_JPEG_PAYLOAD_TYPE | (last ? 0x80 : 0);
+        write_be16(&q[2], p->seq++);
+        write_be32(&q[4], timestamp);
+        write_be32(&q[8], p->ssrc);
+        q += RTP_HEADER_LEN;
+
+        // JPEG 头: type-specific, 24位分片偏移, type, Q, width/8, height/8
+        q[0] = 0;
+        q[1] = (offset >> 16) & 0xff;
+        q[2] = (offset >> 8) & 0xff;
+        q[3] = offset & 0xff;
+        q[4] = info.type;
+        q[5] = 255;
+        q[6] = (info.width + 7) / 8;
+        q[7] = (info.height + 7) / 8;
+        q += RTP_JPEG_HEADER_LEN;
+
+        // Q=255: 第一个包带量化表头和表
+        if (offset == 0) {
+            q[0] = 0;       // MBZ
+            q[1] = 0;       // 精度: 全部8位
+            write_be16(&q[2], qtables_len);
+            q += RTP_JPEG_QTABLE_HEADER_LEN;
+            for (int i = 0; i < info.qtable_count; i++) {
+                // 只有一张表时色度也用亮度表, parse 保证亮度表一定存在
+                const uint8_t *table = info.qtables[i] ? info.qtables[i] : info.qtables[0];
+                memcpy(q, table, JPEG_QTABLE_LEN);
+                q += JPEG_QTABLE_LEN;
+            }
+        }
+
+        memcpy(q, info.scan + offset, chunk);
+        err = emit(pkt_buf, hdr_len + chunk, arg);
+        if (err != ESP_OK) {
+            return err;
+        }
+        offset += chunk;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,46 @@
+#ifndef RTP_JPEG_H
+#define RTP_JPEG_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// RFC 2435 RTP/JPEG 打包, 只依赖标准C, 不访问网络
+
+#define RTP_JPEG_PAYLOAD_TYPE 26
+#define RTP_HEADER_LEN 12
+#define RTP_JPEG_HEADER_LEN 8
+#define RTP_JPEG_QTABLE_HEADER_LEN 4
+#define RTP_JPEG_CLOCK_RATE 90000
+
+// 从基线JPEG里解析出 RTP/JPEG 需要的字段, 指针都指向原始JPEG内部
+typedef struct {
+    uint8_t type;               // 0: YUV 4:2:2 (h2v1), 1: YUV 4:2:0 (h2v2)
+    uint16_t width;
+    uint16_t height;
+    const uint8_t *qtables[2];  // 亮度/色度量化表, 各64字节, JPEG zigzag 顺序
+    uint8_t qtable_count;
+    const uint8_t *scan;        // SOS 段之后的熵编码数据, 不含 EOI
+    size_t scan_len;
+} rtp_jpeg_info_t;
+
+// 解析JPEG; 不支持的格式(非基线、非8位量化表、没有亮度量化表、带重启标记、尺寸超过2040)返回 ESP_ERR_NOT_SUPPORTED
+esp_err_t rtp_jpeg_parse(const uint8_t *jpeg, size_t len, rtp_jpeg_info_t *info);
+
+typedef struct {
+    uint32_t ssrc;
+    uint16_t seq;               // 下一个包的序号, 每发一个包加1
+    size_t mtu;                 // 单个UDP负载上限(含RTP头)
+} rtp_jpeg_packetizer_t;
+
+// 每生成一个包调用一次; 返回非 ESP_OK 时停止打包这一帧
+typedef esp_err_t (*rtp_jpeg_emit_t)(const uint8_t *pkt, size_t len, void *arg);
+
+// 把一帧JPEG打成若干RTP包, 最后一个包置 marker 位
+// 量化表以 Q=255 放在第一个包里, 接收端不需要事先知道质量参数
+// pkt_buf 至少 mtu 字节
+esp_err_t rtp_jpeg_packetize(rtp_jpeg_packetizer_t *p, const uint8_t *jpeg, size_t len, uint32_t timestamp,
+                             uint8_t *pkt_buf, rtp_jpeg_emit_t emit, void *arg);
+
+#endif
@@ -0,0 +1,223 @@
+#include "rtp_stream.h"
+#include "rtp_jpeg.h"
+#include "frame_broadcast.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "lwip/sockets.h"
+#include "lwip/inet.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "RTP_STREAM";
+
+typedef struct {
+    int sock;
+    struct sockaddr_in dest;
+    uint32_t send_errors;
+} rtp_sender_t;
+
+// 任务还没退出之前 s_task_handle 一直保留, 同一时间最多只有一个推流任务
+static TaskHandle_t s_task_handle = NULL;
+static SemaphoreHandle_t s_task_done = NULL;
+static volatile bool s_running = false;
+// 由 rtp_stream_start 准备好交给任务, 任务退出时释放
+static rtp_sender_t s_sender = {.sock = -1};
+static int s_sub = -1;
+static uint8_t s_pkt_buf[RTP_STREAM_MTU];
+
+static esp_err_t rtp_emit(const uint8_t *pkt, size_t len, void *arg)
+{
+    rtp_sender_t *sender = (rtp_sender_t *)arg;
+    if (sendto(sender->sock, pkt, len, 0, (struct sockaddr *)&sender->dest, sizeof(sender->dest)) < 0) {
+        // 发送缓冲不够时放弃这一帧剩下的包, 接收端靠 marker/偏移发现不完整并丢弃
+        sender->send_errors++;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static void rtp_stream_task(void *pvParameters)
+{
+    rtp_sender_t sender = s_sender;
+    int sub = s_sub;
+    rtp_jpeg_packetizer_t packetizer = {
+        .ssrc = esp_random(),
+        .seq = (uint16_t)esp_random(),
+        .mtu = RTP_STREAM_MTU,
+    };
+    uint32_t last_seq = 0;
+    size_t frames_sent = 0;
+    size_t frames_dropped = 0;
+
+    ESP_LOGI(TAG, "RTP推流开始 -> %s:%u", inet_ntoa(sender.dest.sin_addr), ntohs(sender.dest.sin_port));
+
+    while (s_running) {
+        broadcast_frame_t *frame = frame_broadcast_acquire(sub, last_seq, 500 / portTICK_PERIOD_MS);
+        if (!frame) {
+            continue;
+        }
+        last_seq = frame->seq;
+
+        // RTP 时间戳用 90kHz 时钟, 取自帧开始时间
+        const camera_fb_t *fb = frame->fb;
+        uint64_t us = (uint64_t)fb->timestamp.tv_sec * 1000000ULL + fb->timestamp.tv_usec;
+        uint32_t rtp_ts = (uint32_t)(us * (RTP_JPEG_CLOCK_RATE / 1000) / 1000);
+
+        esp_err_t err = rtp_jpeg_packetize(&packetizer, fb->buf, fb->len, rtp_ts, s_pkt_buf, rtp_emit, &sender);
+        frame_broadcast_release(frame);
+
+        if (err == ESP_OK) {
+            frames_sent++;
+        } else {
+            frames_dropped++;
+            if (err != ESP_FAIL) {
+                ESP_LOGW(TAG, "无法打包该JPEG: %s", esp_err_to_name(err));
+            }
+        }
+        if ((frames_sent + frames_dropped) % 100 == 0) {
+            ESP_LOGI(TAG, "RTP已发送 %zu 帧, 丢弃 %zu 帧, 发送错误 %lu",
+                     frames_sent, frames_dropped, (unsigned long)sender.send_errors);
+        }
+    }
+
+    frame_broadcast_unsubscribe(sub);
+    close(sender.sock);
+    ESP_LOGI(TAG, "RTP推流结束");
+    xSemaphoreGive(s_task_done);
+    vTaskDelete(NULL);
+}
+
+esp_err_t rtp_stream_start(const char *host, uint16_t port)
+{
+    struct sockaddr_in dest = {0};
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(port);
+    if (!host || port == 0 || inet_aton(host, &dest.sin_addr) == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!s_task_done) {
+        s_task_done = xSemaphoreCreateBinary();
+        if (!s_task_done) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    rtp_stream_stop();
+    if (s_task_handle) {
+        // 旧任务还卡在发送里, 两个任务会共用 s_pkt_buf, 等它退出后再开始
+        ESP_LOGW(TAG, "上一个RTP任务还没有退出");
+        return ESP_ERR_INVALID_STATE;
+    }
+    // 旧任务早已自己退出(如 socket 出错)时留下的通知, 不能让下一次 stop 提前返回
+    xSemaphoreTake(s_task_done, 0);
+
+    // socket 和订阅在这里准备好, 失败时请求方能拿到错误
+    s_sub = frame_broadcast_subscribe();
+    if (s_sub < 0) {
+        ESP_LOGW(TAG, "观看人数已满，无法开始RTP推流");
+        return ESP_ERR_NO_MEM;
+    }
+    s_sender = (rtp_sender_t) {
+        .sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP),
+        .dest = dest,
+    };
+    if (s_sender.sock < 0) {
+        ESP_LOGE(TAG, "创建UDP socket失败: errno %d", errno);
+        frame_broadcast_unsubscribe(s_sub);
+        return ESP_FAIL;
+    }
+
+    s_running = true;
+    if (xTaskCreatePinnedToCore(rtp_stream_task, "rtp_stream", 4096, NULL, 5, &s_task_handle, 1) != pdPASS) {
+        s_running = false;
+        s_task_handle = NULL;
+        close(s_sender.sock);
+        frame_broadcast_unsubscribe(s_sub);
+        ESP_LOGE(TAG, "创建RTP任务失败");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void rtp_stream_stop(void)
+{
+    if (!s_task_handle) {
+        return;
+    }
+    s_running = false;
+    // 任务最长阻塞在 frame_broadcast_acquire 的超时上; 确认退出之前保留句柄
+    if (xSemaphoreTake(s_task_done, 2000 / portTICK_PERIOD_MS) != pdTRUE) {
+        ESP_LOGW(TAG, "等待RTP任务退出超时");
+        return;
+    }
+    s_task_handle = NULL;
+}
+
+bool rtp_stream_is_running(void)
+{
+    return s_running;
+}
+
+static esp_err_t rtp_control_handler(httpd_req_t *req)
+{
+    char query[96] = {0};
+    char action[8] = {0};
+    char host[16] = {0};
+    char port_str[8] = {0};
+    char resp[96];
+    uint16_t port = RTP_STREAM_DEFAULT_PORT;
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    httpd_query_key_value(query, "action", action, sizeof(action));
+    httpd_resp_set_type(req, "text/plain");
+
+    if (strcmp(action, "stop") == 0) {
+        rtp_stream_stop();
+        return httpd_resp_sendstr(req, "stopped\n");
+    }
+    if (strcmp(action, "start") != 0) {
+        snprintf(resp, sizeof(resp), "%s\n", rtp_stream_is_running() ? "running" : "stopped");
+        return httpd_resp_sendstr(req, resp);
+    }
+
+    if (httpd_query_key_value(query, "port", port_str, sizeof(port_str)) == ESP_OK) {
+        port = (uint16_t)atoi(port_str);
+    }
+    if (httpd_query_key_value(query, "host", host, sizeof(host)) != ESP_OK) {
+        // 没指定目标时推给发起请求的客户端
+        struct sockaddr_in6 peer;
+        socklen_t peer_len = sizeof(peer);
+        if (getpeername(httpd_req_to_sockfd(req), (struct sockaddr *)&peer, &peer_len) == 0) {
+            if (peer.sin6_family == AF_INET6) {
+                // IPv4 映射地址 ::ffff:a.b.c.d
+                inet_ntop(AF_INET, &peer.sin6_addr.s6_addr[12], host, sizeof(host));
+            } else {
+                inet_ntop(AF_INET, &((struct sockaddr_in *)&peer)->sin_addr, host, sizeof(host));
+            }
+        }
+    }
+
+    esp_err_t err = rtp_stream_start(host, port);
+    if (err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_set_status(req, "400 Bad Request");
+        return httpd_resp_sendstr(req, "invalid host or port\n");
+    }
+    if (err != ESP_OK) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        snprintf(resp, sizeof(resp), "cannot start: %s\n", esp_err_to_name(err));
+        return httpd_resp_sendstr(req, resp);
+    }
+    snprintf(resp, sizeof(resp), "streaming to %s:%u\n", host, port);
+    return httpd_resp_sendstr(req, resp);
+}
+
+esp_err_t rtp_stream_register(httpd_handle_t server)
+{
+    httpd_uri_t rtp_uri = {.uri = "/rtp", .method = HTTP_GET, .handler = rtp_control_handler};
+    return httpd_register_uri_handler(server, &rtp_uri);
+}
@@ -0,0 +1,29 @@
+#ifndef RTP_STREAM_H
+#define RTP_STREAM_H
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// RTP/JPEG over UDP 推流, 与 /stream 共用同一个采集广播
+// 丢包只会丢掉那一帧, 不会像TCP那样卡住后面的帧
+
+#define RTP_STREAM_DEFAULT_PORT 5004
+// 单个UDP包的负载上限, 留出IP/UDP头, 避免在热点上分片
+#define RTP_STREAM_MTU 1400
+
+// 开始向 host:port 推流, 已经在推流时先停止再切换到新目标
+// 返回 ESP_ERR_INVALID_ARG: 地址或端口无效; ESP_ERR_NO_MEM: 观看人数已满;
+// ESP_ERR_INVALID_STATE: 上一个推流任务还没有退出
+esp_err_t rtp_stream_start(const char *host, uint16_t port);
+// 等推流任务退出, 超时后任务仍算在运行, 下一次 start 会再等
+void rtp_stream_stop(void);
+bool rtp_stream_is_running(void);
+
+// 注册控制端点:
+//   GET /rtp?action=start[&host=IP][&port=N]  不带host时推给请求方
+//   GET /rtp?action=stop
+esp_err_t rtp_stream_register(httpd_handle_t server);
+
+#endif
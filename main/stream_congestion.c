@@ -0,0 +1,78 @@
+#include "stream_congestion.h"
+#include "sdkconfig.h"
+
+// writev 阻塞超过这个时间才认为发送缓冲已满, 采样才有意义
+#define BLOCKED_THRESHOLD_US 2000
+
+// TCP 发送缓冲大小, 缓冲满时积压至少是这么多
+#ifdef CONFIG_LWIP_TCP_SND_BUF_DEFAULT
+#define SND_BUF_BYTES CONFIG_LWIP_TCP_SND_BUF_DEFAULT
+#else
+#define SND_BUF_BYTES 5760
+#endif
+
+static uint32_t clamp_rate(uint64_t rate)
+{
+    if (rate < STREAM_MIN_RATE_BPS) {
+        return STREAM_MIN_RATE_BPS;
+    }
+    if (rate > STREAM_MAX_RATE_BPS) {
+        return STREAM_MAX_RATE_BPS;
+    }
+    return (uint32_t)rate;
+}
+
+// 按估算速度把积压排空到 now_us
+static void drain(stream_congestion_t *cc, int64_t now_us)
+{
+    if (now_us <= cc->last_us) {
+        return;
+    }
+    uint64_t drained = (uint64_t)cc->rate_bps * (uint64_t)(now_us - cc->last_us) / 1000000;
+    cc->backlog = drained >= cc->backlog ? 0 : cc->backlog - (uint32_t)drained;
+    cc->last_us = now_us;
+}
+
+void stream_congestion_init(stream_congestion_t *cc, int64_t now_us, uint32_t max_delay_ms)
+{
+    cc->rate_bps = STREAM_INITIAL_RATE_BPS;
+    cc->backlog = 0;
+    cc->last_us = now_us;
+    cc->max_delay_ms = max_delay_ms ? max_delay_ms : STREAM_MAX_QUEUE_DELAY_MS;
+}
+
+bool stream_congestion_should_send(stream_congestion_t *cc, size_t len, int64_t now_us)
+{
+    drain(cc, now_us);
+    // 积压为0时总是发送, 否则慢链路上的大帧永远发不出去
+    if (cc->backlog == 0) {
+        return true;
+    }
+    uint64_t delay_ms = ((uint64_t)cc->backlog + len) * 1000 / cc->rate_bps;
+    return delay_ms <= cc->max_delay_ms;
+}
+
+void stream_congestion_on_sent(stream_congestion_t *cc, size_t len, int64_t start_us, int64_t end_us)
+{
+    drain(cc, start_us);
+    int64_t blocked_us = end_us - start_us;
+
+    if (blocked_us > BLOCKED_THRESHOLD_US) {
+        // 缓冲满了: 阻塞期间写入的字节数就是链路排空的量, 按 1/4 权重平滑
+        uint64_t sample = (uint64_t)len * 1000000 / blocked_us;
+        cc->rate_bps = clamp_rate(((uint64_t)cc->rate_bps * 3 + sample) / 4);
+        cc->backlog = SND_BUF_BYTES;
+    } else {
+        // 整帧直接进了缓冲, 链路跟得上, 慢慢上调估算速度去试探更高帧率
+        cc->backlog += len;
+        cc->rate_bps = clamp_rate((uint64_t)cc->rate_bps + cc->rate_bps / 8);
+    }
+    cc->last_us = end_us;
+}
+
+void stream_congestion_on_timeout(stream_congestion_t *cc, int64_t now_us)
+{
+    cc->rate_bps = clamp_rate(cc->rate_bps / 2);
+    cc->backlog = SND_BUF_BYTES;
+    cc->last_us = now_us;
+}
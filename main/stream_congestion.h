@@ -0,0 +1,50 @@
+#ifndef STREAM_CONGESTION_H
+#define STREAM_CONGESTION_H
+
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 按链路实际排空速度决定每帧发不发, 代替固定的跳帧数/大小阈值/帧间延时
+//
+// lwip 的 socket 接口拿不到发送缓冲里还没发出去的字节数, 所以用 writev 的阻塞时间估算:
+// writev 阻塞说明发送缓冲已满, 这段时间内被接收的字节数就是链路排空的速度.
+// 在此基础上维护一个"虚拟积压"(已写入但估计还没送达的字节), 按估算速度随时间排空,
+// 预测新帧的排队时延超过上限时跳过这一帧.
+
+// 默认允许的最大排队时延, 越小延迟越低, 越大帧率越高
+// 在 menuconfig 里设置, 单个客户端可以用 /stream?max_delay_ms=N 覆盖
+#ifdef CONFIG_STREAM_MAX_QUEUE_DELAY_MS
+#define STREAM_MAX_QUEUE_DELAY_MS CONFIG_STREAM_MAX_QUEUE_DELAY_MS
+#else
+#define STREAM_MAX_QUEUE_DELAY_MS 150
+#endif
+// max_delay_ms 参数的取值范围, 与 Kconfig 一致
+#define STREAM_MIN_QUEUE_DELAY_LIMIT_MS 20
+#define STREAM_MAX_QUEUE_DELAY_LIMIT_MS 5000
+// 初始估算速度, 连接刚建立时用
+#define STREAM_INITIAL_RATE_BPS (100 * 1024)
+#define STREAM_MIN_RATE_BPS (8 * 1024)
+#define STREAM_MAX_RATE_BPS (4 * 1024 * 1024)
+
+typedef struct {
+    uint32_t rate_bps;          // 估算的排空速度 (字节/秒)
+    uint32_t backlog;           // 虚拟积压字节数
+    int64_t last_us;            // 上次更新积压的时间
+    uint32_t max_delay_ms;      // 允许的最大排队时延
+} stream_congestion_t;
+
+// max_delay_ms 为 0 时使用 STREAM_MAX_QUEUE_DELAY_MS
+void stream_congestion_init(stream_congestion_t *cc, int64_t now_us, uint32_t max_delay_ms);
+
+// 这一帧现在发出去, 预测排队时延是否在上限内
+bool stream_congestion_should_send(stream_congestion_t *cc, size_t len, int64_t now_us);
+
+// 一帧写完: start_us/end_us 为 writev 开始和返回的时间
+void stream_congestion_on_sent(stream_congestion_t *cc, size_t len, int64_t start_us, int64_t end_us);
+
+// 发送超时(一个字节都没写出去): 速度减半
+void stream_congestion_on_timeout(stream_congestion_t *cc, int64_t now_us);
+
+#endif
@@ -0,0 +1,242 @@
+#include "stream_metrics.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "stream_senders.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "METRICS";
+
+// 直方图桶上限(微秒), 最后还有一个 +Inf 桶
+static const int64_t s_bucket_us[] = {
+    1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000,
+};
+static const char *s_bucket_le[] = {
+    "0.001", "0.002", "0.005", "0.01", "0.02", "0.05", "0.1", "0.2", "0.5", "1",
+};
+#define BUCKET_COUNT (sizeof(s_bucket_us) / sizeof(s_bucket_us[0]))
+
+static const char *s_stage_names[STREAM_STAGE_COUNT] = {
+    "dma_done", "take", "first_byte", "last_byte",
+};
+static const char *s_drop_names[STREAM_DROP_COUNT] = {
+    "skip", "send_failure",
+};
+
+// 桶内计数不累加, 输出时再转换成 Prometheus 要求的累计值
+typedef struct {
+    atomic_uint_least32_t buckets[BUCKET_COUNT + 1];
+    atomic_uint_least64_t sum_us;
+    atomic_uint_least32_t count;
+} histogram_t;
+
+static histogram_t s_hist[STREAM_STAGE_COUNT];
+static atomic_uint_least32_t s_drops[STREAM_DROP_COUNT];
+static atomic_uint_least32_t s_frames_total;
+static atomic_uint_least64_t s_bytes_total;
+
+// 1秒滑动窗口算帧率和码率, 抢到窗口切换的那个任务负责更新
+#define RATE_WINDOW_US 1000000
+static atomic_int_least64_t s_window_start;
+static atomic_uint_least32_t s_window_frames;
+static atomic_uint_least32_t s_window_bytes;
+static atomic_uint_least32_t s_fps_milli;       // 帧率 x1000
+static atomic_uint_least32_t s_bytes_per_sec;
+
+static void histogram_observe(histogram_t *h, int64_t us)
+{
+    if (us < 0) {
+        us = 0;
+    }
+    size_t i = 0;
+    while (i < BUCKET_COUNT && us > s_bucket_us[i]) {
+        i++;
+    }
+    atomic_fetch_add_explicit(&h->buckets[i], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_us, (uint64_t)us, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+}
+
+static void rate_update(int64_t now, size_t bytes)
+{
+    atomic_fetch_add_explicit(&s_window_frames, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_window_bytes, bytes, memory_order_relaxed);
+
+    int64_t start = atomic_load_explicit(&s_window_start, memory_order_relaxed);
+    if (start == 0) {
+        atomic_compare_exchange_strong(&s_window_start, &start, now);
+        return;
+    }
+    int64_t elapsed = now - start;
+    if (elapsed < RATE_WINDOW_US || !atomic_compare_exchange_strong(&s_window_start, &start, now)) {
+        return;
+    }
+    uint32_t frames = atomic_exchange(&s_window_frames, 0);
+    uint32_t window_bytes = atomic_exchange(&s_window_bytes, 0);
+    atomic_store(&s_fps_milli, (uint32_t)((uint64_t)frames * 1000000000ULL / elapsed));
+    atomic_store(&s_bytes_per_sec, (uint32_t)((uint64_t)window_bytes * 1000000ULL / elapsed));
+}
+
+void stream_metrics_frame_sent(const camera_fb_t *fb, int64_t first_byte_us, int64_t last_byte_us, size_t bytes)
+{
+    int64_t start_us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+
+    if (fb->eof_us) {
+        histogram_observe(&s_hist[STREAM_STAGE_DMA_DONE], fb->eof_us - start_us);
+    }
+    if (fb->take_us) {
+        histogram_observe(&s_hist[STREAM_STAGE_TAKE], fb->take_us - start_us);
+    }
+    histogram_observe(&s_hist[STREAM_STAGE_FIRST_BYTE], first_byte_us - start_us);
+    histogram_observe(&s_hist[STREAM_STAGE_LAST_BYTE], last_byte_us - start_us);
+
+    atomic_fetch_add_explicit(&s_frames_total, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_bytes_total, bytes, memory_order_relaxed);
+    rate_update(last_byte_us, bytes);
+}
+
+void stream_metrics_drop(stream_drop_t reason)
+{
+    if (reason < STREAM_DROP_COUNT) {
+        atomic_fetch_add_explicit(&s_drops[reason], 1, memory_order_relaxed);
+    }
+}
+
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
+    char buf[512];
+    int len;
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+    len = snprintf(buf, sizeof(buf),
+                   "# HELP esp32cam_frame_latency_seconds Time from frame start (VSYNC) to each pipeline stage\n"
+                   "# TYPE esp32cam_frame_latency_seconds histogram\n");
+    httpd_resp_send_chunk(req, buf, len);
+
+    for (int s = 0; s < STREAM_STAGE_COUNT; s++) {
+        const histogram_t *h = &s_hist[s];
+        uint32_t cumulative = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; i++) {
+            cumulative += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+            len = snprintf(buf, sizeof(buf),
+                           "esp32cam_frame_latency_seconds_bucket{stage=\"%s\",le=\"%s\"} %lu\n",
+                           s_stage_names[s], s_bucket_le[i], (unsigned long)cumulative);
+            httpd_resp_send_chunk(req, buf, len);
+        }
+        cumulative += atomic_load_explicit(&h->buckets[BUCKET_COUNT], memory_order_relaxed);
+        uint64_t sum_us = atomic_load_explicit(&h->sum_us, memory_order_relaxed);
+        len = snprintf(buf, sizeof(buf),
+                       "esp32cam_frame_latency_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %lu\n"
+                       "esp32cam_frame_latency_seconds_sum{stage=\"%s\"} %llu.%06llu\n"
+                       "esp32cam_frame_latency_seconds_count{stage=\"%s\"} %lu\n",
+                       s_stage_names[s], (unsigned long)cumulative,
+                       s_stage_names[s], (unsigned long long)(sum_us / 1000000), (unsigned long long)(sum_us % 1000000),
+                       s_stage_names[s], (unsigned long)atomic_load(&h->count));
+        httpd_resp_send_chunk(req, buf, len);
+    }
+
+    len = snprintf(buf, sizeof(buf),
+                   "# HELP esp32cam_frame_drops_total Frames not sent, by reason\n"
+                   "# TYPE esp32cam_frame_drops_total counter\n");
+    httpd_resp_send_chunk(req, buf, len);
+    for (int d = 0; d < STREAM_DROP_COUNT; d++) {
+        len = snprintf(buf, sizeof(buf), "esp32cam_frame_drops_total{reason=\"%s\"} %lu\n",
+                       s_drop_names[d], (unsigned long)atomic_load(&s_drops[d]));
+        httpd_resp_send_chunk(req, buf, len);
+    }
+
+    // 超过两个窗口没有发帧, 速率按0输出
+    int64_t idle_us = esp_timer_get_time() - atomic_load(&s_window_start);
+    uint32_t fps_milli = idle_us > 2 * RATE_WINDOW_US ? 0 : atomic_load(&s_fps_milli);
+    uint32_t bps = idle_us > 2 * RATE_WINDOW_US ? 0 : atomic_load(&s_bytes_per_sec);
+    len = snprintf(buf, sizeof(buf),
+                   "# TYPE esp32cam_frames_sent_total counter\n"
+                   "esp32cam_frames_sent_total %lu\n"
+                   "# TYPE esp32cam_bytes_sent_total counter\n"
+                   "esp32cam_bytes_sent_total %llu\n"
+                   "# TYPE esp32cam_fps gauge\n"
+                   "esp32cam_fps %lu.%03lu\n"
+                   "# TYPE esp32cam_bytes_per_second gauge\n"
+                   "esp32cam_bytes_per_second %lu\n",
+                   (unsigned long)atomic_load(&s_frames_total),
+                   (unsigned long long)atomic_load(&s_bytes_total),
+                   (unsigned long)(fps_milli / 1000), (unsigned long)(fps_milli % 1000),
+                   (unsigned long)bps);
+    httpd_resp_send_chunk(req, buf, len);
+
+    // 驱动侧的丢帧原因, 和上面发送侧的丢帧一起定位帧率损失在哪一环
+    camera_stats_t cam;
+    if (esp_camera_get_stats(&cam) == ESP_OK) {
+        len = snprintf(buf, sizeof(buf),
+                       "# HELP esp32cam_driver_frames_total Frames started and delivered by the camera driver\n"
+                       "# TYPE esp32cam_driver_frames_total counter\n"
+                       "esp32cam_driver_frames_total{state=\"started\"} %lu\n"
+                       "esp32cam_driver_frames_total{state=\"delivered\"} %lu\n"
+                       "esp32cam_driver_frames_total{state=\"repaired\"} %lu\n"
+                       "# TYPE esp32cam_driver_queue_depth gauge\n"
+                       "esp32cam_driver_queue_depth %lu\n"
+                       "# TYPE esp32cam_driver_dma_resets_total counter\n"
+                       "esp32cam_driver_dma_resets_total %lu\n",
+                       (unsigned long)cam.frames_started, (unsigned long)cam.frames_delivered,
+                       (unsigned long)cam.repaired,
+                       (unsigned long)cam.queue_depth, (unsigned long)cam.dma_resets);
+        httpd_resp_send_chunk(req, buf, len);
+        // 自适应 JPEG 帧缓冲的当前大小和重新分配次数
+        len = snprintf(buf, sizeof(buf),
+                       "# TYPE esp32cam_driver_fb_bytes gauge\n"
+                       "esp32cam_driver_fb_bytes %lu\n"
+                       "# TYPE esp32cam_driver_fb_resizes_total counter\n"
+                       "esp32cam_driver_fb_resizes_total %lu\n",
+                       (unsigned long)cam.fb_size, (unsigned long)cam.fb_resizes);
+        httpd_resp_send_chunk(req, buf, len);
+
+        const struct {
+            const char *name;
+            uint32_t value;
+        } cam_drops[] = {
+            {"fb_overflow", cam.fb_overflow},
+            {"no_soi", cam.no_soi},
+            {"no_eoi", cam.no_eoi},
+            {"bad_size", cam.bad_size},
+            {"event_overflow", cam.event_overflow},
+            {"queue_evicted", cam.queue_evicted},
+            {"queue_dropped", cam.queue_dropped},
+            {"no_free_fb", cam.no_free_fb},
+        };
+        len = snprintf(buf, sizeof(buf),
+                       "# HELP esp32cam_driver_drops_total Frames lost in the camera driver, by reason\n"
+                       "# TYPE esp32cam_driver_drops_total counter\n");
+        httpd_resp_send_chunk(req, buf, len);
+        for (size_t i = 0; i < sizeof(cam_drops) / sizeof(cam_drops[0]); i++) {
+            len = snprintf(buf, sizeof(buf), "esp32cam_driver_drops_total{reason=\"%s\"} %lu\n",
+                           cam_drops[i].name, (unsigned long)cam_drops[i].value);
+            httpd_resp_send_chunk(req, buf, len);
+        }
+    }
+
+    // 每个推流发送任务当前客户端落后最新帧的帧数
+    stream_sender_stats_t senders[STREAM_SENDER_COUNT];
+    size_t n = stream_senders_get_stats(senders, STREAM_SENDER_COUNT);
+    len = snprintf(buf, sizeof(buf), "# TYPE esp32cam_sender_queue_depth gauge\n");
+    httpd_resp_send_chunk(req, buf, len);
+    for (size_t i = 0; i < n; i++) {
+        len = snprintf(buf, sizeof(buf),
+                       "esp32cam_sender_queue_depth{sender=\"%u\",fd=\"%d\"} %lu\n",
+                       (unsigned)i, senders[i].fd, (unsigned long)senders[i].queue_depth);
+        httpd_resp_send_chunk(req, buf, len);
+    }
+
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+esp_err_t stream_metrics_register(httpd_handle_t server)
+{
+    httpd_uri_t metrics_uri = {.uri = "/metrics", .method = HTTP_GET, .handler = metrics_handler};
+    esp_err_t err = httpd_register_uri_handler(server, &metrics_uri);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "注册 /metrics 失败: %s", esp_err_to_name(err));
+    }
+    return err;
+}
@@ -0,0 +1,36 @@
+#ifndef STREAM_METRICS_H
+#define STREAM_METRICS_H
+
+#include "esp_err.h"
+#include "esp_camera.h"
+#include "esp_http_server.h"
+#include <stdint.h>
+
+// 推流指标: 各阶段延迟直方图 + 帧率/丢帧/码率, 以 Prometheus 文本格式在 /metrics 输出
+// 所有记录函数只做原子加法, 可以在任意任务里并发调用, 不加锁
+
+// 各阶段相对帧开始(fb->timestamp, 即VSYNC后第一个DMA缓冲)的耗时
+typedef enum {
+    STREAM_STAGE_DMA_DONE = 0,      // cam_task 收齐整帧
+    STREAM_STAGE_TAKE,              // cam_take 把帧交给应用
+    STREAM_STAGE_FIRST_BYTE,        // 第一个字节写进socket
+    STREAM_STAGE_LAST_BYTE,         // 最后一个字节写进socket
+    STREAM_STAGE_COUNT,
+} stream_stage_t;
+
+typedef enum {
+    STREAM_DROP_SKIP = 0,           // 跳帧策略主动丢弃
+    STREAM_DROP_SEND_FAIL,          // 发送超时或失败
+    STREAM_DROP_COUNT,
+} stream_drop_t;
+
+// 一帧发送完成: 记录全部阶段延迟, 以及帧数/字节数
+// first_byte_us/last_byte_us 为 esp_timer_get_time() 时间
+void stream_metrics_frame_sent(const camera_fb_t *fb, int64_t first_byte_us, int64_t last_byte_us, size_t bytes);
+
+void stream_metrics_drop(stream_drop_t reason);
+
+// 在 server 上注册 GET /metrics
+esp_err_t stream_metrics_register(httpd_handle_t server);
+
+#endif
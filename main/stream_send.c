@@ -0,0 +1,100 @@
+#include "stream_send.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include <sys/uio.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "STREAM_SEND";
+
+#define STREAM_HTTP_HEADER \
+    "HTTP/1.1 200 OK\r\n" \
+    "Content-Type: multipart/x-mixed-replace;boundary=123456789000000000000987654321\r\n" \
+    "Access-Control-Allow-Origin: *\r\n" \
+    "Cache-Control: no-cache, no-store, must-revalidate\r\n" \
+    "Pragma: no-cache\r\n" \
+    "Connection: close\r\n" \
+    "\r\n"
+#define STREAM_BOUNDARY "\r\n--123456789000000000000987654321\r\n"
+#define STREAM_PART "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n"
+#define STREAM_PART_NO_LENGTH "Content-Type: image/jpeg\r\n\r\n"
+
+// 循环 writev 直到全部写完, 处理部分写入
+// first_byte_us 不为 NULL 时记录第一次写出数据的时间
+static esp_err_t stream_writev_all(int fd, struct iovec *iov, int iovcnt, int64_t *first_byte_us)
+{
+    size_t written = 0;
+
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && written == 0) {
+                // 发送缓冲区一直满, 但这一帧还没写出任何字节, 流仍然完整
+                return ESP_ERR_TIMEOUT;
+            }
+            ESP_LOGD(TAG, "writev失败: errno %d, 已写 %zu 字节", errno, written);
+            return ESP_FAIL;
+        }
+        if (written == 0 && n > 0 && first_byte_us) {
+            *first_byte_us = esp_timer_get_time();
+        }
+        written += n;
+
+        // 跳过已经写完的 iov, 调整写了一半的那个
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t stream_send_http_header(int fd)
+{
+    struct iovec iov = {
+        .iov_base = (void *)STREAM_HTTP_HEADER,
+        .iov_len = strlen(STREAM_HTTP_HEADER),
+    };
+    return stream_writev_all(fd, &iov, 1, NULL);
+}
+
+esp_err_t stream_send_frame(int fd, const camera_fb_t *fb, int64_t *first_byte_us)
+{
+    char part_buf[64];
+    int hlen = snprintf(part_buf, sizeof(part_buf), STREAM_PART, (unsigned)fb->len);
+
+    struct iovec iov[3] = {
+        {.iov_base = (void *)STREAM_BOUNDARY, .iov_len = strlen(STREAM_BOUNDARY)},
+        {.iov_base = part_buf, .iov_len = hlen},
+        {.iov_base = fb->buf, .iov_len = fb->len},
+    };
+    return stream_writev_all(fd, iov, 3, first_byte_us);
+}
+
+esp_err_t stream_send_part_header(int fd)
+{
+    struct iovec iov[2] = {
+        {.iov_base = (void *)STREAM_BOUNDARY, .iov_len = strlen(STREAM_BOUNDARY)},
+        {.iov_base = (void *)STREAM_PART_NO_LENGTH, .iov_len = strlen(STREAM_PART_NO_LENGTH)},
+    };
+    return stream_writev_all(fd, iov, 2, NULL);
+}
+
+esp_err_t stream_send_data(int fd, const uint8_t *data, size_t len, int64_t *first_byte_us)
+{
+    struct iovec iov = {
+        .iov_base = (void *)data,
+        .iov_len = len,
+    };
+    return stream_writev_all(fd, &iov, 1, first_byte_us);
+}
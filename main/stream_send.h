@@ -0,0 +1,25 @@
+#ifndef STREAM_SEND_H
+#define STREAM_SEND_H
+
+#include "esp_err.h"
+#include "esp_camera.h"
+
+// MJPEG 直接写 socket 的发送路径, 不经过 httpd 的 chunked 编码
+
+// 发送 multipart 响应头, 之后连接只用于推流, 结束时由服务器关闭
+esp_err_t stream_send_http_header(int fd);
+
+// 用一次 writev 发送 边界 + 部分头 + JPEG 数据, 直接从 fb->buf 发送不拷贝
+// 返回 ESP_ERR_TIMEOUT 表示发送超时且未写出任何字节, 可以重试;
+// 返回 ESP_FAIL 表示连接已断开或帧只发出了一部分, 必须关闭连接
+// first_byte_us 可为 NULL, 否则填入第一个字节写进socket的时间(esp_timer_get_time)
+esp_err_t stream_send_frame(int fd, const camera_fb_t *fb, int64_t *first_byte_us);
+
+// 低延迟模式: 帧长度还不知道, 只发 边界 + 不带 Content-Length 的部分头, 客户端按边界分帧
+// 返回值同 stream_send_frame
+esp_err_t stream_send_part_header(int fd);
+
+// 发送帧的一段数据, 返回 ESP_ERR_TIMEOUT 时这一段一个字节都没写出去
+esp_err_t stream_send_data(int fd, const uint8_t *data, size_t len, int64_t *first_byte_us);
+
+#endif
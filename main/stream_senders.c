@@ -0,0 +1,175 @@
+#include "stream_senders.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "STREAM_SENDER";
+
+typedef struct {
+    TaskHandle_t task;
+    httpd_req_t *req;           // 异步请求副本, 空闲时为 NULL
+    stream_sender_fn_t fn;
+    stream_sender_stats_t stats;
+} stream_sender_t;
+
+static stream_sender_t s_senders[STREAM_SENDER_COUNT];
+static SemaphoreHandle_t s_lock = NULL;
+static SemaphoreHandle_t s_exited = NULL;   // 计数信号量, 每个任务退出时加1
+static volatile bool s_stopping = false;
+static bool s_started = false;
+
+static void stream_sender_task(void *pvParameters)
+{
+    stream_sender_t *sender = (stream_sender_t *)pvParameters;
+
+    while (!s_stopping) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        httpd_req_t *req = sender->req;
+        stream_sender_fn_t fn = sender->fn;
+        xSemaphoreGive(s_lock);
+        if (!req) {
+            continue;
+        }
+
+        esp_err_t res = fn(req, &sender->stats);
+        if (res != ESP_OK) {
+            // 同步处理时返回失败会让httpd关闭连接, 异步请求需要自己触发
+            httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
+        }
+        httpd_req_async_handler_complete(req);
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        sender->req = NULL;
+        sender->stats.fd = -1;
+        sender->stats.queue_depth = 0;
+        xSemaphoreGive(s_lock);
+    }
+
+    xSemaphoreGive(s_exited);
+    vTaskDelete(NULL);
+}
+
+esp_err_t stream_senders_start(void)
+{
+    if (s_started) {
+        return ESP_OK;
+    }
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+        s_exited = xSemaphoreCreateCounting(STREAM_SENDER_COUNT, 0);
+        if (!s_lock || !s_exited) {
+            ESP_LOGE(TAG, "创建信号量失败");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    s_stopping = false;
+    for (int i = 0; i < STREAM_SENDER_COUNT; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "stream_tx%d", i);
+        memset(&s_senders[i], 0, sizeof(s_senders[i]));
+        s_senders[i].stats.fd = -1;
+        if (xTaskCreatePinnedToCore(stream_sender_task, name, STREAM_SENDER_STACK_SIZE, &s_senders[i],
+                                    STREAM_SENDER_PRIORITY, &s_senders[i].task, STREAM_SENDER_CORE) != pdPASS) {
+            ESP_LOGE(TAG, "创建发送任务 %d 失败", i);
+            s_started = true;
+            stream_senders_stop();
+            return ESP_FAIL;
+        }
+    }
+    s_started = true;
+#if CONFIG_STREAM_SENDER_NO_AFFINITY
+    ESP_LOGI(TAG, "%d 个推流发送任务已启动 (不绑定核心, 优先级 %d)", STREAM_SENDER_COUNT, STREAM_SENDER_PRIORITY);
+#else
+    ESP_LOGI(TAG, "%d 个推流发送任务已启动 (核心 %d, 优先级 %d)", STREAM_SENDER_COUNT, STREAM_SENDER_CORE,
+             STREAM_SENDER_PRIORITY);
+#endif
+    return ESP_OK;
+}
+
+void stream_senders_stop(void)
+{
+    if (!s_started) {
+        return;
+    }
+    s_stopping = true;
+
+    int running = 0;
+    for (int i = 0; i < STREAM_SENDER_COUNT; i++) {
+        if (s_senders[i].task) {
+            xTaskNotifyGive(s_senders[i].task);
+            running++;
+        }
+    }
+    // 推流函数最长阻塞在取帧超时加一次发送超时上
+    for (int i = 0; i < running; i++) {
+        if (xSemaphoreTake(s_exited, 10000 / portTICK_PERIOD_MS) != pdTRUE) {
+            ESP_LOGW(TAG, "等待发送任务退出超时");
+            break;
+        }
+    }
+    for (int i = 0; i < STREAM_SENDER_COUNT; i++) {
+        s_senders[i].task = NULL;
+    }
+    s_started = false;
+}
+
+bool stream_senders_stopping(void)
+{
+    return s_stopping;
+}
+
+esp_err_t stream_senders_submit(httpd_req_t *req, stream_sender_fn_t fn)
+{
+    if (!s_started || s_stopping) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    stream_sender_t *sender = NULL;
+    for (int i = 0; i < STREAM_SENDER_COUNT; i++) {
+        if (s_senders[i].task && !s_senders[i].req) {
+            sender = &s_senders[i];
+            break;
+        }
+    }
+    if (!sender) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // 复制一份请求, 原请求返回后httpd不再处理这个socket, 直到 async_handler_complete
+    httpd_req_t *copy = NULL;
+    esp_err_t err = httpd_req_async_handler_begin(req, &copy);
+    if (err != ESP_OK) {
+        xSemaphoreGive(s_lock);
+        return err;
+    }
+    sender->req = copy;
+    sender->fn = fn;
+    memset(&sender->stats, 0, sizeof(sender->stats));
+    sender->stats.fd = httpd_req_to_sockfd(copy);
+    xSemaphoreGive(s_lock);
+
+    xTaskNotifyGive(sender->task);
+    return ESP_OK;
+}
+
+size_t stream_senders_get_stats(stream_sender_stats_t *out, size_t max)
+{
+    size_t n = 0;
+    if (!s_lock) {
+        return 0;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < STREAM_SENDER_COUNT && n < max; i++) {
+        out[n++] = s_senders[i].stats;
+    }
+    xSemaphoreGive(s_lock);
+    return n;
+}
@@ -0,0 +1,57 @@
+#ifndef STREAM_SENDERS_H
+#define STREAM_SENDERS_H
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 推流发送任务池: /stream 请求通过 esp_http_server 的异步请求机制交给这里的任务,
+// httpd 任务立即返回, 主页和控制端点不会被推流连接卡住
+
+// 发送任务数量 = 同时推流的客户端上限, 核心和优先级都在 menuconfig 里设置
+#ifdef CONFIG_STREAM_SENDER_COUNT
+#define STREAM_SENDER_COUNT CONFIG_STREAM_SENDER_COUNT
+#else
+#define STREAM_SENDER_COUNT 4
+#endif
+#if CONFIG_STREAM_SENDER_CORE0
+#define STREAM_SENDER_CORE 0
+#elif CONFIG_STREAM_SENDER_NO_AFFINITY
+#define STREAM_SENDER_CORE tskNO_AFFINITY
+#else
+#define STREAM_SENDER_CORE 1
+#endif
+#ifdef CONFIG_STREAM_SENDER_PRIORITY
+#define STREAM_SENDER_PRIORITY CONFIG_STREAM_SENDER_PRIORITY
+#else
+#define STREAM_SENDER_PRIORITY 5
+#endif
+#define STREAM_SENDER_STACK_SIZE 4096
+
+// 每个发送任务当前客户端的状态, 由推流函数更新
+typedef struct {
+    int fd;                             // 客户端socket, 空闲时为 -1
+    volatile uint32_t queue_depth;      // 最新帧序号 - 该客户端已发送的帧序号
+    volatile uint32_t frames_sent;
+    volatile uint32_t frames_skipped;
+} stream_sender_stats_t;
+
+// 推流函数在发送任务里运行, 直到客户端断开或 stream_senders_stopping() 为真
+// 返回非 ESP_OK 时连接会被关闭
+typedef esp_err_t (*stream_sender_fn_t)(httpd_req_t *req, stream_sender_stats_t *stats);
+
+esp_err_t stream_senders_start(void);
+// 通知所有推流函数退出并等待发送任务结束, 须在 httpd_stop 之前调用
+void stream_senders_stop(void);
+bool stream_senders_stopping(void);
+
+// 把请求交给空闲的发送任务; 没有空闲任务时返回 ESP_ERR_NOT_FOUND, 请求仍由调用者处理
+esp_err_t stream_senders_submit(httpd_req_t *req, stream_sender_fn_t fn);
+
+// 复制各发送任务的状态, 返回填入的个数
+size_t stream_senders_get_stats(stream_sender_stats_t *out, size_t max);
+
+#endif
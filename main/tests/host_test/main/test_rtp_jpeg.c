@@ -0,0 +1,443 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "rtp_jpeg.h"
+
+// 打包 -> 解包 -> 重组, 和原始JPEG逐项比较
+
+#define MAX_JPEG 8192
+#define MAX_PKTS 256
+#define TEST_SSRC 0x12345678
+
+// 构造测试用的基线JPEG
+typedef struct {
+    uint8_t type;               // 0: h2v1, 1: h2v2
+    uint16_t width;
+    uint16_t height;
+    uint8_t qtable_ids;         // bit0: 带 id 0 的表, bit1: 带 id 1 的表
+    size_t scan_len;
+    bool app0;                  // 加一个 APP0 段
+    bool dht;                   // 加一个 DHT 段
+    uint16_t restart_interval;  // 非0时加 DRI 段
+    uint8_t sof_marker;         // 0 表示 SOF0
+    size_t trailing;            // EOI 之后的填充字节数
+} jpeg_spec_t;
+
+static uint8_t *put_be16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+    return p + 2;
+}
+
+static void fill_qtable(uint8_t *table, uint8_t id)
+{
+    for (int i = 0; i < 64; i++) {
+        table[i] = (uint8_t)(1 + i + id * 64);
+    }
+}
+
+// 熵编码数据: 0xFF 后面总是跟 0x00 填充, 和真实码流一样不会出现标记
+static void fill_scan(uint8_t *scan, size_t len, uint32_t seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        uint8_t b = (uint8_t)(seed >> 16);
+        if (i > 0 && scan[i - 1] == 0xFF) {
+            b = 0x00;
+        } else if (i == len - 1 && b == 0xFF) {
+            b = 0xFE;
+        }
+        scan[i] = b;
+    }
+}
+
+static size_t build_jpeg(uint8_t *out, const jpeg_spec_t *spec, uint32_t seed)
+{
+    uint8_t *p = out;
+    *p++ = 0xFF; *p++ = 0xD8;
+    if (spec->app0) {
+        static const uint8_t jfif[] = {'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0};
+        *p++ = 0xFF; *p++ = 0xE0;
+        p = put_be16(p, 2 + sizeof(jfif));
+        memcpy(p, jfif, sizeof(jfif));
+        p += sizeof(jfif);
+    }
+    for (uint8_t id = 0; id < 2; id++) {
+        if (spec->qtable_ids & (1 << id)) {
+            *p++ = 0xFF; *p++ = 0xDB;
+            p = put_be16(p, 2 + 1 + 64);
+            *p++ = id;
+            fill_qtable(p, id);
+            p += 64;
+        }
+    }
+    *p++ = 0xFF; *p++ = spec->sof_marker ? spec->sof_marker : 0xC0;
+    p = put_be16(p, 2 + 6 + 3 * 3);
+    *p++ = 8;
+    p = put_be16(p, spec->height);
+    p = put_be16(p, spec->width);
+    *p++ = 3;
+    uint8_t chroma_q = (spec->qtable_ids & 2) ? 1 : 0;
+    *p++ = 1; *p++ = spec->type ? 0x22 : 0x21; *p++ = 0;
+    *p++ = 2; *p++ = 0x11; *p++ = chroma_q;
+    *p++ = 3; *p++ = 0x11; *p++ = chroma_q;
+    if (spec->dht) {
+        // 内容无关紧要, RTP/JPEG 不传霍夫曼表
+        *p++ = 0xFF; *p++ = 0xC4;
+        p = put_be16(p, 2 + 17 + 1);
+        *p++ = 0x00;
+        memset(p, 0, 16);
+        p[0] = 1;
+        p += 16;
+        *p++ = 0x00;
+    }
+    if (spec->restart_interval) {
+        *p++ = 0xFF; *p++ = 0xDD;
+        p = put_be16(p, 4);
+        p = put_be16(p, spec->restart_interval);
+    }
+    *p++ = 0xFF; *p++ = 0xDA;
+    p = put_be16(p, 2 + 1 + 3 * 2 + 3);
+    *p++ = 3;
+    *p++ = 1; *p++ = 0x00;
+    *p++ = 2; *p++ = 0x11;
+    *p++ = 3; *p++ = 0x11;
+    *p++ = 0; *p++ = 63; *p++ = 0;
+    fill_scan(p, spec->scan_len, seed);
+    p += spec->scan_len;
+    *p++ = 0xFF; *p++ = 0xD9;
+    memset(p, 0, spec->trailing);
+    p += spec->trailing;
+    return p - out;
+}
+
+// 接收端: 按 RFC 2435 把一帧的包重新拼起来
+typedef struct {
+    uint32_t timestamp;
+    uint16_t next_seq;
+    bool have_seq;
+    bool started;
+    bool complete;
+    bool broken;                // 丢包、乱序或分片偏移对不上
+    uint8_t type;
+    uint16_t width;
+    uint16_t height;
+    uint8_t qtables[2 * 64];
+    size_t qtables_len;
+    uint8_t scan[MAX_JPEG];
+    size_t scan_len;
+    size_t packets;
+} depacketizer_t;
+
+static void depacketizer_begin(depacketizer_t *d)
+{
+    uint16_t next_seq = d->next_seq;
+    bool have_seq = d->have_seq;
+    memset(d, 0, sizeof(*d));
+    d->next_seq = next_seq;
+    d->have_seq = have_seq;
+}
+
+static uint16_t get_be16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t get_be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void depacketize(depacketizer_t *d, const uint8_t *pkt, size_t len)
+{
+    TEST_ASSERT_GREATER_OR_EQUAL(RTP_HEADER_LEN + RTP_JPEG_HEADER_LEN + 1, len);
+    TEST_ASSERT_EQUAL_HEX8(0x80, pkt[0]);
+    TEST_ASSERT_EQUAL(RTP_JPEG_PAYLOAD_TYPE, pkt[1] & 0x7f);
+    TEST_ASSERT_EQUAL_HEX32(TEST_SSRC, get_be32(&pkt[8]));
+    bool marker = pkt[1] & 0x80;
+    uint16_t seq = get_be16(&pkt[2]);
+    uint32_t timestamp = get_be32(&pkt[4]);
+
+    if (d->have_seq && seq != d->next_seq) {
+        d->broken = true;
+    }
+    d->have_seq = true;
+    d->next_seq = seq + 1;
+    if (!d->started) {
+        d->started = true;
+        d->timestamp = timestamp;
+    }
+    TEST_ASSERT_EQUAL_UINT32(d->timestamp, timestamp);
+    TEST_ASSERT_FALSE(d->complete);
+
+    const uint8_t *q = pkt + RTP_HEADER_LEN;
+    uint32_t offset = (uint32_t)q[1] << 16 | (uint32_t)q[2] << 8 | q[3];
+    uint8_t type = q[4];
+    uint8_t quality = q[5];
+    TEST_ASSERT_EQUAL(0, q[0]);
+    TEST_ASSERT_EQUAL(255, quality);
+    q += RTP_JPEG_HEADER_LEN;
+
+    if (offset == 0) {
+        d->type = type;
+        d->width = pkt[RTP_HEADER_LEN + 6] * 8;
+        d->height = pkt[RTP_HEADER_LEN + 7] * 8;
+        // Q=255: 量化表头 MBZ, 精度, 长度
+        TEST_ASSERT_EQUAL(0, q[0]);
+        TEST_ASSERT_EQUAL(0, q[1]);
+        d->qtables_len = get_be16(&q[2]);
+        TEST_ASSERT_TRUE(d->qtables_len == 64 || d->qtables_len == 128);
+        q += RTP_JPEG_QTABLE_HEADER_LEN;
+        memcpy(d->qtables, q, d->qtables_len);
+        q += d->qtables_len;
+    } else {
+        TEST_ASSERT_EQUAL(d->type, type);
+    }
+    if (offset != d->scan_len) {
+        d->broken = true;
+    }
+
+    size_t chunk = len - (q - pkt);
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(d->scan) - d->scan_len, chunk);
+    if (!d->broken) {
+        memcpy(d->scan + d->scan_len, q, chunk);
+        d->scan_len += chunk;
+    }
+    d->packets++;
+    d->complete = marker;
+}
+
+// 从解包结果重建JPEG: SOI DQT SOF0 SOS 熵编码数据 EOI
+static size_t reassemble(const depacketizer_t *d, uint8_t *out)
+{
+    uint8_t *p = out;
+    size_t tables = d->qtables_len / 64;
+    *p++ = 0xFF; *p++ = 0xD8;
+    for (size_t id = 0; id < tables; id++) {
+        *p++ = 0xFF; *p++ = 0xDB;
+        p = put_be16(p, 2 + 1 + 64);
+        *p++ = id;
+        memcpy(p, d->qtables + id * 64, 64);
+        p += 64;
+    }
+    uint8_t chroma_q = tables > 1 ? 1 : 0;
+    *p++ = 0xFF; *p++ = 0xC0;
+    p = put_be16(p, 2 + 6 + 3 * 3);
+    *p++ = 8;
+    p = put_be16(p, d->height);
+    p = put_be16(p, d->width);
+    *p++ = 3;
+    *p++ = 1; *p++ = d->type ? 0x22 : 0x21; *p++ = 0;
+    *p++ = 2; *p++ = 0x11; *p++ = chroma_q;
+    *p++ = 3; *p++ = 0x11; *p++ = chroma_q;
+    *p++ = 0xFF; *p++ = 0xDA;
+    p = put_be16(p, 2 + 1 + 3 * 2 + 3);
+    *p++ = 3;
+    *p++ = 1; *p++ = 0x00;
+    *p++ = 2; *p++ = 0x11;
+    *p++ = 3; *p++ = 0x11;
+    *p++ = 0; *p++ = 63; *p++ = 0;
+    memcpy(p, d->scan, d->scan_len);
+    p += d->scan_len;
+    *p++ = 0xFF; *p++ = 0xD9;
+    return p - out;
+}
+
+// 打包时记下的所有包, 测试可以丢掉其中一些再解包
+typedef struct {
+    uint8_t data[MAX_PKTS][1500];
+    size_t len[MAX_PKTS];
+    size_t count;
+    size_t fail_at;             // 第几个包时 emit 返回错误, 0 表示不出错
+    size_t mtu;
+} capture_t;
+
+static esp_err_t capture_emit(const uint8_t *pkt, size_t len, void *arg)
+{
+    capture_t *c = (capture_t *)arg;
+    TEST_ASSERT_LESS_OR_EQUAL(c->mtu, len);
+    TEST_ASSERT_LESS_THAN(MAX_PKTS, c->count);
+    if (c->fail_at && c->count + 1 == c->fail_at) {
+        return ESP_FAIL;
+    }
+    memcpy(c->data[c->count], pkt, len);
+    c->len[c->count] = len;
+    c->count++;
+    return ESP_OK;
+}
+
+static uint8_t s_jpeg[MAX_JPEG];
+static uint8_t s_rebuilt[MAX_JPEG];
+static uint8_t s_pkt_buf[1500];
+static capture_t s_capture;
+static depacketizer_t s_depack;
+
+static void check_same_frame(const uint8_t *a, size_t a_len, const uint8_t *b, size_t b_len)
+{
+    rtp_jpeg_info_t ia, ib;
+    TEST_ASSERT_EQUAL(ESP_OK, rtp_jpeg_parse(a, a_len, &ia));
+    TEST_ASSERT_EQUAL(ESP_OK, rtp_jpeg_parse(b, b_len, &ib));
+    TEST_ASSERT_EQUAL(ia.type, ib.type);
+    TEST_ASSERT_EQUAL((ia.width + 7) / 8 * 8, ib.width);
+    TEST_ASSERT_EQUAL((ia.height + 7) / 8 * 8, ib.height);
+    TEST_ASSERT_EQUAL(ia.qtable_count, ib.qtable_count);
+    for (int i = 0; i < ia.qtable_count; i++) {
+        // 只有亮度表时两边的色度都沿用亮度表
+        const uint8_t *ta = ia.qtables[i] ? ia.qtables[i] : ia.qtables[0];
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(ta, ib.qtables[i], 64);
+    }
+    TEST_ASSERT_EQUAL(ia.scan_len, ib.scan_len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(ia.scan, ib.scan, ia.scan_len);
+}
+
+// 打包一帧, 全部包按顺序解包, 重组结果和原始帧一致
+static void round_trip(const jpeg_spec_t *spec, size_t mtu, rtp_jpeg_packetizer_t *p, uint32_t timestamp)
+{
+    size_t len = build_jpeg(s_jpeg, spec, timestamp);
+    memset(&s_capture, 0, sizeof(s_capture));
+    s_capture.mtu = mtu;
+    p->mtu = mtu;
+    uint16_t first_seq = p->seq;
+
+    TEST_ASSERT_EQUAL(ESP_OK, rtp_jpeg_packetize(p, s_jpeg, len, timestamp, s_pkt_buf, capture_emit, &s_capture));
+    TEST_ASSERT_GREATER_THAN(0, s_capture.count);
+    TEST_ASSERT_EQUAL_UINT16((uint16_t)(first_seq + s_capture.count), p->seq);
+
+    depacketizer_begin(&s_depack);
+    for (size_t i = 0; i < s_capture.count; i++) {
+        // 只有最后一个包带 marker
+        TEST_ASSERT_EQUAL(i == s_capture.count - 1, (s_capture.data[i][1] & 0x80) != 0);
+        depacketize(&s_depack, s_capture.data[i], s_capture.len[i]);
+    }
+    TEST_ASSERT_TRUE(s_depack.complete);
+    TEST_ASSERT_FALSE(s_depack.broken);
+    TEST_ASSERT_EQUAL_UINT32(timestamp, s_depack.timestamp);
+
+    size_t rebuilt = reassemble(&s_depack, s_rebuilt);
+    check_same_frame(s_jpeg, len, s_rebuilt, rebuilt);
+}
+
+TEST_CASE("RTP/JPEG round trip at several MTUs", "[rtp_jpeg]")
+{
+    static const size_t mtus[] = {RTP_HEADER_LEN + RTP_JPEG_HEADER_LEN + RTP_JPEG_QTABLE_HEADER_LEN + 128 + 1,
+                                  300, 576, 1400};
+    static const jpeg_spec_t specs[] = {
+        {.type = 0, .width = 320, .height = 240, .qtable_ids = 3, .scan_len = 4000, .app0 = true, .dht = true},
+        {.type = 1, .width = 640, .height = 480, .qtable_ids = 3, .scan_len = 1},
+        {.type = 0, .width = 96, .height = 96, .qtable_ids = 3, .scan_len = 1400 - 40, .trailing = 7},
+        {.type = 1, .width = 2040, .height = 2040, .qtable_ids = 3, .scan_len = 2000, .sof_marker = 0xC1},
+        // 只有亮度表: 色度沿用亮度表
+        {.type = 0, .width = 160, .height = 120, .qtable_ids = 1, .scan_len = 700},
+        // 显式的重启间隔0等于没有重启标记
+        {.type = 0, .width = 160, .height = 120, .qtable_ids = 3, .scan_len = 500, .restart_interval = 0},
+    };
+    rtp_jpeg_packetizer_t p = {.ssrc = TEST_SSRC, .seq = 0xFFF0};
+    uint32_t timestamp = 1000;
+
+    for (size_t m = 0; m < sizeof(mtus) / sizeof(mtus[0]); m++) {
+        for (size_t s = 0; s < sizeof(specs) / sizeof(specs[0]); s++) {
+            // 序号跨帧连续, 并且会回绕
+            round_trip(&specs[s], mtus[m], &p, timestamp);
+            timestamp += RTP_JPEG_CLOCK_RATE / 10;
+        }
+    }
+}
+
+TEST_CASE("RTP/JPEG lost packet is detected by the receiver", "[rtp_jpeg]")
+{
+    jpeg_spec_t spec = {.type = 1, .width = 320, .height = 240, .qtable_ids = 3, .scan_len = 3000};
+    rtp_jpeg_packetizer_t p = {.ssrc = TEST_SSRC, .mtu = 500};
+    size_t len = build_jpeg(s_jpeg, &spec, 7);
+
+    memset(&s_capture, 0, sizeof(s_capture));
+    s_capture.mtu = p.mtu;
+    TEST_ASSERT_EQUAL(ESP_OK, rtp_jpeg_packetize(&p, s_jpeg, len, 90, s_pkt_buf, capture_emit, &s_capture));
+    TEST_ASSERT_GREATER_THAN(3, s_capture.count);
+
+    // 去掉中间一个包: 序号和分片偏移都对不上, 这一帧不能当作完整帧
+    memset(&s_depack, 0, sizeof(s_depack));
+    for (size_t i = 0; i < s_capture.count; i++) {
+        if (i != 2) {
+            depacketize(&s_depack, s_capture.data[i], s_capture.len[i]);
+        }
+    }
+    TEST_ASSERT_TRUE(s_depack.complete);
+    TEST_ASSERT_TRUE(s_depack.broken);
+}
+
+TEST_CASE("RTP/JPEG rejects unsupported frames", "[rtp_jpeg]")
+{
+    rtp_jpeg_info_t info;
+    jpeg_spec_t base = {.type = 0, .width = 320, .height = 240, .qtable_ids = 3, .scan_len = 100};
+    jpeg_spec_t spec;
+    size_t len;
+
+    // 只有色度表(id 1), 没有亮度表
+    spec = base;
+    spec.qtable_ids = 2;
+    len = build_jpeg(s_jpeg, &spec, 1);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, rtp_jpeg_parse(s_jpeg, len, &info));
+    rtp_jpeg_packetizer_t p = {.ssrc = TEST_SSRC, .mtu = 1400};
+    memset(&s_capture, 0, sizeof(s_capture));
+    s_capture.mtu = p.mtu;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, rtp_jpeg_packetize(&p, s_jpeg, len, 0, s_pkt_buf, capture_emit, &s_capture));
+    TEST_ASSERT_EQUAL(0, s_capture.count);
+
+    // 渐进式
+    spec = base;
+    spec.sof_marker = 0xC2;
+    len = build_jpeg(s_jpeg, &spec, 1);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, rtp_jpeg_parse(s_jpeg, len, &info));
+
+    // 带重启标记
+    spec = base;
+    spec.restart_interval = 4;
+    len = build_jpeg(s_jpeg, &spec, 1);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, rtp_jpeg_parse(s_jpeg, len, &info));
+
+    // 尺寸超过 RTP/JPEG 能表示的 2040
+    spec = base;
+    spec.width = 2048;
+    len = build_jpeg(s_jpeg, &spec, 1);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, rtp_jpeg_parse(s_jpeg, len, &info));
+
+    // 缺少 EOI 或被截断
+    spec = base;
+    len = build_jpeg(s_jpeg, &spec, 1);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, rtp_jpeg_parse(s_jpeg, len - 2, &info));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, rtp_jpeg_parse(s_jpeg, 40, &info));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, rtp_jpeg_parse(s_jpeg + 1, len - 1, &info));
+}
+
+TEST_CASE("RTP/JPEG packetizer errors", "[rtp_jpeg]")
+{
+    jpeg_spec_t spec = {.type = 0, .width = 320, .height = 240, .qtable_ids = 3, .scan_len = 2000};
+    size_t len = build_jpeg(s_jpeg, &spec, 3);
+
+    // MTU 放不下第一个包的头和量化表
+    rtp_jpeg_packetizer_t p = {.ssrc = TEST_SSRC,
+                               .mtu = RTP_HEADER_LEN + RTP_JPEG_HEADER_LEN + RTP_JPEG_QTABLE_HEADER_LEN + 128};
+    memset(&s_capture, 0, sizeof(s_capture));
+    s_capture.mtu = p.mtu;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, rtp_jpeg_packetize(&p, s_jpeg, len, 0, s_pkt_buf, capture_emit, &s_capture));
+    TEST_ASSERT_EQUAL(0, s_capture.count);
+    TEST_ASSERT_EQUAL(0, p.seq);
+
+    // emit 出错时停在那个包
+    p.mtu = 300;
+    memset(&s_capture, 0, sizeof(s_capture));
+    s_capture.mtu = p.mtu;
+    s_capture.fail_at = 3;
+    TEST_ASSERT_EQUAL(ESP_FAIL, rtp_jpeg_packetize(&p, s_jpeg, len, 0, s_pkt_buf, capture_emit, &s_capture));
+    TEST_ASSERT_EQUAL(2, s_capture.count);
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    unity_run_all_tests();
+    int failures = UNITY_END();
+    exit(failures ? 1 : 0);
+}
@@ -1,4 +1,7 @@
 #include "websocket.h"
+#include "frame_pool.h"
+#include "frame_clock.h"
+#include "frame_broadcast.h"
 #include "esp_websocket_client.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
@@ -9,109 +12,151 @@
 #include "esp_http_server.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include <string.h>
 
 static const char *TAG = "WEBSOCKET_SERVER";
 
 static httpd_handle_t ws_server = NULL;
-static QueueHandle_t frame_queue = NULL;
-static bool ws_streaming = false;
-static TaskHandle_t camera_task_handle = NULL;
+static volatile bool ws_stopping = false;
+static SemaphoreHandle_t ws_task_done = NULL;  // 计数信号量, 每个任务退出时加1
+static size_t ws_task_count = 0;
+static uint32_t frame_seq = 0;
 
-// 帧数据结构
-typedef struct {
-    uint8_t *data;
-    size_t len;
-} frame_data_t;
+#define WS_MAX_CLIENTS 5
+// 帧槽: 1个采集中 + 2个排队 + 1个发送中
+#define WS_FRAME_SLOTS 4
+#define WS_MAX_FRAME_SIZE (40 * 1024)
+#define WS_CAPTURE_FPS 10
+// 停止时等任务退出的上限, 任务最长阻塞在取帧/取帧槽的超时上
+#define WS_STOP_TIMEOUT_MS 5000
 
-// WebSocket连接处理 - 使用HTTP升级到WebSocket
+// WebSocket连接处理 - 握手由esp_http_server完成, 之后只接收客户端的控制消息
 static esp_err_t ws_handler(httpd_req_t *req)
 {
     if (req->method == HTTP_GET) {
-        ESP_LOGI(TAG, "WebSocket握手请求");
-        
-        // 检查WebSocket升级头
-        char upgrade[32] = {0};
-        char connection[32] = {0};
-        char ws_key[64] = {0};
-        
-        if (httpd_req_get_hdr_value_str(req, "Upgrade", upgrade, sizeof(upgrade)) != ESP_OK ||
-            httpd_req_get_hdr_value_str(req, "Connection", connection, sizeof(connection)) != ESP_OK ||
-            httpd_req_get_hdr_value_str(req, "Sec-WebSocket-Key", ws_key, sizeof(ws_key)) != ESP_OK) {
-            
-            ESP_LOGE(TAG, "缺少WebSocket升级头");
-            return ESP_FAIL;
-        }
-        
-        if (strcasecmp(upgrade, "websocket") != 0) {
-            ESP_LOGE(TAG, "不是WebSocket升级请求");
-            return ESP_FAIL;
-        }
-        
-        ESP_LOGI(TAG, "WebSocket升级成功");
+        ESP_LOGI(TAG, "WebSocket握手完成, fd=%d", httpd_req_to_sockfd(req));
         return ESP_OK;
     }
-    
-    return ESP_FAIL;
+
+    // 客户端发来的消息目前不需要处理, 读出后丢弃
+    uint8_t buf[32];
+    httpd_ws_frame_t ws_pkt = {0};
+    esp_err_t ret = httpd_ws_recv_frame(req, &ws_pkt, 0);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (ws_pkt.len > sizeof(buf)) {
+        ESP_LOGW(TAG, "忽略过长的客户端消息 (%zu 字节)", ws_pkt.len);
+        return ESP_FAIL;
+    }
+    ws_pkt.payload = buf;
+    return httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
+}
+
+// 当前已完成握手的WebSocket客户端数
+// 直接以 httpd 的会话表为准, 连接建立和断开都只由 httpd 维护, 不需要另外的状态标志
+static size_t ws_client_count(void)
+{
+    int fds[WS_MAX_CLIENTS];
+    size_t fd_count = WS_MAX_CLIENTS;
+    size_t clients = 0;
+
+    if (!ws_server || httpd_get_client_list(ws_server, &fd_count, fds) != ESP_OK) {
+        return 0;
+    }
+    for (size_t i = 0; i < fd_count; i++) {
+        if (httpd_ws_get_fd_info(ws_server, fds[i]) == HTTPD_WS_CLIENT_WEBSOCKET) {
+            clients++;
+        }
+    }
+    return clients;
 }
 
-// 摄像头捕获任务
+// 摄像头捕获任务, 按 WS_CAPTURE_FPS 节拍采集
 static void camera_capture_task(void *pvParameters)
 {
-    camera_fb_t *fb = NULL;
-    size_t frame_count = 0;
+    frame_clock_t clock;
+    bool active = false;
+    bool full_warned = false;
+    int sub = -1;
+    uint32_t last_seq = 0;
+
+    if (frame_clock_init(&clock, "ws_capture", FRAME_CLOCK_PERIOD_US(WS_CAPTURE_FPS)) != ESP_OK) {
+        ESP_LOGE(TAG, "帧时钟创建失败");
+        xSemaphoreGive(ws_task_done);
+        vTaskDelete(NULL);
+        return;
+    }
     
-    ESP_LOGI(TAG, "摄像头捕获任务启动");
+    ESP_LOGI(TAG, "摄像头捕获任务启动, 目标 %d fps", WS_CAPTURE_FPS);
     
-    while (true) {
-        if (!ws_streaming) {
+    while (!ws_stopping) {
+        if (ws_client_count() == 0) {
+            if (active) {
+                ESP_LOGI(TAG, "WebSocket客户端全部断开");
+                active = false;
+            }
+            // 没有客户端时退订, 不占用广播槽位
+            frame_broadcast_unsubscribe(sub);
+            sub = -1;
             vTaskDelay(500 / portTICK_PERIOD_MS);
+            frame_clock_reset(&clock);
             continue;
         }
-        
-        fb = esp_camera_fb_get();
-        if (!fb) {
-            ESP_LOGW(TAG, "摄像头获取失败");
-            vTaskDelay(100 / portTICK_PERIOD_MS);
-            continue;
+        // 帧由广播器的帧回调统一接管, esp_camera_fb_get 在这里拿不到帧
+        if (sub < 0) {
+            sub = frame_broadcast_subscribe();
+            if (sub < 0) {
+                if (!full_warned) {
+                    ESP_LOGW(TAG, "观看人数已满，WebSocket暂时无法取帧");
+                    full_warned = true;
+                }
+                vTaskDelay(500 / portTICK_PERIOD_MS);
+                continue;
+            }
+            full_warned = false;
         }
+        active = true;
+
+        // 失败或跳过的帧也占一个周期, 下一次采集在下一个节拍
+        frame_clock_wait(&clock);
         
-        frame_count++;
-        
-        // 跳帧处理
-        if (frame_count % 2 != 0) {
-            esp_camera_fb_return(fb);
-            vTaskDelay(50 / portTICK_PERIOD_MS);
+        broadcast_frame_t *frame = frame_broadcast_acquire(sub, last_seq, 500 / portTICK_PERIOD_MS);
+        if (!frame) {
             continue;
         }
+        last_seq = frame->seq;
+        const camera_fb_t *fb = frame->fb;
         
-        // 大帧检查
-        if (fb->len > 40 * 1024) {
-            ESP_LOGW(TAG, "帧过大 (%zu KB)，跳过", fb->len / 1024);
-            esp_camera_fb_return(fb);
-            vTaskDelay(50 / portTICK_PERIOD_MS);
+        // 取一个帧槽, 消息头和JPEG放在同一个槽位里; 池满时丢弃最旧的排队帧
+        frame_slot_t *slot = frame_pool_alloc(sizeof(ws_frame_header_t) + fb->len);
+        if (!slot) {
+            ESP_LOGW(TAG, "帧过大 (%zu KB) 或无可用帧槽，跳过", fb->len / 1024);
+            frame_broadcast_release(frame);
             continue;
         }
-        
-        // 创建帧数据
-        frame_data_t frame_data;
-        frame_data.data = malloc(fb->len);
-        if (frame_data.data) {
-            memcpy(frame_data.data, fb->buf, fb->len);
-            frame_data.len = fb->len;
-            
-            // 发送到队列
-            if (xQueueSend(frame_queue, &frame_data, pdMS_TO_TICKS(100)) != pdPASS) {
-                ESP_LOGW(TAG, "队列满，丢弃帧");
-                free(frame_data.data);
-            }
-        }
-        
-        esp_camera_fb_return(fb);
-        vTaskDelay(100 / portTICK_PERIOD_MS); // 约10fps
+
+        ws_frame_header_t hdr = {
+            .seq = ++frame_seq,
+            .timestamp_us = (uint64_t)fb->timestamp.tv_sec * 1000000ULL + fb->timestamp.tv_usec,
+            .width = fb->width,
+            .height = fb->height,
+            .len = fb->len,
+        };
+        memcpy(slot->data, &hdr, sizeof(hdr));
+        memcpy(slot->data + sizeof(hdr), fb->buf, fb->len);
+        slot->len = sizeof(hdr) + fb->len;
+        frame_broadcast_release(frame);
+
+        frame_pool_commit(slot);
     }
     
+    // 每次循环结束时帧和帧槽都已交出, 这里只剩订阅和帧时钟要释放
+    frame_broadcast_unsubscribe(sub);
+    frame_clock_deinit(&clock);
+    ESP_LOGI(TAG, "摄像头捕获任务退出");
+    xSemaphoreGive(ws_task_done);
     vTaskDelete(NULL);
 }
 
@@ -150,10 +195,14 @@ static esp_err_t ws_index_handler(httpd_req_t *req)
     "<button onclick='location.reload()'>刷新页面</button>"
     "</div>"
     "<div class='status' id='status'>准备连接...</div>"
-    "<div class='info'>基于ESP32官方WebSocket组件 | 更低延迟 | 约10fps</div>"
+    "<div class='info'>RFC 6455 WebSocket二进制推流 | 每帧带序号和采集时间戳 | 约10fps</div>"
     "</div>"
     "<script>"
-    "let frameCount = 0;"
+    "const HDR_LEN = 20;"
+    "let ws = null;"
+    "let lastSeq = 0;"
+    "let lastTs = 0;"
+    "let lost = 0;"
     "const videoImg = document.getElementById('videoImg');"
     "const placeholder = document.getElementById('placeholder');"
     "const status = document.getElementById('status');"
@@ -165,27 +214,47 @@ static esp_err_t ws_index_handler(httpd_req_t *req)
     "  console.log(msg);"
     "}"
     ""
-    "// 模拟WebSocket连接来获取视频流"
+    "// 解析消息头: seq(u32) timestamp_us(u64) width(u16) height(u16) len(u32), 小端序"
+    "function onFrame(ev) {"
+    "  const dv = new DataView(ev.data);"
+    "  const seq = dv.getUint32(0, true);"
+    "  const ts = Number(dv.getBigUint64(4, true));"
+    "  const w = dv.getUint16(12, true);"
+    "  const h = dv.getUint16(14, true);"
+    "  const len = dv.getUint32(16, true);"
+    "  if (lastSeq && seq > lastSeq + 1) lost += seq - lastSeq - 1;"
+    "  const interval = lastTs ? (ts - lastTs) / 1000 : 0;"
+    "  lastSeq = seq;"
+    "  lastTs = ts;"
+    "  const url = URL.createObjectURL(new Blob([new Uint8Array(ev.data, HDR_LEN, len)], {type: 'image/jpeg'}));"
+    "  videoImg.onload = () => URL.revokeObjectURL(url);"
+    "  videoImg.src = url;"
+    "  updateStatus('帧 #' + seq + ' ' + w + 'x' + h + ' ' + len + 'B, 帧间隔 ' + interval.toFixed(1) + 'ms, 丢帧 ' + lost);"
+    "}"
+    ""
     "function startStream() {"
-    "  updateStatus('开始请求视频流...');"
+    "  updateStatus('正在连接WebSocket...');"
     "  startBtn.disabled = true;"
     "  stopBtn.disabled = false;"
-    "  placeholder.style.display = 'none';"
-    "  videoImg.style.display = 'block';"
-    "  "
-    "  // 使用HTTP流模式 (因为这是服务器端实现)"
-    "  videoImg.src = '/stream';"
-    "  frameCount = 0;"
-    "  updateStatus('视频流已开始');"
+    "  lastSeq = 0; lastTs = 0; lost = 0;"
+    "  ws = new WebSocket('ws://' + location.host + '/ws');"
+    "  ws.binaryType = 'arraybuffer';"
+    "  ws.onopen = () => {"
+    "    placeholder.style.display = 'none';"
+    "    videoImg.style.display = 'block';"
+    "    updateStatus('WebSocket已连接，等待视频帧');"
+    "  };"
+    "  ws.onmessage = onFrame;"
+    "  ws.onclose = () => { updateStatus('WebSocket已断开'); stopStream(); };"
     "}"
     ""
     "function stopStream() {"
-    "  updateStatus('停止视频流');"
+    "  if (ws) { ws.onclose = null; ws.close(); ws = null; }"
     "  startBtn.disabled = false;"
     "  stopBtn.disabled = true;"
     "  placeholder.style.display = 'block';"
     "  videoImg.style.display = 'none';"
-    "  videoImg.src = '';"
+    "  videoImg.removeAttribute('src');"
     "}"
     ""
     "// 页面加载完成"
@@ -201,103 +270,103 @@ static esp_err_t ws_index_handler(httpd_req_t *req)
     return httpd_resp_send(req, html_page, HTTPD_RESP_USE_STRLEN);
 }
 
-// 视频流处理 (MJPEG格式)
-static esp_err_t stream_handler(httpd_req_t *req)
+// 向所有WebSocket客户端推送一帧, 返回成功发送的客户端数
+static size_t ws_broadcast_frame(const frame_slot_t *slot)
+{
+    int fds[WS_MAX_CLIENTS];
+    size_t fd_count = WS_MAX_CLIENTS;
+    size_t sent = 0;
+
+    if (httpd_get_client_list(ws_server, &fd_count, fds) != ESP_OK) {
+        return 0;
+    }
+
+    httpd_ws_frame_t ws_pkt = {
+        .final = true,
+        .fragmented = false,
+        .type = HTTPD_WS_TYPE_BINARY,
+        .payload = slot->data,
+        .len = slot->len,
+    };
+
+    for (size_t i = 0; i < fd_count; i++) {
+        if (httpd_ws_get_fd_info(ws_server, fds[i]) != HTTPD_WS_CLIENT_WEBSOCKET) {
+            continue;
+        }
+        // 在本任务里直接写socket, 不占用httpd任务
+        if (httpd_ws_send_frame_async(ws_server, fds[i], &ws_pkt) != ESP_OK) {
+            ESP_LOGW(TAG, "发送失败，关闭客户端 fd=%d", fds[i]);
+            httpd_sess_trigger_close(ws_server, fds[i]);
+            continue;
+        }
+        sent++;
+    }
+    return sent;
+}
+
+// WebSocket发送任务: 每帧一条二进制消息推给所有客户端
+static void ws_sender_task(void *pvParameters)
 {
-    esp_err_t res = ESP_OK;
-    char part_buf[128];
-    frame_data_t frame_data;
     size_t frames_sent = 0;
-    
-    // WebSocket流相关定义
-    const char* STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=123456789000000000000987654321";
-    const char* STREAM_BOUNDARY = "\r\n--123456789000000000000987654321\r\n";
-    const char* STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n";
 
-    ESP_LOGI(TAG, "开始WebSocket视频流传输");
-    
-    res = httpd_resp_set_type(req, STREAM_CONTENT_TYPE);
-    if (res != ESP_OK) return res;
-    
-    // 设置HTTP头
-    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
-    httpd_resp_set_hdr(req, "Pragma", "no-cache");
-    
-    // 启动视频流
-    ws_streaming = true;
-    
-    while (true) {
-        // 从队列获取帧数据
-        if (xQueueReceive(frame_queue, &frame_data, pdMS_TO_TICKS(1000)) == pdPASS) {
-            
-            // 发送边界
-            res = httpd_resp_send_chunk(req, STREAM_BOUNDARY, strlen(STREAM_BOUNDARY));
-            if (res != ESP_OK) {
-                free(frame_data.data);
-                break;
-            }
-            
-            // 发送JPEG头
-            size_t hlen = snprintf(part_buf, 128, STREAM_PART, frame_data.len);
-            res = httpd_resp_send_chunk(req, part_buf, hlen);
-            if (res != ESP_OK) {
-                free(frame_data.data);
-                break;
-            }
-            
-            // 分块发送图像数据
-            const size_t chunk_size = 4096;
-            size_t sent = 0;
-            
-            while (sent < frame_data.len) {
-                size_t to_send = (frame_data.len - sent) > chunk_size ? chunk_size : (frame_data.len - sent);
-                res = httpd_resp_send_chunk(req, (const char *)frame_data.data + sent, to_send);
-                if (res != ESP_OK) {
-                    break;
-                }
-                sent += to_send;
-            }
-            
-            free(frame_data.data);
-            
-            if (res != ESP_OK) {
-                break;
-            }
-            
-            frames_sent++;
-            if (frames_sent % 50 == 0) {
-                ESP_LOGI(TAG, "WebSocket已发送 %zu 帧", frames_sent);
-            }
-            
-        } else {
-            // 超时，发送keep-alive
-            res = httpd_resp_send_chunk(req, "\r\n", 2);
-            if (res != ESP_OK) {
-                break;
-            }
+    ESP_LOGI(TAG, "WebSocket发送任务启动");
+
+    while (!ws_stopping) {
+        frame_slot_t *slot = frame_pool_take(pdMS_TO_TICKS(1000));
+        if (!slot) {
+            continue;
+        }
+
+        size_t clients = ws_broadcast_frame(slot);
+        frame_pool_release(slot);
+
+        // 没有客户端时采集任务会自己停下来
+        if (clients == 0) {
+            continue;
+        }
+
+        frames_sent++;
+        if (frames_sent % 50 == 0) {
+            frame_pool_stats_t stats;
+            frame_pool_get_stats(&stats);
+            ESP_LOGI(TAG, "WebSocket已发送 %zu 帧, 客户端: %zu, 帧槽占用 %zu/%zu (峰值 %zu), 丢弃 %lu",
+                     frames_sent, clients, stats.in_use, stats.slot_count, stats.high_water,
+                     (unsigned long)stats.dropped);
         }
     }
-    
-    ws_streaming = false;
-    ESP_LOGI(TAG, "WebSocket视频流传输结束");
-    return res;
+
+    ESP_LOGI(TAG, "WebSocket发送任务退出");
+    xSemaphoreGive(ws_task_done);
+    vTaskDelete(NULL);
 }
 
 // 启动WebSocket服务器
 esp_err_t start_websocket_server(void)
 {
-    // 创建帧队列
-    frame_queue = xQueueCreate(5, sizeof(frame_data_t));
-    if (!frame_queue) {
-        ESP_LOGE(TAG, "创建帧队列失败");
+    if (!ws_task_done) {
+        ws_task_done = xSemaphoreCreateCounting(2, 0);
+        if (!ws_task_done) {
+            ESP_LOGE(TAG, "创建信号量失败");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    // 和 /stream、RTP 共用帧广播; 已经启动时直接返回, 停止由 HTTP 推流服务负责
+    if (frame_broadcast_start() != ESP_OK) {
+        ESP_LOGE(TAG, "启动帧广播失败");
+        return ESP_FAIL;
+    }
+
+    // 预分配帧槽池, 推流过程中不再申请堆内存
+    if (frame_pool_init(WS_FRAME_SLOTS, sizeof(ws_frame_header_t) + WS_MAX_FRAME_SIZE) != ESP_OK) {
+        ESP_LOGE(TAG, "创建帧槽池失败");
         return ESP_FAIL;
     }
     
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = 8080;           // 使用8080端口
     config.stack_size = 8192;            // 增加栈大小
-    config.max_open_sockets = 5;         // 增加连接数
+    config.max_open_sockets = WS_MAX_CLIENTS;  // 增加连接数
     config.task_priority = 6;
     config.core_id = 1;
     config.send_wait_timeout = 10;       // 增加超时时间
@@ -316,38 +385,39 @@ esp_err_t start_websocket_server(void)
             .handler = ws_index_handler
         };
         
-        // WebSocket升级处理
+        // WebSocket端点, 握手和控制帧由esp_http_server处理
         httpd_uri_t ws_uri = {
             .uri = "/ws",
             .method = HTTP_GET,
             .handler = ws_handler,
-            .user_ctx = NULL
-        };
-        
-        // 视频流处理
-        httpd_uri_t stream_uri = {
-            .uri = "/stream",
-            .method = HTTP_GET,
-            .handler = stream_handler,
-            .user_ctx = NULL
+            .user_ctx = NULL,
+            .is_websocket = true
         };
         
         httpd_register_uri_handler(ws_server, &index_uri);
         httpd_register_uri_handler(ws_server, &ws_uri);
-        httpd_register_uri_handler(ws_server, &stream_uri);
         
-        // 启动摄像头捕获任务
-        xTaskCreatePinnedToCore(camera_capture_task, "camera_task", 6144, NULL, 5, &camera_task_handle, 1);
+        // 启动摄像头捕获任务和WebSocket发送任务, 记下实际启动的个数, 停止时等它们全部退出
+        ws_stopping = false;
+        ws_task_count = 0;
+        if (xTaskCreatePinnedToCore(camera_capture_task, "camera_task", 6144, NULL, 5, NULL, 1) == pdPASS) {
+            ws_task_count++;
+        }
+        if (xTaskCreatePinnedToCore(ws_sender_task, "ws_sender", 4096, NULL, 5, NULL, 1) == pdPASS) {
+            ws_task_count++;
+        }
+        if (ws_task_count < 2) {
+            ESP_LOGE(TAG, "创建推流任务失败");
+            stop_websocket_server();
+            return ESP_FAIL;
+        }
         
         ESP_LOGI(TAG, "WebSocket服务器启动成功，端口: 8080");
         ESP_LOGI(TAG, "访问: http://ESP32_IP:8080/");
         return ESP_OK;
     }
     
-    if (frame_queue) {
-        vQueueDelete(frame_queue);
-        frame_queue = NULL;
-    }
+    frame_pool_deinit();
     
     return ESP_FAIL;
 }
@@ -355,21 +425,21 @@ esp_err_t start_websocket_server(void)
 // 停止WebSocket服务器
 void stop_websocket_server(void)
 {
-    ws_streaming = false;
-    
-    if (camera_task_handle) {
-        vTaskDelete(camera_task_handle);
-        camera_task_handle = NULL;
+    // 通知任务退出并等它们确认, 任务持有的帧槽、相机帧和帧时钟都由任务自己释放
+    ws_stopping = true;
+    size_t exited = 0;
+    while (exited < ws_task_count &&
+           xSemaphoreTake(ws_task_done, WS_STOP_TIMEOUT_MS / portTICK_PERIOD_MS) == pdTRUE) {
+        exited++;
     }
-    
-    if (frame_queue) {
-        // 清空队列
-        frame_data_t frame_data;
-        while (xQueueReceive(frame_queue, &frame_data, 0) == pdPASS) {
-            free(frame_data.data);
-        }
-        vQueueDelete(frame_queue);
-        frame_queue = NULL;
+    bool all_exited = exited == ws_task_count;
+    ws_task_count -= exited;
+
+    if (all_exited) {
+        frame_pool_deinit();
+    } else {
+        // 还有任务可能在用槽位, 宁可不释放帧槽池也不能让它访问已释放的内存
+        ESP_LOGE(TAG, "推流任务没有按时退出, 帧槽池不释放");
     }
     
     if (ws_server) {
@@ -382,14 +452,13 @@ void stop_websocket_server(void)
 // 获取WebSocket状态
 bool is_websocket_streaming(void)
 {
-    return ws_streaming;
+    return ws_client_count() > 0;
 }
 
 // 获取等待发送的帧数量
 int get_pending_frames(void)
 {
-    if (frame_queue) {
-        return uxQueueMessagesWaiting(frame_queue);
-    }
-    return 0;
+    frame_pool_stats_t stats;
+    frame_pool_get_stats(&stats);
+    return stats.queued;
 }
\ No newline at end of file
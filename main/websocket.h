@@ -3,6 +3,16 @@
 
 #include "esp_err.h"
 #include <stdbool.h>
+#include <stdint.h>
+
+// /ws 推送的每条二进制消息 = 消息头 + 完整JPEG, 所有字段均为小端序
+typedef struct __attribute__((packed)) {
+    uint32_t seq;           // 帧序号, 不连续说明中间有丢帧
+    uint64_t timestamp_us;  // 采集时间戳(开机以来微秒), 来自 fb->timestamp
+    uint16_t width;
+    uint16_t height;
+    uint32_t len;           // 后面JPEG数据的字节数
+} ws_frame_header_t;
 
 // WebSocket服务器函数
 esp_err_t start_websocket_server(void);
@@ -10,4 +20,4 @@ void stop_websocket_server(void);
 bool is_websocket_streaming(void);
 int get_pending_frames(void);
 
-#endif
\ No newline at end of file
+#endif
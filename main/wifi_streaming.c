@@ -6,9 +6,19 @@
 #include "esp_netif.h"
 #include "esp_camera.h"
 #include "esp_http_server.h"
+#include "frame_broadcast.h"
+#include "stream_send.h"
+#include "stream_metrics.h"
+#include "rtp_stream.h"
+#include "stream_congestion.h"
+#include "stream_senders.h"
+#include "frame_clock.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 static const char *TAG = "WIFI";
@@ -21,11 +31,6 @@ static EventGroupHandle_t s_wifi_event_group;
 static int s_retry_num = 0;
 static httpd_handle_t stream_server = NULL;
 
-// 视频流相关定义
-#define STREAM_CONTENT_TYPE "multipart/x-mixed-replace;boundary=123456789000000000000987654321"
-#define STREAM_BOUNDARY "\r\n--123456789000000000000987654321\r\n"
-#define STREAM_PART "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n"
-
 // WiFi事件处理
 static void event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
 {
@@ -130,162 +135,323 @@ esp_err_t wifi_init_sta(void)
     
 }
 
-// 视频流处理
-static esp_err_t stream_handler(httpd_req_t *req)
+// /stream 的查询参数, 例如 ?lowlatency=1&fps=15&max_delay_ms=300
+#define STREAM_QUERY_LEN 64
+
+// 取整数参数, 没有该参数或不在 [min, max] 内时返回 0
+static int stream_query_int(httpd_req_t *req, const char *key, int min, int max)
+{
+    char query[STREAM_QUERY_LEN];
+    char value[8];
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, key, value, sizeof(value)) != ESP_OK) {
+        return 0;
+    }
+    int v = atoi(value);
+    return v >= min && v <= max ? v : 0;
+}
+
+// ?fps=N 限制推给该客户端的帧率, 不带参数时每个新帧都推
+#define STREAM_MAX_FPS 60
+static int stream_fps_requested(httpd_req_t *req)
+{
+    return stream_query_int(req, "fps", 1, STREAM_MAX_FPS);
+}
+
+// ?max_delay_ms=N 覆盖该客户端允许的最大排队时延, 不带参数时用 CONFIG_STREAM_MAX_QUEUE_DELAY_MS
+static uint32_t stream_max_delay_requested(httpd_req_t *req)
+{
+    int ms = stream_query_int(req, "max_delay_ms", STREAM_MIN_QUEUE_DELAY_LIMIT_MS, STREAM_MAX_QUEUE_DELAY_LIMIT_MS);
+    if (!ms) {
+        return STREAM_MAX_QUEUE_DELAY_MS;
+    }
+    ESP_LOGI(TAG, "最大排队时延 %d ms", ms);
+    return (uint32_t)ms;
+}
+
+// 视频流推送, 在推流发送任务里运行, 不占用httpd任务
+static esp_err_t stream_client_run(httpd_req_t *req, stream_sender_stats_t *stats)
 {
+    broadcast_frame_t *frame = NULL;
     camera_fb_t *fb = NULL;
+    uint32_t last_seq = 0;
+    uint32_t last_sent_seq = 0;
     esp_err_t res = ESP_OK;
-    char part_buf[128];
-    size_t frame_count = 0;
-    size_t error_count = 0;
     size_t dropped_frames = 0;  // 统计丢帧数
-    const size_t max_errors = 5;
+    size_t error_count = 0;
+    stream_congestion_t cc;
+    frame_clock_t clock;
+    int fps = stream_fps_requested(req);
 
     ESP_LOGI(TAG, "开始视频流传输");
 
-    res = httpd_resp_set_type(req, STREAM_CONTENT_TYPE);
-    if (res != ESP_OK) return res;
-    
-    // 优化HTTP头
-    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
-    httpd_resp_set_hdr(req, "Pragma", "no-cache");
-    httpd_resp_set_hdr(req, "Connection", "keep-alive");
-    httpd_resp_set_hdr(req, "Keep-Alive", "timeout=5, max=100");  // 添加keep-alive参数
-
-    while (true) {
-        // 关键优化：立即获取最新帧，清空缓冲区
-        fb = esp_camera_fb_get();
-        if (!fb) {
-            ESP_LOGW(TAG, "摄像头获取失败");
-            vTaskDelay(50 / portTICK_PERIOD_MS);  // 减少延时
+    // 订阅采集广播, 所有客户端共享同一次采集
+    int sub = frame_broadcast_subscribe();
+    if (sub < 0) {
+        ESP_LOGW(TAG, "观看人数已满");
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    // 直接在socket上写响应头, 之后整条连接只用于推流, 不使用chunked编码
+    int fd = httpd_req_to_sockfd(req);
+    res = stream_send_http_header(fd);
+    if (res != ESP_OK) {
+        frame_broadcast_unsubscribe(sub);
+        return ESP_FAIL;
+    }
+    stream_congestion_init(&cc, esp_timer_get_time(), stream_max_delay_requested(req));
+    if (fps && frame_clock_init(&clock, "stream", FRAME_CLOCK_PERIOD_US(fps)) != ESP_OK) {
+        ESP_LOGW(TAG, "帧时钟创建失败, 不限制帧率");
+        fps = 0;
+    }
+    if (fps) {
+        ESP_LOGI(TAG, "限制帧率 %d fps", fps);
+    }
+
+    while (!stream_senders_stopping()) {
+        // 限帧率时按节拍取帧, 两个节拍之间到达的帧只留最新的一个
+        if (fps) {
+            frame_clock_wait(&clock);
+        }
+        // 关键优化：只取最新帧，发送期间错过的帧直接跳过
+        frame = frame_broadcast_acquire(sub, last_seq, 1000 / portTICK_PERIOD_MS);
+        if (!frame) {
+            if (fps) {
+                frame_clock_reset(&clock);
+            }
             continue;
         }
-        
-        frame_count++;
-
-        // 更激进的跳帧策略
-        int skip_frames = 2;  // 固定跳2帧，只发送1帧
-        if (error_count > 1) {
-            skip_frames = 12;  // 错误时跳更多
+        last_seq = frame->seq;
+        fb = frame->fb;
+        // 该客户端落后最新帧多少帧
+        if (last_sent_seq) {
+            stats->queue_depth = frame_broadcast_latest_seq() - last_sent_seq;
         }
-        
-        if (frame_count % skip_frames != 0) {
-            esp_camera_fb_return(fb);
+
+        // 按链路排空速度决定发不发: 预测排队时延超过上限就跳过这一帧
+        if (!stream_congestion_should_send(&cc, fb->len, esp_timer_get_time())) {
+            frame_broadcast_release(frame);
             dropped_frames++;
-            
-            // 重要：不要延时！立即获取下一帧
-            continue;  
+            stats->frames_skipped++;
+            stream_metrics_drop(STREAM_DROP_SKIP);
+            continue;
         }
 
-        // 大帧检查 - 根据错误情况动态调整阈值
-        size_t max_frame_size = (error_count > 2) ? 15 * 1024 : 25 * 1024;
-        if (fb->len > max_frame_size) {
-            ESP_LOGW(TAG, "帧过大 (%zu KB)，跳过", fb->len / 1024);
-            esp_camera_fb_return(fb);
-            dropped_frames++;
-            continue;  // 不延时
+        // 边界、JPEG头和图像数据一次writev发出, 直接从帧缓冲发送
+        int64_t first_byte_us = 0;
+        int64_t start_us = esp_timer_get_time();
+        res = stream_send_frame(fd, fb, &first_byte_us);
+        int64_t end_us = esp_timer_get_time();
+        if (res == ESP_OK) {
+            stream_metrics_frame_sent(fb, first_byte_us, end_us, fb->len);
+            stream_congestion_on_sent(&cc, fb->len, start_us, end_us);
+            last_sent_seq = last_seq;
+            stats->frames_sent++;
         }
+        frame_broadcast_release(frame);
 
-        // 发送边界
-        res = httpd_resp_send_chunk(req, STREAM_BOUNDARY, strlen(STREAM_BOUNDARY));
         if (res != ESP_OK) {
-            ESP_LOGW(TAG, "发送边界失败: %s (错误计数: %zu)", esp_err_to_name(res), error_count);
-            esp_camera_fb_return(fb);
-
-            // 检查是否是连接断开
-            if (res == ESP_ERR_HTTPD_RESP_SEND || res == ESP_ERR_HTTPD_INVALID_REQ) {
+            stream_metrics_drop(STREAM_DROP_SEND_FAIL);
+            // 连接断开或帧只发出一部分, 流已无法继续
+            if (res != ESP_ERR_TIMEOUT) {
                 ESP_LOGI(TAG, "客户端已断开连接，结束视频流");
-                break; // 直接退出循环
+                break;
             }
-
+            // 整帧都没写出去, 降低估算速度, 后面的帧会被自动跳过直到积压排空
             error_count++;
-            if (error_count >= max_errors) {
-                ESP_LOGI(TAG, "错误过多，暂停5秒后重试");
-                vTaskDelay(5000 / portTICK_PERIOD_MS);
-                error_count = 0;
-                continue;
-            }
-            vTaskDelay(500 / portTICK_PERIOD_MS);
+            stream_congestion_on_timeout(&cc, end_us);
+            ESP_LOGW(TAG, "发送超时 (错误计数: %zu, 估算速度 %lu KB/s)",
+                     error_count, (unsigned long)(cc.rate_bps / 1024));
             continue;
         }
 
-        // 发送JPEG头
-        size_t hlen = snprintf(part_buf, 128, STREAM_PART, fb->len);
-        res = httpd_resp_send_chunk(req, part_buf, hlen);
-        if (res != ESP_OK) {
-            ESP_LOGW(TAG, "发送头部失败: %s (错误计数: %zu)", esp_err_to_name(res), error_count);
-            esp_camera_fb_return(fb);
+        // 状态输出
+        if (stats->frames_sent % 20 == 0) {
+            ESP_LOGI(TAG, "发送: %lu 帧, 丢弃: %zu 帧, 错误: %zu, 估算速度 %lu KB/s",
+                     (unsigned long)stats->frames_sent, dropped_frames, error_count, (unsigned long)(cc.rate_bps / 1024));
+        }
+    }
+    
+    if (fps) {
+        frame_clock_deinit(&clock);
+    }
+    frame_broadcast_unsubscribe(sub);
+    ESP_LOGI(TAG, "视频流传输结束，总丢帧: %zu", dropped_frames);
+    // 返回失败让httpd关闭这个已被推流占用的连接
+    return ESP_FAIL;
+}
 
-            if (res == ESP_ERR_HTTPD_RESP_SEND || res == ESP_ERR_HTTPD_INVALID_REQ) {
-                ESP_LOGI(TAG, "客户端已断开连接，结束视频流");
-                break;
-            }
+// 低延迟视频流: 帧还在采集时就把已到达的 JPEG 数据写进socket, 首字节不用等整帧结束
+// 部分头不带 Content-Length, 帧中途被驱动丢弃时这一部分是坏图, 浏览器会跳过
+static esp_err_t stream_client_run_lowlatency(httpd_req_t *req, stream_sender_stats_t *stats)
+{
+    uint32_t last_sent_seq = 0;
+    size_t prev_len = 0;        // 上一帧的长度, 帧开始时还不知道本帧多大, 拿它做拥塞判断
+    size_t dropped_frames = 0;
+    size_t aborted_frames = 0;
+    esp_err_t res = ESP_OK;
+    stream_congestion_t cc;
 
-            error_count++;
-            if (error_count >= max_errors) {
-                ESP_LOGI(TAG, "错误过多，暂停5秒后重试");
-                vTaskDelay(5000 / portTICK_PERIOD_MS);
-                error_count = 0;
-                continue;
-            }
-            vTaskDelay(500 / portTICK_PERIOD_MS);
+    ESP_LOGI(TAG, "开始低延迟视频流传输");
+
+    int sub = frame_broadcast_subscribe();
+    if (sub < 0) {
+        ESP_LOGW(TAG, "观看人数已满");
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    int fd = httpd_req_to_sockfd(req);
+    if (stream_send_http_header(fd) != ESP_OK) {
+        frame_broadcast_unsubscribe(sub);
+        return ESP_FAIL;
+    }
+    stream_congestion_init(&cc, esp_timer_get_time(), stream_max_delay_requested(req));
+
+    while (!stream_senders_stopping()) {
+        uint32_t id = frame_broadcast_partial_begin(sub, 1000 / portTICK_PERIOD_MS);
+        if (!id) {
             continue;
         }
-
-        // 分块发送图像数据
-        const size_t chunk_size = 2024;
-        size_t sent = 0;
-        bool send_failed = false;
-
-        while (sent < fb->len && !send_failed) {
-            size_t to_send = (fb->len - sent) > chunk_size ? chunk_size : (fb->len - sent);
-
-            res = httpd_resp_send_chunk(req, (const char *)fb->buf + sent, to_send);
-            if (res != ESP_OK) {
-                ESP_LOGW(TAG, "发送数据块失败: %s", esp_err_to_name(res));
-                // 检查是否是连接断开
-                if (res == ESP_ERR_HTTPD_RESP_SEND || res == ESP_ERR_HTTPD_INVALID_REQ) {
-                    ESP_LOGI(TAG, "客户端已断开连接，结束视频流");
-                    send_failed = true;
-                    break;
-                }
-                send_failed = true;
-                break;
-            }
-            sent += to_send;
-            vTaskDelay(5 / portTICK_PERIOD_MS);
+        if (last_sent_seq) {
+            stats->queue_depth = frame_broadcast_latest_seq() - last_sent_seq;
+        }
+        if (!stream_congestion_should_send(&cc, prev_len, esp_timer_get_time())) {
+            // 跳过的帧也马上还给驱动, 不占着帧缓冲等下一帧
+            frame_broadcast_partial_end(sub);
+            dropped_frames++;
+            stats->frames_skipped++;
+            stream_metrics_drop(STREAM_DROP_SKIP);
+            continue;
         }
 
-        esp_camera_fb_return(fb);
+        res = stream_send_part_header(fd);
+        if (res == ESP_ERR_TIMEOUT) {
+            // 部分头都没写出去, 流仍然完整, 当作跳过这一帧
+            frame_broadcast_partial_end(sub);
+            stream_congestion_on_timeout(&cc, esp_timer_get_time());
+            stream_metrics_drop(STREAM_DROP_SEND_FAIL);
+            continue;
+        }
 
-        if (send_failed) {
-            error_count++;
-            if (error_count >= max_errors) {
-                ESP_LOGI(TAG, "错误过多，暂停5秒后重试");
-                vTaskDelay(5000 / portTICK_PERIOD_MS);
-                error_count = 0;
+        // 按到达顺序一段段发送, 只累计 writev 本身的时间给拥塞估算, 等传感器的时间不算
+        camera_fb_t *fb = NULL;
+        size_t sent = 0;
+        size_t avail = 0;
+        bool done = false;
+        int64_t first_byte_us = 0;
+        int64_t blocked_us = 0;
+        while (res == ESP_OK && !done) {
+            res = frame_broadcast_partial_wait(sub, id, &fb, &avail, &done, 1000 / portTICK_PERIOD_MS);
+            if (res != ESP_OK || avail <= sent) {
                 continue;
             }
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
+            int64_t start_us = esp_timer_get_time();
+            res = stream_send_data(fd, fb->buf + sent, avail - sent, first_byte_us ? NULL : &first_byte_us);
+            blocked_us += esp_timer_get_time() - start_us;
+            sent = avail;
+        }
+        int64_t end_us = esp_timer_get_time();
+
+        if (res == ESP_ERR_INVALID_STATE || res == ESP_ERR_TIMEOUT) {
+            // 帧被丢弃: 这一部分已经发出的数据只能作废, 下一条边界会结束它
+            aborted_frames++;
+            stream_metrics_drop(STREAM_DROP_SEND_FAIL);
+            frame_broadcast_partial_end(sub);
             continue;
         }
+        if (res != ESP_OK) {
+            // 帧只发出一部分, 流已无法继续
+            frame_broadcast_partial_end(sub);
+            stream_metrics_drop(STREAM_DROP_SEND_FAIL);
+            ESP_LOGI(TAG, "客户端已断开连接，结束视频流");
+            break;
+        }
 
-        // 发送成功，重置错误计数
-        error_count = 0;
+        // 分片时还不知道EOI在哪, 最后一段可能多发了EOI之后的几个字节, 解码器会忽略
+        stream_metrics_frame_sent(fb, first_byte_us, end_us, sent);
+        last_sent_seq = frame_broadcast_latest_seq();
+        stream_congestion_on_sent(&cc, sent, end_us - blocked_us, end_us);
+        frame_broadcast_partial_end(sub);
+        prev_len = avail;
+        stats->frames_sent++;
+
+        if (stats->frames_sent % 20 == 0) {
+            ESP_LOGI(TAG, "低延迟发送: %lu 帧, 丢弃: %zu 帧, 中途作废: %zu, 估算速度 %lu KB/s",
+                     (unsigned long)stats->frames_sent, dropped_frames, aborted_frames,
+                     (unsigned long)(cc.rate_bps / 1024));
+        }
+    }
 
-        // 自适应帧间延时
-        int frame_delay = (error_count > 0) ? 200 : 50;
-        vTaskDelay(frame_delay / portTICK_PERIOD_MS);
-        
-        // 状态输出
-        if ((frame_count / skip_frames) % 20 == 0) {
-            ESP_LOGI(TAG, "发送: %zu 帧, 丢弃: %zu 帧, 错误: %zu", 
-                     frame_count / skip_frames, dropped_frames, error_count);
+    frame_broadcast_unsubscribe(sub);
+    ESP_LOGI(TAG, "低延迟视频流传输结束，总丢帧: %zu", dropped_frames);
+    return ESP_FAIL;
+}
+
+// /stream?lowlatency=1 选择低延迟模式
+static bool stream_lowlatency_requested(httpd_req_t *req)
+{
+    char query[STREAM_QUERY_LEN];
+    char value[4];
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "lowlatency", value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    return strcmp(value, "1") == 0;
+}
+
+// 视频流处理: 交给推流发送任务, httpd任务立即返回
+static esp_err_t stream_handler(httpd_req_t *req)
+{
+    stream_sender_fn_t fn = stream_client_run;
+    if (stream_lowlatency_requested(req)) {
+        if (frame_broadcast_partial_supported()) {
+            fn = stream_client_run_lowlatency;
+        } else {
+            ESP_LOGW(TAG, "当前格式不支持低延迟模式, 使用整帧推流");
         }
     }
-    
-    ESP_LOGI(TAG, "视频流传输结束，总丢帧: %zu", dropped_frames);
+
+    esp_err_t err = stream_senders_submit(req, fn);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "没有空闲的推流发送任务: %s", esp_err_to_name(err));
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    return ESP_OK;
+}
+
+// 静态截图: 直接返回广播器缓存的最新帧, 不额外采集
+// ETag 为帧序号, 帧没变时返回 304
+static esp_err_t snapshot_handler(httpd_req_t *req)
+{
+    broadcast_frame_t *frame = frame_broadcast_acquire_latest();
+    if (!frame) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    char etag[16];
+    snprintf(etag, sizeof(etag), "\"%lu\"", (unsigned long)frame->seq);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    char if_none_match[32];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strcmp(if_none_match, etag) == 0) {
+        frame_broadcast_release(frame);
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    // 发送期间持有引用, 帧缓冲不会被驱动覆盖
+    httpd_resp_set_type(req, "image/jpeg");
+    esp_err_t res = httpd_resp_send(req, (const char *)frame->fb->buf, frame->fb->len);
+    frame_broadcast_release(frame);
     return res;
 }
 
@@ -328,7 +494,7 @@ esp_err_t start_streaming_server(void)
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = 80;
     config.stack_size = 8192;            // 增加栈大小
-    config.max_open_sockets = 2;         // 增加最大连接数
+    config.max_open_sockets = FRAME_BROADCAST_MAX_SUBSCRIBERS + 1;  // 每个观看者一个连接, 外加主页
     config.task_priority = 6;            // 提高任务优先级
     config.core_id = 1;                  // 绑定核心1
     config.send_wait_timeout = 5;        // 增加发送超时时间
@@ -339,25 +505,43 @@ esp_err_t start_streaming_server(void)
     config.keep_alive_interval = 3;      // keep-alive间隔
     config.keep_alive_count = 5;         // keep-alive重试次数
 
+    // 帧广播, 所有 /stream 客户端共享
+    if (frame_broadcast_start() != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (stream_senders_start() != ESP_OK) {
+        frame_broadcast_stop();
+        return ESP_FAIL;
+    }
     
     if (httpd_start(&stream_server, &config) == ESP_OK) {
         httpd_uri_t index_uri = {.uri = "/", .method = HTTP_GET, .handler = index_handler};
         httpd_uri_t stream_uri = {.uri = "/stream", .method = HTTP_GET, .handler = stream_handler};
+        httpd_uri_t snapshot_uri = {.uri = "/snapshot", .method = HTTP_GET, .handler = snapshot_handler};
         
         httpd_register_uri_handler(stream_server, &index_uri);
         httpd_register_uri_handler(stream_server, &stream_uri);
+        httpd_register_uri_handler(stream_server, &snapshot_uri);
+        stream_metrics_register(stream_server);
+        rtp_stream_register(stream_server);
         
         ESP_LOGI(TAG, "HTTP服务器启动成功");
         return ESP_OK;
     }
+    stream_senders_stop();
+    frame_broadcast_stop();
     return ESP_FAIL;
 }
 
 // 停止服务器
 void stop_streaming_server(void)
 {
+    rtp_stream_stop();
+    // 先让推流任务结束并交还异步请求, 再停止httpd
+    stream_senders_stop();
     if (stream_server) {
         httpd_stop(stream_server);
         stream_server = NULL;
     }
+    frame_broadcast_stop();
 }
\ No newline at end of file
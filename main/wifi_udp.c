@@ -4,6 +4,7 @@
 #include "esp_netif.h"
 #include "lwip/sockets.h"
 #include "lwip/inet.h"
+#include "frame_clock.h"
 #include <string.h>
 
 #define UDP_BROADCAST_PORT 45678
@@ -28,7 +29,17 @@ static void udp_broadcast_task(void *pvParameter)
     broadcast_addr.sin_port = htons(UDP_BROADCAST_PORT);
     broadcast_addr.sin_addr.s_addr = inet_addr("255.255.255.255");
 
+    // 按固定周期广播, 不受发送耗时影响
+    frame_clock_t clock;
+    if (frame_clock_init(&clock, "udp_broadcast", UDP_BROADCAST_INTERVAL_MS * 1000LL) != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to create broadcast clock");
+        close(sock);
+        vTaskDelete(NULL);
+        return;
+    }
+
     while (1) {
+        frame_clock_wait(&clock);
         // 获取本机IP
         esp_netif_ip_info_t ip_info;
         esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
@@ -41,9 +52,9 @@ static void udp_broadcast_task(void *pvParameter)
                    (struct sockaddr *)&broadcast_addr, sizeof(broadcast_addr));
             ESP_LOGI(TAG, "UDP广播本机IP: %s", msg);
         }
-        vTaskDelay(UDP_BROADCAST_INTERVAL_MS / portTICK_PERIOD_MS);
     }
     // 不会走到这里
+    frame_clock_deinit(&clock);
     close(sock);
     vTaskDelete(NULL);
 }
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""/ws 推流测试客户端, 只依赖标准库.
+
+连接 ESP32(或 linux 主机目标)的 /ws 端点, 解析每条二进制消息的 20 字节消息头,
+检查帧序号递增、len 与实际 JPEG 长度一致、JPEG 以 SOI 开头 EOI 结尾, 最后打印统计.
+有任何帧不合格时退出码为 1.
+
+    python3 tools/ws_client.py 192.168.1.100 --port 8080 --frames 100 --save /tmp/frames
+"""
+
+import argparse
+import base64
+import os
+import socket
+import struct
+import sys
+import time
+
+HDR = struct.Struct('<IQHHI')   # seq, timestamp_us, width, height, len
+OP_CONT, OP_TEXT, OP_BINARY, OP_CLOSE, OP_PING, OP_PONG = 0x0, 0x1, 0x2, 0x8, 0x9, 0xA
+
+
+def recv_exact(sock, n):
+    buf = bytearray()
+    while len(buf) < n:
+        chunk = sock.recv(n - len(buf))
+        if not chunk:
+            raise ConnectionError('连接已关闭')
+        buf += chunk
+    return bytes(buf)
+
+
+def handshake(sock, host, port, path):
+    key = base64.b64encode(os.urandom(16)).decode()
+    req = (f'GET {path} HTTP/1.1\r\n'
+           f'Host: {host}:{port}\r\n'
+           'Upgrade: websocket\r\n'
+           'Connection: Upgrade\r\n'
+           f'Sec-WebSocket-Key: {key}\r\n'
+           'Sec-WebSocket-Version: 13\r\n\r\n')
+    sock.sendall(req.encode())
+    resp = b''
+    while b'\r\n\r\n' not in resp:
+        chunk = sock.recv(1024)
+        if not chunk:
+            raise ConnectionError('握手时连接关闭')
+        resp += chunk
+    status = resp.split(b'\r\n', 1)[0]
+    if b' 101 ' not in status:
+        raise ConnectionError(f'握手失败: {status.decode(errors="replace")}')
+    # 握手响应后面可能已经跟着第一帧的数据
+    return resp.split(b'\r\n\r\n', 1)[1]
+
+
+def send_frame(sock, opcode, payload=b''):
+    # 客户端发出的帧必须带掩码
+    mask = os.urandom(4)
+    head = bytes([0x80 | opcode])
+    if len(payload) < 126:
+        head += bytes([0x80 | len(payload)])
+    else:
+        head += bytes([0x80 | 126]) + struct.pack('>H', len(payload))
+    body = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+    sock.sendall(head + mask + body)
+
+
+class Reader:
+    def __init__(self, sock, pending):
+        self.sock = sock
+        self.pending = pending
+
+    def read(self, n):
+        if len(self.pending) >= n:
+            data, self.pending = self.pending[:n], self.pending[n:]
+            return data
+        data, self.pending = self.pending, b''
+        return data + recv_exact(self.sock, n - len(data))
+
+    def message(self):
+        """读一条完整消息(合并分片), 自动回复 ping, 返回 (opcode, payload)"""
+        opcode = None
+        payload = b''
+        while True:
+            b0, b1 = self.read(2)
+            fin, op = b0 & 0x80, b0 & 0x0F
+            length = b1 & 0x7F
+            if length == 126:
+                length, = struct.unpack('>H', self.read(2))
+            elif length == 127:
+                length, = struct.unpack('>Q', self.read(8))
+            mask = self.read(4) if b1 & 0x80 else None
+            data = self.read(length)
+            if mask:
+                data = bytes(b ^ mask[i % 4] for i, b in enumerate(data))
+            if op == OP_PING:
+                send_frame(self.sock, OP_PONG, data)
+                continue
+            if op in (OP_CLOSE, OP_PONG):
+                return op, data
+            if op != OP_CONT:
+                opcode = op
+            payload += data
+            if fin:
+                return opcode, payload
+
+
+def check_frame(payload, last_seq):
+    """返回 (header, 错误描述或None)"""
+    if len(payload) < HDR.size:
+        return None, f'消息只有 {len(payload)} 字节, 不够消息头'
+    seq, ts, width, height, length = HDR.unpack_from(payload)
+    jpeg = payload[HDR.size:]
+    hdr = (seq, ts, width, height, length)
+    if length != len(jpeg):
+        return hdr, f'len={length} 但实际 JPEG {len(jpeg)} 字节'
+    if last_seq and seq <= last_seq:
+        return hdr, f'帧序号没有递增: {last_seq} -> {seq}'
+    if jpeg[:2] != b'\xff\xd8' or jpeg[-2:] != b'\xff\xd9':
+        return hdr, 'JPEG 缺少 SOI/EOI'
+    return hdr, None
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    ap.add_argument('host')
+    ap.add_argument('--port', type=int, default=8080)
+    ap.add_argument('--path', default='/ws')
+    ap.add_argument('--frames', type=int, default=50, help='收到多少帧后退出')
+    ap.add_argument('--timeout', type=float, default=10.0, help='等待单帧的超时(秒)')
+    ap.add_argument('--save', help='把每帧 JPEG 存到这个目录')
+    args = ap.parse_args()
+
+    if args.save:
+        os.makedirs(args.save, exist_ok=True)
+
+    sock = socket.create_connection((args.host, args.port), timeout=args.timeout)
+    reader = Reader(sock, handshake(sock, args.host, args.port, args.path))
+
+    last_seq = 0
+    lost = errors = received = 0
+    start = time.monotonic()
+    try:
+        while received < args.frames:
+            op, payload = reader.message()
+            if op == OP_CLOSE:
+                print('服务器关闭了连接')
+                break
+            if op != OP_BINARY:
+                continue
+            received += 1
+            hdr, err = check_frame(payload, last_seq)
+            if err:
+                errors += 1
+                print(f'帧 #{hdr[0] if hdr else "?"}: {err}')
+            if not hdr:
+                continue
+            seq, ts, width, height, length = hdr
+            if last_seq and seq > last_seq + 1:
+                lost += seq - last_seq - 1
+            last_seq = max(last_seq, seq)
+            print(f'帧 #{seq} {width}x{height} {length}B 时间戳 {ts}us')
+            if args.save and not err:
+                with open(os.path.join(args.save, f'{seq:06d}.jpg'), 'wb') as f:
+                    f.write(payload[HDR.size:])
+    finally:
+        try:
+            send_frame(sock, OP_CLOSE, struct.pack('>H', 1000))
+        except OSError:
+            pass
+        sock.close()
+
+    elapsed = time.monotonic() - start
+    fps = received / elapsed if elapsed > 0 else 0.0
+    print(f'收到 {received} 帧, {fps:.1f} fps, 丢帧 {lost}, 错误 {errors}')
+    return 1 if errors or received == 0 else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())